@@ -0,0 +1,35 @@
+# Checks the conversions of "time_tool --stream", on both a file and
+# stdin. Run by ctest as:
+#     cmake -DTIME_TOOL=<time_tool> -DWORK_DIR=<dir> -P TimeToolStreamTest.cmake
+
+function(expect_stream name input expected)
+  set(path "${WORK_DIR}/time_tool_stream_test_${name}")
+  file(WRITE "${path}" "${input}")
+  foreach(source file stdin)
+    if (source STREQUAL "file")
+      execute_process(COMMAND "${TIME_TOOL}" --stream ${ARGN} "${path}"
+        OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    else()
+      execute_process(COMMAND "${TIME_TOOL}" --stream ${ARGN}
+        INPUT_FILE "${path}" OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    endif()
+    if (NOT result EQUAL 0 OR NOT output STREQUAL expected)
+      file(REMOVE "${path}")
+      message(FATAL_ERROR "${name} (${source}): exit ${result}, output:\n"
+                          "${output}\nexpected:\n${expected}")
+    endif()
+  endforeach()
+  file(REMOVE "${path}")
+endfunction()
+
+# Timestamps with offsets, and lines without timestamps, which are copied.
+expect_stream(offsets
+  "2020-01-01T00:00:00+00:00 given\n2020-07-01T12:34:56.25-04:00 subsec\nnone\n\n1999-12-31T23:59:59Z last"
+  "2020-01-01T09:00:00+09:00 given\n2020-07-02T01:34:56.25+09:00 subsec\nnone\n\n2000-01-01T08:59:59+09:00 last"
+  --from=America/New_York --to=Asia/Tokyo)
+
+# Civil timestamps, in the "from" zone.
+expect_stream(civil
+  "2020-01-01 00:00:00 winter\n2020-07-01 12:00:00 summer\n"
+  "2020-01-01 05:00:00 winter\n2020-07-01 16:00:00 summer\n"
+  --from=America/New_York --to=UTC "--in-format=%Y-%m-%d %H:%M:%S")
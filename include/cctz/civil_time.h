@@ -320,6 +320,28 @@ using detail::prev_weekday;
 //
 using detail::get_yearday;
 
+// Array forms of civil_day and civil_month arithmetic, for bucketing many
+// values at once. Each out[i] is the same as the scalar expression noted,
+// but, for years within about a million of year 0, is computed in closed
+// form, without loops or data-dependent branches (see Neri and Schneider,
+// "Euclidean affine functions and their application to calendar
+// algorithms", 2022). Other values fall back to the scalar operators.
+//
+//   add_days(origin, n, count, out);            // out[i] = origin + n[i]
+//   add_months(origin, n, count, out);          // out[i] = origin + n[i]
+//   day_differences(cd, count, origin, out);    // out[i] = cd[i] - origin
+//   month_differences(cm, count, origin, out);  // out[i] = cm[i] - origin
+//
+// Example:
+//   std::vector<std::int_fast64_t> days = ...;  // days since 1970-01-01
+//   std::vector<civil_day> cds(days.size());
+//   add_days(civil_day(1970, 1, 1), days.data(), days.size(), cds.data());
+//
+using detail::add_days;
+using detail::add_months;
+using detail::day_differences;
+using detail::month_differences;
+
 }  // namespace cctz
 
 #endif  // CCTZ_CIVIL_TIME_H_
@@ -15,6 +15,7 @@
 #ifndef CCTZ_CIVIL_TIME_DETAIL_H_
 #define CCTZ_CIVIL_TIME_DETAIL_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <ostream>
@@ -338,6 +339,9 @@ CONSTEXPR_F fields align(year_tag, fields f) noexcept {
 
 ////////////////////////////////////////////////////////////////////////
 
+struct civil_time_kernels;
+class time_zone_era;
+
 template <typename T>
 class civil_time {
  public:
@@ -429,6 +433,8 @@ class civil_time {
   // private constructor and access the private fields member.
   template <typename U>
   friend class civil_time;
+  friend struct civil_time_kernels;  // builds results from fields directly
+  friend class time_zone_era;        // likewise
 
   // The designated constructor that all others eventually call.
   explicit CONSTEXPR_M civil_time(fields f) noexcept : f_(align(T{}, f)) {}
@@ -526,44 +532,16 @@ CONSTEXPR_F weekday get_weekday(const civil_second& cs) noexcept {
 
 ////////////////////////////////////////////////////////////////////////
 
+// The weekdays are numbered from Monday, so the distance forward from a day
+// of weekday "base" to the next "wd" is in [1:7].
 CONSTEXPR_F civil_day next_weekday(civil_day cd, weekday wd) noexcept {
-  CONSTEXPR_D weekday k_weekdays_forw[14] = {
-      weekday::monday,    weekday::tuesday,  weekday::wednesday,
-      weekday::thursday,  weekday::friday,   weekday::saturday,
-      weekday::sunday,    weekday::monday,   weekday::tuesday,
-      weekday::wednesday, weekday::thursday, weekday::friday,
-      weekday::saturday,  weekday::sunday,
-  };
-  weekday base = get_weekday(cd);
-  for (int i = 0;; ++i) {
-    if (base == k_weekdays_forw[i]) {
-      for (int j = i + 1;; ++j) {
-        if (wd == k_weekdays_forw[j]) {
-          return cd + (j - i);
-        }
-      }
-    }
-  }
+  const int base = static_cast<int>(get_weekday(cd));
+  return cd + ((static_cast<int>(wd) - base + 6) % 7 + 1);
 }
 
 CONSTEXPR_F civil_day prev_weekday(civil_day cd, weekday wd) noexcept {
-  CONSTEXPR_D weekday k_weekdays_back[14] = {
-      weekday::sunday,   weekday::saturday,  weekday::friday,
-      weekday::thursday, weekday::wednesday, weekday::tuesday,
-      weekday::monday,   weekday::sunday,    weekday::saturday,
-      weekday::friday,   weekday::thursday,  weekday::wednesday,
-      weekday::tuesday,  weekday::monday,
-  };
-  weekday base = get_weekday(cd);
-  for (int i = 0;; ++i) {
-    if (base == k_weekdays_back[i]) {
-      for (int j = i + 1;; ++j) {
-        if (wd == k_weekdays_back[j]) {
-          return cd - (j - i);
-        }
-      }
-    }
-  }
+  const int base = static_cast<int>(get_weekday(cd));
+  return cd - ((base - static_cast<int>(wd) + 6) % 7 + 1);
 }
 
 CONSTEXPR_F int get_yearday(const civil_second& cs) noexcept {
@@ -576,6 +554,18 @@ CONSTEXPR_F int get_yearday(const civil_second& cs) noexcept {
 
 ////////////////////////////////////////////////////////////////////////
 
+// Array forms of civil_day and civil_month arithmetic (see civil_time.h).
+void add_days(const civil_day& origin, const diff_t* n, std::size_t count,
+              civil_day* out) noexcept;
+void add_months(const civil_month& origin, const diff_t* n,
+                std::size_t count, civil_month* out) noexcept;
+void day_differences(const civil_day* cd, std::size_t count,
+                     const civil_day& origin, diff_t* out) noexcept;
+void month_differences(const civil_month* cm, std::size_t count,
+                       const civil_month& origin, diff_t* out) noexcept;
+
+////////////////////////////////////////////////////////////////////////
+
 std::ostream& operator<<(std::ostream& os, const civil_year& y);
 std::ostream& operator<<(std::ostream& os, const civil_month& m);
 std::ostream& operator<<(std::ostream& os, const civil_day& d);
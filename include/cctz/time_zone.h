@@ -20,11 +20,17 @@
 #ifndef CCTZ_TIME_ZONE_H_
 #define CCTZ_TIME_ZONE_H_
 
+#include <atomic>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "cctz/civil_time.h"
 
@@ -41,6 +47,7 @@ template <typename D>
 std::pair<time_point<seconds>, D> split_seconds(const time_point<D>& tp);
 std::pair<time_point<seconds>, seconds> split_seconds(
     const time_point<seconds>& tp);
+class time_zone_era;
 }  // namespace detail
 
 // cctz::time_zone is an opaque, small, value-type class representing a
@@ -63,17 +70,24 @@ std::pair<time_point<seconds>, seconds> split_seconds(
 // - https://en.wikipedia.org/wiki/Zoneinfo
 class time_zone {
  public:
-  time_zone() : time_zone(nullptr) {}  // Equivalent to UTC
+  time_zone() : impl_(nullptr), era_(nullptr) {}  // Equivalent to UTC
   time_zone(const time_zone&) = default;
   time_zone& operator=(const time_zone&) = default;
 
-  std::string name() const;
+  // The name, version() and description() of a zone are returned by
+  // reference, and each string outlives the zone data it describes (which
+  // is never freed), so callers may keep them without copying.
+  const std::string& name() const;
 
   // An absolute_lookup represents the civil time (cctz::civil_second) within
   // this time_zone at the given absolute time (time_point). There are
   // additionally a few other fields that may be useful when working with
   // older APIs, such as std::tm.
   //
+  // Instants within the zone's current "era" (the span between the two
+  // transitions that surround the current time) are converted inline,
+  // without a search or a lock.
+  //
   // Example:
   //   const cctz::time_zone tz = ...
   //   const auto tp = std::chrono::system_clock::now();
@@ -94,6 +108,19 @@ class time_zone {
     return lookup(detail::split_seconds(tp).first);
   }
 
+  // Performs lookup(tps[i]) for each of the n time_points, storing the
+  // result in als[i]. This is equivalent to, but faster than, looping over
+  // the scalar lookup(), particularly when the input is sorted (or nearly
+  // so), as successive conversions can then reuse each other's work.
+  //
+  // Example:
+  //   const cctz::time_zone tz = ...
+  //   std::vector<cctz::time_point<cctz::seconds>> tps = ...
+  //   std::vector<cctz::time_zone::absolute_lookup> als(tps.size());
+  //   tz.lookup(tps.data(), tps.size(), als.data());
+  void lookup(const time_point<seconds>* tps, std::size_t n,
+              absolute_lookup* als) const;
+
   // A civil_lookup represents the absolute time(s) (time_point) that
   // correspond to the given civil time (cctz::civil_second) within this
   // time_zone. Usually the given civil time represents a unique instant
@@ -147,6 +174,13 @@ class time_zone {
   };
   civil_lookup lookup(const civil_second& cs) const;
 
+  // Performs lookup(css[i]) for each of the n civil times, storing the
+  // result in cls[i]. As with the batch absolute-time lookup() above,
+  // this is cheapest when the input is sorted, and particularly so when
+  // all of the civil times fall between the same pair of transitions.
+  void lookup(const civil_second* css, std::size_t n,
+              civil_lookup* cls) const;
+
   // Finds the time of the next/previous offset change in this time zone.
   //
   // By definition, next_transition(tp, &trans) returns false when tp has
@@ -194,6 +228,157 @@ class time_zone {
     return prev_transition(detail::split_seconds(tp).first, trans);
   }
 
+  class Impl;
+
+  // A transition_range holds the transitions of the time zone at instants
+  // within [begin, end), the same ones that a chain of next_transition()
+  // calls would find, and it can be iterated in either direction. The
+  // transitions are found lazily, and each step carries on through the
+  // zone's transitions from the last, rather than searching again, even
+  // among those generated from the zone's rules for future years. A range
+  // (and its iterators) must only be used while the time zone is alive.
+  // An iterator holds the transition that it refers to, so a reference to
+  // that transition is only valid until the iterator changes.
+  //
+  // Example:
+  //   cctz::time_zone nyc;
+  //   if (!cctz::load_time_zone("America/New_York", &nyc)) { ... }
+  //   for (const auto& trans : nyc.transitions(begin, end)) {
+  //     // transition: trans.from -> trans.to
+  //   }
+  class transition_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = civil_transition;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const civil_transition*;
+    using reference = const civil_transition&;
+
+    transition_iterator() = default;  // a singular iterator
+
+    const civil_transition& operator*() const { return trans_; }
+    const civil_transition* operator->() const { return &trans_; }
+    transition_iterator& operator++();
+    transition_iterator operator++(int) {
+      transition_iterator it = *this;
+      ++*this;
+      return it;
+    }
+    transition_iterator& operator--();
+    transition_iterator operator--(int) {
+      transition_iterator it = *this;
+      --*this;
+      return it;
+    }
+
+    friend bool operator==(const transition_iterator& lhs,
+                           const transition_iterator& rhs) {
+      return lhs.valid_ == rhs.valid_ && (!lhs.valid_ || lhs.at_ == rhs.at_);
+    }
+    friend bool operator!=(const transition_iterator& lhs,
+                           const transition_iterator& rhs) {
+      return !(lhs == rhs);
+    }
+
+   private:
+    friend class time_zone;
+    transition_iterator(const Impl* impl, const time_point<seconds>& end)
+        : impl_(impl), end_(end) {}
+
+    const Impl* impl_ = nullptr;
+    time_point<seconds> end_;  // of the range
+    time_point<seconds> at_;   // the instant of trans_, if valid_
+    civil_transition trans_;
+    std::size_t hint_ = 0;  // where the zone's search for at_ left off
+    bool valid_ = false;    // false when at the end of the range
+  };
+  // A transition_iterator run backwards, as a std::reverse_iterator would,
+  // except that it keeps the transition before base() (the one it refers
+  // to), where std::reverse_iterator would return a reference into its
+  // temporary copy of base(). That transition is found on first use.
+  class reverse_transition_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = civil_transition;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const civil_transition*;
+    using reference = const civil_transition&;
+
+    reverse_transition_iterator() = default;  // a singular iterator
+    explicit reverse_transition_iterator(const transition_iterator& base)
+        : base_(base) {}
+
+    transition_iterator base() const { return base_; }
+    const civil_transition& operator*() const { return *Prev(); }
+    const civil_transition* operator->() const { return &*Prev(); }
+    reverse_transition_iterator& operator++() {
+      base_ = Prev();
+      has_prev_ = false;
+      return *this;
+    }
+    reverse_transition_iterator operator++(int) {
+      reverse_transition_iterator it = *this;
+      ++*this;
+      return it;
+    }
+    reverse_transition_iterator& operator--() {
+      prev_ = base_;
+      has_prev_ = true;
+      ++base_;
+      return *this;
+    }
+    reverse_transition_iterator operator--(int) {
+      reverse_transition_iterator it = *this;
+      --*this;
+      return it;
+    }
+
+    friend bool operator==(const reverse_transition_iterator& lhs,
+                           const reverse_transition_iterator& rhs) {
+      return lhs.base_ == rhs.base_;
+    }
+    friend bool operator!=(const reverse_transition_iterator& lhs,
+                           const reverse_transition_iterator& rhs) {
+      return !(lhs == rhs);
+    }
+
+   private:
+    const transition_iterator& Prev() const {
+      if (!has_prev_) {
+        prev_ = base_;
+        --prev_;
+        has_prev_ = true;
+      }
+      return prev_;
+    }
+
+    transition_iterator base_;
+    mutable transition_iterator prev_;  // std::prev(base_), if has_prev_
+    mutable bool has_prev_ = false;
+  };
+  class transition_range {
+   public:
+    using iterator = transition_iterator;
+    using reverse_iterator = reverse_transition_iterator;
+
+    iterator begin() const { return begin_; }
+    iterator end() const { return end_; }
+    reverse_iterator rbegin() const { return reverse_iterator(end_); }
+    reverse_iterator rend() const { return reverse_iterator(begin_); }
+    bool empty() const { return begin_ == end_; }
+
+   private:
+    friend class time_zone;
+    transition_range(const transition_iterator& begin,
+                     const transition_iterator& end)
+        : begin_(begin), end_(end) {}
+
+    transition_iterator begin_;
+    transition_iterator end_;
+  };
+  transition_range transitions(const time_point<seconds>& begin,
+                               const time_point<seconds>& end) const;
+
   // version() and description() provide additional information about the
   // time zone. The content of each of the returned strings is unspecified,
   // however, when the IANA Time Zone Database is the underlying data source
@@ -201,23 +386,66 @@ class time_zone {
   // empty when unavailable.
   //
   // Note: These functions are for informational or testing purposes only.
-  std::string version() const;  // empty when unknown
-  std::string description() const;
+  const std::string& version() const;  // empty when unknown
+  const std::string& description() const;
 
-  // Relational operators.
+  // Relational operators. Two time_zones are equal when they came from the
+  // same load, so time zones with different names (e.g., "US/Pacific" and
+  // "America/Los_Angeles") are never equal, even when they share data.
+  // Comparisons never examine the names, and take constant time.
   friend bool operator==(time_zone lhs, time_zone rhs) {
+    if (lhs.impl_ == rhs.impl_) return true;
+    if (lhs.impl_ != nullptr && rhs.impl_ != nullptr) return false;
+    // An implicit UTC (see above) may still equal an explicit one.
     return &lhs.effective_impl() == &rhs.effective_impl();
   }
   friend bool operator!=(time_zone lhs, time_zone rhs) {
     return !(lhs == rhs);
   }
 
-  class Impl;
+  // A cursor performs lookups within a time_zone using search state that
+  // it owns, rather than the state shared by all users of the time zone.
+  // Each thread (or other independent stream of conversions) can then
+  // keep its own locality, without contending with the others. A cursor
+  // is cheap to construct and copy, but a single cursor must not be used
+  // concurrently.
+  //
+  // Example:
+  //   const cctz::time_zone tz = ...
+  //   cctz::time_zone::cursor cur(tz);
+  //   for (const auto& tp : this_threads_sorted_time_points) {
+  //     const cctz::time_zone::absolute_lookup al = cur.lookup(tp);
+  //     ...
+  //   }
+  class cursor {
+   public:
+    explicit cursor(const time_zone& tz) : impl_(&tz.effective_impl()) {}
+    cursor(const cursor&) = default;
+    cursor& operator=(const cursor&) = default;
+
+    time_zone zone() const;
+
+    absolute_lookup lookup(const time_point<seconds>& tp);
+    template <typename D>
+    absolute_lookup lookup(const time_point<D>& tp) {
+      return lookup(detail::split_seconds(tp).first);
+    }
+    civil_lookup lookup(const civil_second& cs);
+
+   private:
+    const Impl* impl_;
+    std::size_t absolute_hint_ = 0;  // for absolute-to-civil lookups
+    std::size_t civil_hint_ = 0;     // for civil-to-absolute lookups
+  };
 
  private:
-  explicit time_zone(const Impl* impl) : impl_(impl) {}
+  friend struct std::hash<time_zone>;
+  friend class time_zone_converter;
+  explicit time_zone(const Impl* impl);
   const Impl& effective_impl() const;  // handles implicit UTC
+  absolute_lookup lookup_outside_era(const time_point<seconds>& tp) const;
   const Impl* impl_;
+  const detail::time_zone_era* era_;  // that of impl_, if any
 };
 
 // Loads the named time zone. May perform I/O on the initial load.
@@ -235,7 +463,165 @@ time_zone fixed_time_zone(const seconds& offset);
 
 // Returns a time zone representing the local time zone. Falls back to UTC.
 // Note: local_time_zone.name() may only be something like "localtime".
+//
+// The local time zone is resolved once and then cached, so that later
+// calls cost only an atomic load, a comparison of ${TZ} with the value it
+// was resolved from, and a read of a coarse clock. A changed ${TZ} is
+// resolved again by the very next call. At most once a second, a call
+// also checks whether the zone's file (e.g., /etc/localtime) has been
+// replaced, and reloads the zone if so. So, a replaced file may take up
+// to a second to be noticed, unless it is followed by
+// refresh_local_time_zone(), which resolves the zone at once, consults
+// any other platform settings (e.g., on Android, Apple, or Fuchsia) again,
+// and re-reads the zone data.
 time_zone local_time_zone();
+void refresh_local_time_zone();
+
+// A bundle is a single file holding many zones, already decoded into the
+// tables that cctz uses for lookups. Once a bundle is in use, loading one
+// of its zones is little more than a pointer lookup and a check of its
+// tables, and, as the file is mapped read-only, its pages are shared by
+// every process that uses it.
+//
+// write_time_zone_bundle() writes a bundle of the named zones (as found by
+// load_time_zone()), replacing any existing file. use_time_zone_bundle()
+// maps a bundle, after which load_time_zone() looks for zones there first
+// (zones that are already loaded are unaffected). A bundle is only usable
+// by a cctz build with the same data layout as the writer's. Both return
+// false on failure.
+//
+// Example:
+//   // At build or install time ...
+//   cctz::write_time_zone_bundle("/var/lib/app/tz.bundle", zone_names);
+//   // ... and at startup.
+//   cctz::use_time_zone_bundle("/var/lib/app/tz.bundle");
+bool write_time_zone_bundle(const std::string& path,
+                            const std::vector<std::string>& names);
+bool use_time_zone_bundle(const std::string& path);
+
+// Loads the named time zones, as load_time_zone() would, but concurrently
+// on up to num_threads threads (or one per CPU if num_threads is not
+// positive), so that later loads of those zones need do no I/O or parsing.
+// preload_all_time_zones() does the same for every zone that is listed in
+// the zone1970.tab file, which it obtains just as it would the data for a
+// zone of that name (so that a cctz_extension::zone_info_source_factory may
+// provide it). Where there is no such file, as with Android's tzdata, it
+// preloads nothing. Both return the number of zones that loaded
+// successfully.
+//
+// Example:
+//   // Before accepting requests ...
+//   cctz::preload_all_time_zones(8);
+std::size_t preload_time_zones(const std::vector<std::string>& names,
+                               int num_threads);
+std::size_t preload_all_time_zones(int num_threads);
+
+// Reads every loaded time zone afresh, and, where its tzdata version or
+// its rules have changed, switches it to the new data, so that existing
+// time_zone objects (and later loads) follow the new rules. When the
+// zoneinfo reports a version, only zones at some other version are read
+// again; otherwise only those whose file in ${TZDIR} has been replaced or
+// rewritten since it was read (or that did not come from such a file) are.
+// Changing use_compact_time_zones() alone changes no zone. Lookups never
+// wait for an update, and each sees either the old data or the new. The
+// old data is retained (as absolute_lookup::abbr may still refer to it),
+// so each update of a zone costs the memory of that zone. Returns the
+// number of zones that changed. It is intended to be called from a
+// background thread, say after a tzdata package update.
+//
+// Example:
+//   // Every so often, on a background thread ...
+//   if (cctz::update_time_zones() != 0) LOG(INFO) << "tzdata updated";
+std::size_t update_time_zones();
+
+// A task runner for load_time_zone_async(), which must eventually run
+// each task that it is given (e.g., by posting it to a thread pool).
+using time_zone_executor = std::function<void(std::function<void()> task)>;
+
+// A handle on a load begun by load_time_zone_async(). Copies refer to the
+// same load, and a default-constructed handle to none (making it ready,
+// with the result of a failed load).
+class time_zone_load {
+ public:
+  time_zone_load() = default;
+
+  // Returns true once the load has finished, when get() will not block.
+  bool ready() const;
+
+  // Waits for the load to finish, and then sets "*tz" and returns just as
+  // load_time_zone() would have.
+  bool get(time_zone* tz) const;
+
+  struct state;  // an implementation detail
+
+ private:
+  friend class time_zone::Impl;
+  explicit time_zone_load(std::shared_ptr<state> st) : state_(std::move(st)) {}
+  std::shared_ptr<state> state_;
+};
+
+// Loads the named time zone, as load_time_zone() would, but without
+// blocking the caller on any I/O or parsing. The load runs as a task
+// given to the executor, or, without one, on a new thread. Requests for
+// a zone that is already loaded finish immediately, and those for a zone
+// that is still loading share that load. If "done" is given, it is also
+// called with the result: on the thread that ran the load, or, when the
+// load had already finished, before load_time_zone_async() returns.
+//
+// Example:
+//   cctz::load_time_zone_async(
+//       "Europe/Paris", [](bool loaded, const cctz::time_zone& tz) {
+//         ...
+//       });
+time_zone_load load_time_zone_async(
+    const std::string& name,
+    std::function<void(bool loaded, const time_zone& tz)> done = nullptr,
+    time_zone_executor executor = nullptr);
+
+// Selects whether the zones loaded from zoneinfo after this call use a
+// compact representation of their transitions: about a third of the
+// usual memory, at the cost of deriving civil times during lookups.
+// This suits processes that keep every zone resident. The default is
+// false, and zones that have already been loaded are unaffected.
+void use_compact_time_zones(bool compact);
+
+// Statistics about a loaded time zone, for export to a monitoring system.
+// They are only collected when cctz is built with CCTZ_ENABLE_STATS defined
+// (e.g., with cmake -DCCTZ_ENABLE_STATS=ON), as otherwise the lookups do
+// no counting at all.
+struct time_zone_stats {
+  // How lookups found the transition that applies to a time: either with
+  // the transition that the previous lookup found (a hint hit), or else by
+  // searching for it. Of those misses, "searches" counts a binary search of
+  // every transition, where the others could be estimated from the year.
+  // "shifts" counts lookups beyond the generated transitions, which are then
+  // shifted by a multiple of 400 years into their span.
+  struct lookup_counts {
+    std::uint_fast64_t hint_hits;
+    std::uint_fast64_t hint_misses;
+    std::uint_fast64_t searches;
+    std::uint_fast64_t shifts;
+  };
+
+  std::string name;
+  lookup_counts absolute;  // absolute to civil time (e.g., convert(tp, tz))
+  lookup_counts civil;     // civil to absolute time (e.g., convert(cs, tz))
+  std::int_fast64_t load_nanos;    // time taken to load the zone
+  std::int_fast64_t extend_nanos;  // of which extending its transitions
+  std::size_t bytes_read;   // of zoneinfo data (none if bundled or embedded)
+  std::size_t transitions;  // including any generated since it was loaded
+};
+
+// Sets *zones to a snapshot of the statistics of every loaded time zone
+// (other than UTC), ordered by name. Returns false, leaving *zones empty,
+// when cctz was built without CCTZ_ENABLE_STATS.
+//
+// Example:
+//   std::vector<cctz::time_zone_stats> zones;
+//   if (cctz::stats(&zones)) {
+//     for (const auto& zone : zones) Export(zone.name, zone.absolute, ...);
+//   }
+bool stats(std::vector<time_zone_stats>* zones);
 
 // Returns the civil time (cctz::civil_second) within the given time zone at
 // the given absolute time (time_point). Since the additional fields provided
@@ -258,12 +644,82 @@ inline time_point<seconds> convert(const civil_second& cs,
   return cl.pre;
 }
 
+// A time_zone_converter converts civil times in one time zone into the
+// civil times at the same instants in another, just as
+// convert(convert(cs, from), to) would. When it is constructed, a single
+// walk over the transitions of both zones builds a table of the offset
+// between them for the from-zone civil times in [first, last], so that a
+// conversion within that range is only a table lookup and an addition,
+// and a sorted series is converted in one linear pass. Civil times
+// outside the range are still converted, but without the table.
+//
+// The table is built once, so a converter is worth keeping for reuse, and,
+// as it is immutable, it can be shared between threads. It follows the
+// rules of the zones when it was constructed, even after
+// update_time_zones().
+//
+// Example:
+//   const cctz::time_zone nyc = ..., syd = ...
+//   const cctz::time_zone_converter nyc_to_syd(
+//       nyc, syd, cctz::civil_second(2020, 1, 1, 0, 0, 0),
+//       cctz::civil_second(2030, 1, 1, 0, 0, 0));
+//   std::vector<cctz::civil_second> css = ...  // sorted, in nyc
+//   std::vector<cctz::civil_second> out(css.size());
+//   nyc_to_syd.convert(css.data(), css.size(), out.data());  // in syd
+class time_zone_converter {
+ public:
+  time_zone_converter(const time_zone& from, const time_zone& to,
+                      const civil_second& first, const civil_second& last);
+
+  civil_second convert(const civil_second& cs) const;
+
+  // Performs convert(css[i]) for each of the n civil times, storing the
+  // result in out[i], which is fastest when the input is sorted.
+  void convert(const civil_second* css, std::size_t n,
+               civil_second* out) const;
+
+ private:
+  // A run of from-zone civil times, from begin up to the next span (or
+  // end_), that convert to cs + delta, or, when the from zone skipped
+  // them, all to begin + delta.
+  struct Span {
+    civil_second begin;
+    std::int_fast64_t delta;
+    bool skipped;
+  };
+  bool tabulated(const civil_second& cs) const {
+    return !spans_.empty() && cs >= spans_.front().begin && cs < end_;
+  }
+  std::size_t find(const civil_second& cs) const;  // requires tabulated(cs)
+  civil_second convert_untabulated(const civil_second& cs) const;
+
+  time_zone from_;
+  time_zone to_;
+  std::vector<Span> spans_;
+  civil_second end_;  // of the last span
+};
+
+class format_plan;
+class parse_plan;
+
 namespace detail {
 using femtoseconds = std::chrono::duration<std::int_fast64_t, std::femto>;
 std::string format(const std::string&, const time_point<seconds>&,
                    const femtoseconds&, const time_zone&);
+std::size_t format(const char*, std::size_t, char*, std::size_t,
+                   const time_point<seconds>&, const femtoseconds&,
+                   const time_zone&);
+std::string format(const format_plan&, const time_point<seconds>&,
+                   const femtoseconds&, const time_zone&);
+std::size_t format(const format_plan&, char*, std::size_t,
+                   const time_point<seconds>&, const femtoseconds&,
+                   const time_zone&);
 bool parse(const std::string&, const std::string&, const time_zone&,
            time_point<seconds>*, femtoseconds*, std::string* err = nullptr);
+bool parse(const parse_plan&, const char*, std::size_t, const time_zone&,
+           time_point<seconds>*, femtoseconds*, std::string* err = nullptr);
+bool parse_rfc3339(const char*, std::size_t, time_point<seconds>*,
+                   femtoseconds*);
 template <typename Rep, std::intmax_t Denom>
 bool join_seconds(
     const time_point<seconds>& sec, const femtoseconds& fs,
@@ -317,6 +773,115 @@ inline std::string format(const std::string& fmt, const time_point<D>& tp,
   return detail::format(fmt, p.first, n, tz);
 }
 
+// Formats like format(), but writes the result into the caller's buffer,
+// or through an output iterator, so that no std::string is created. The
+// buffer versions write at most cap characters (with no NUL terminator),
+// and return the length of the complete result, just like snprintf(). The
+// iterator versions return the iterator past the last character written.
+// None of them allocate, unless strftime() is needed for some specifier
+// and it produces an unusually long result.
+//
+// Example:
+//   char buf[64];
+//   std::size_t len = cctz::format_to(buf, sizeof(buf), "%H:%M:%S", tp, lax);
+//   if (len <= sizeof(buf)) { ... }  // buf[0 .. len) is the result
+//   cctz::format_to(std::back_inserter(vec), "%H:%M:%S", tp, lax);
+template <typename D>
+inline std::size_t format_to(char* buf, std::size_t cap, const char* fmt,
+                             const time_point<D>& tp, const time_zone& tz) {
+  const auto p = detail::split_seconds(tp);
+  const auto n = std::chrono::duration_cast<detail::femtoseconds>(p.second);
+  return detail::format(fmt, std::char_traits<char>::length(fmt), buf, cap,
+                        p.first, n, tz);
+}
+template <typename D>
+inline std::size_t format_to(char* buf, std::size_t cap,
+                             const std::string& fmt, const time_point<D>& tp,
+                             const time_zone& tz) {
+  const auto p = detail::split_seconds(tp);
+  const auto n = std::chrono::duration_cast<detail::femtoseconds>(p.second);
+  return detail::format(fmt.c_str(), fmt.size(), buf, cap, p.first, n, tz);
+}
+namespace detail {
+template <typename OutputIt, typename F, typename D>
+OutputIt format_to(OutputIt out, const F& fmt, const time_point<D>& tp,
+                   const time_zone& tz) {
+  char buf[128];
+  const std::size_t len = cctz::format_to(buf, sizeof(buf), fmt, tp, tz);
+  if (len > sizeof(buf)) {
+    for (const char c : cctz::format(fmt, tp, tz)) *out++ = c;
+  } else {
+    for (std::size_t i = 0; i != len; ++i) *out++ = buf[i];
+  }
+  return out;
+}
+}  // namespace detail
+
+template <typename OutputIt, typename D>
+inline OutputIt format_to(OutputIt out, const char* fmt,
+                          const time_point<D>& tp, const time_zone& tz) {
+  return detail::format_to(out, fmt, tp, tz);
+}
+template <typename OutputIt, typename D>
+inline OutputIt format_to(OutputIt out, const std::string& fmt,
+                          const time_point<D>& tp, const time_zone& tz) {
+  return detail::format_to(out, fmt, tp, tz);
+}
+
+// A format_plan is a format string, with the same syntax as for format(),
+// that has been compiled once so that it can then format many time_points
+// without re-examining the string. Most specifiers are rendered directly,
+// rather than by strftime(), including %a, %A, %b, %B, %h and %p, which
+// always use their "C" locale names. Composite specifiers like %F, %T and
+// %R are expanded when the plan is compiled. Any remaining specifiers are
+// still passed to strftime().
+//
+// A plan can also format into a caller-provided buffer, in which case it
+// writes no more than cap characters (with no NUL terminator), and returns
+// the length of the complete result, just like snprintf(). This does not
+// allocate unless strftime() produces an unusually long result.
+//
+// Example:
+//   static const cctz::format_plan plan("%Y-%m-%d%ET%H:%M:%E*S%Ez");
+//   std::string s = plan.format(tp, tz);
+//   char buf[64];
+//   std::size_t len = plan.format(buf, sizeof(buf), tp, tz);
+//   if (len <= sizeof(buf)) { ... }  // buf[0 .. len) is the result
+class format_plan {
+ public:
+  explicit format_plan(const std::string& fmt);
+
+  template <typename D>
+  std::string format(const time_point<D>& tp, const time_zone& tz) const {
+    const auto p = detail::split_seconds(tp);
+    const auto n = std::chrono::duration_cast<detail::femtoseconds>(p.second);
+    return detail::format(*this, p.first, n, tz);
+  }
+  template <typename D>
+  std::size_t format(char* buf, std::size_t cap, const time_point<D>& tp,
+                     const time_zone& tz) const {
+    const auto p = detail::split_seconds(tp);
+    const auto n = std::chrono::duration_cast<detail::femtoseconds>(p.second);
+    return detail::format(*this, buf, cap, p.first, n, tz);
+  }
+
+ private:
+  friend std::size_t detail::format(const format_plan&, char*, std::size_t,
+                                    const time_point<seconds>&,
+                                    const detail::femtoseconds&,
+                                    const time_zone&);
+
+  struct Op {
+    int kind;         // what to render (see time_zone_format.cc)
+    int arg;          // a kind-specific argument, like a precision
+    std::size_t pos;  // the literal text or strftime() specifier, which
+    std::size_t len;  //   is text_.substr(pos, len)
+  };
+  std::vector<Op> ops_;
+  std::string text_;  // literal text and NUL-terminated specifiers
+  bool needs_tm_;     // some specifier is passed to strftime()
+};
+
 // Parses an input string according to the provided format string and
 // returns the corresponding time_point. Uses strftime()-like formatting
 // options, with the same extensions as cctz::format(), but with the
@@ -372,6 +937,83 @@ inline bool parse(const std::string& fmt, const std::string& input,
          detail::join_seconds(sec, fs, tpp);
 }
 
+// A parse_plan is a format string, with the same syntax as for parse(),
+// that has been compiled once so that it can then parse many inputs
+// without re-examining the string. An input is given as a pointer and a
+// length, and need not be NUL terminated, so that, for example, a line can
+// be parsed in place within a larger buffer. The results are the same as
+// from parse() with the same format and input.
+//
+// When the format only uses the specifiers %Y, %m, %d, %e, %H, %M, %S, %z,
+// %Z, %s and %%, along with the %E and %:z extensions, the input is parsed
+// directly, without strptime() or any allocation. Other formats are simply
+// passed through to parse(). Formats laid out like RFC3339, such as
+// "%Y-%m-%d%ET%H:%M:%E*S%Ez" or "%Y-%m-%d %H:%M:%S", are faster still when
+// the input has exactly the canonical field widths.
+//
+// Example:
+//   static const cctz::parse_plan plan("%Y-%m-%d%ET%H:%M:%E*S%Ez");
+//   std::chrono::system_clock::time_point tp;
+//   if (plan.parse(line, line_len, tz, &tp)) {
+//     ...
+//   }
+class parse_plan {
+ public:
+  explicit parse_plan(const std::string& fmt);
+
+  template <typename D>
+  bool parse(const char* input, std::size_t len, const time_zone& tz,
+             time_point<D>* tpp) const {
+    time_point<seconds> sec;
+    detail::femtoseconds fs;
+    return detail::parse(*this, input, len, tz, &sec, &fs) &&
+           detail::join_seconds(sec, fs, tpp);
+  }
+  template <typename D>
+  bool parse(const std::string& input, const time_zone& tz,
+             time_point<D>* tpp) const {
+    return parse(input.data(), input.size(), tz, tpp);
+  }
+
+ private:
+  friend bool detail::parse(const parse_plan&, const char*, std::size_t,
+                            const time_zone&, time_point<seconds>*,
+                            detail::femtoseconds*, std::string* err);
+
+  struct Op {
+    int kind;         // what to parse (see time_zone_format.cc)
+    std::size_t pos;  // any literal text to match, which is
+    std::size_t len;  //   text_.substr(pos, len)
+  };
+  std::vector<Op> ops_;
+  std::string text_;  // literal text, or the whole format for parse()
+  bool fallback_;     // the format is passed through to parse()
+  int layout_;        // an RFC3339-like layout, if non-zero
+};
+
+// Parses an RFC3339 "date-time", like "2013-06-28T19:08:09.123456-07:00",
+// exactly as parse("%Y-%m-%d%ET%H:%M:%E*S%Ez", input, tz, tpp) would (for
+// which tz is unused). Inputs with the canonical field widths are
+// validated and converted several characters at a time.
+//
+// Example:
+//   std::chrono::system_clock::time_point tp;
+//   if (cctz::parse_rfc3339(line, line_len, &tp)) {
+//     ...
+//   }
+template <typename D>
+inline bool parse_rfc3339(const char* input, std::size_t len,
+                          time_point<D>* tpp) {
+  time_point<seconds> sec;
+  detail::femtoseconds fs;
+  return detail::parse_rfc3339(input, len, &sec, &fs) &&
+         detail::join_seconds(sec, fs, tpp);
+}
+template <typename D>
+inline bool parse_rfc3339(const std::string& input, time_point<D>* tpp) {
+  return parse_rfc3339(input.data(), input.size(), tpp);
+}
+
 namespace detail {
 
 // Split a time_point<D> into a time_point<seconds> and a D subseconds.
@@ -395,6 +1037,94 @@ inline std::pair<time_point<seconds>, seconds> split_seconds(
   return {tp, seconds::zero()};
 }
 
+// The span between two transitions of a zone that contains the current
+// time (its current "era"), and the offset, etc., that apply within it,
+// so that time_zone::lookup() can convert the instants within the span
+// inline. It is a seqlock: a reader falls back to the full lookup when a
+// writer changed the fields while it copied them.
+class time_zone_era {
+ public:
+  // Sets *al (and any *abbr_len, to the length of al->abbr) if the instant
+  // lies within the era, and returns true.
+  bool lookup(const time_point<seconds>& tp, time_zone::absolute_lookup* al,
+              std::size_t* abbr_len = nullptr) const {
+    const std::int_fast64_t t = tp.time_since_epoch().count();
+    const std::uint_fast32_t seq = seq_.load(std::memory_order_acquire);
+    if ((seq & 1) != 0) return false;  // mid-write
+    const std::int_fast64_t begin = begin_.load(std::memory_order_relaxed);
+    const std::int_fast64_t end = end_.load(std::memory_order_relaxed);
+    const int offset = offset_.load(std::memory_order_relaxed);
+    const bool is_dst = is_dst_.load(std::memory_order_relaxed);
+    const char* const abbr = abbr_.load(std::memory_order_relaxed);
+    std::size_t len = 0;
+    if (abbr_len != nullptr) len = abbr_len_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // A single (unsigned) comparison checks that begin <= t < end. The
+    // operands are converted first, so that the (modular) differences
+    // cannot overflow.
+    const std::uint_fast64_t ubegin = static_cast<std::uint_fast64_t>(begin);
+    const bool within = static_cast<std::uint_fast64_t>(t) - ubegin <
+                        static_cast<std::uint_fast64_t>(end) - ubegin;
+    if (!within || seq_.load(std::memory_order_relaxed) != seq) {
+      return false;  // outside the era, or a torn (or no) copy
+    }
+    al->cs = civil_at(t + offset);
+    al->offset = offset;
+    al->is_dst = is_dst;
+    al->abbr = abbr;
+    if (abbr_len != nullptr) *abbr_len = len;
+    return true;
+  }
+
+  // Returns the (exclusive) end of the era, for deciding whether to update.
+  time_point<seconds> end() const {
+    return time_point<seconds>(seconds(end_.load(std::memory_order_relaxed)));
+  }
+
+  // The civil time of a count of seconds since 1970-01-01 00:00:00, with
+  // the date computed in closed form (after Howard Hinnant's algorithm),
+  // so that the fields are already normalized. The count must lie within
+  // +/-2^62 seconds of the epoch.
+  static civil_second civil_at(std::int_fast64_t t) {
+    std::int_fast64_t days = t / 86400;
+    std::int_fast64_t sod = t % 86400;
+    if (sod < 0) {
+      days -= 1;
+      sod += 86400;
+    }
+    const std::int_fast64_t z = days + 719468;  // days since 0000-03-01
+    const std::int_fast64_t c4 = (z >= 0 ? z : z - 146096) / 146097;
+    const std::int_fast64_t doe = z - c4 * 146097;  // [0, 146096]
+    const std::int_fast64_t yoe =
+        (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // [0, 399]
+    const std::int_fast64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const std::int_fast64_t mp = (5 * doy + 2) / 153;  // March is 0
+    const std::int_fast64_t d = doy - (153 * mp + 2) / 5 + 1;
+    const std::int_fast64_t m = mp < 10 ? mp + 3 : mp - 9;
+    return civil_second(fields(yoe + c4 * 400 + (m <= 2),
+                               static_cast<month_t>(m), static_cast<day_t>(d),
+                               static_cast<hour_t>(sod / 3600),
+                               static_cast<minute_t>(sod / 60 % 60),
+                               static_cast<second_t>(sod % 60)));
+  }
+
+  // Replaces the era, whose abbreviation (of abbr_len characters) must
+  // outlive it, and returns true. The update is skipped (returning false)
+  // if another is already in progress. Eras must lie within +/-2^59
+  // seconds of the epoch.
+  bool store(const time_point<seconds>& begin, const time_point<seconds>& end,
+             int offset, bool is_dst, const char* abbr, std::size_t abbr_len);
+
+ private:
+  std::atomic<std::uint_fast32_t> seq_ = {0};  // odd while being written
+  std::atomic<std::int_fast64_t> begin_ = {0};
+  std::atomic<std::int_fast64_t> end_ = {0};  // so initially empty
+  std::atomic<int> offset_ = {0};
+  std::atomic<bool> is_dst_ = {false};
+  std::atomic<const char*> abbr_ = {nullptr};
+  std::atomic<std::size_t> abbr_len_ = {0};
+};
+
 // Join a time_point<seconds> and femto subseconds into a time_point<D>.
 // Floors to the resolution of time_point<D>. Returns false if time_point<D>
 // is not of sufficient range.
@@ -446,6 +1176,30 @@ inline bool join_seconds(const time_point<seconds>& sec, const femtoseconds&,
 }
 
 }  // namespace detail
+
+inline time_zone::absolute_lookup time_zone::lookup(
+    const time_point<seconds>& tp) const {
+  absolute_lookup al;
+  if (era_ != nullptr && era_->lookup(tp, &al)) return al;
+  return lookup_outside_era(tp);
+}
+
 }  // namespace cctz
 
+namespace std {
+
+// Hashes a cctz::time_zone consistently with its operator==, so time zones
+// can key unordered containers. The hash values are stable for the life of
+// the process, but not between processes.
+template <>
+struct hash<cctz::time_zone> {
+  std::size_t operator()(const cctz::time_zone& tz) const {
+    const cctz::time_zone::Impl* impl = tz.impl_;
+    if (impl == nullptr) impl = &tz.effective_impl();  // implicit UTC
+    return hash<const cctz::time_zone::Impl*>()(impl);
+  }
+};
+
+}  // namespace std
+
 #endif  // CCTZ_TIME_ZONE_H_
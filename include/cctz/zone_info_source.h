@@ -34,6 +34,16 @@ class ZoneInfoSource {
   // a way for a ZoneInfoSource to indicate it out-of-band.  The default
   // implementation returns an empty string.
   virtual std::string Version() const;
+
+  // A source that already holds its zoneinfo data in one contiguous block
+  // (e.g., embedded in the program, or in a mapped archive) may expose it,
+  // so that the data can be decoded in place instead of being copied out
+  // through Read(). Data() returns the bytes that Read() would produce
+  // next, and Size() their count, which must remain valid for the life
+  // of the source. The default implementations return null and zero, and
+  // then the data is obtained with Read().
+  virtual const char* Data() const;
+  virtual std::size_t Size() const;
 };
 
 }  // namespace cctz
@@ -78,6 +88,11 @@ using ZoneInfoSourceFactory =
 //   (2) only once for any zone name, and
 //   (3) serially (i.e., no concurrent execution).
 //
+// It is also asked for "zone1970.tab", the list of zones, each time that
+// cctz::preload_all_time_zones() is called, and may return null for that
+// when it has no such list. Likewise, it is asked for "UTC" each time that
+// cctz::update_time_zones() is called, to learn the Version() of its data.
+//
 // The fallback factory obtains zoneinfo data by reading files in ${TZDIR},
 // and it is used automatically when no zone_info_source_factory definition
 // is linked into the program.
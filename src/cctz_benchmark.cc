@@ -13,13 +13,22 @@
 //   limitations under the License.
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <ctime>
+#include <functional>
 #include <random>
 #include <string>
+#include <utility>
 #include <vector>
 
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
 #include "benchmark/benchmark.h"
 #include "cctz/civil_time.h"
 #include "cctz/time_zone.h"
@@ -45,6 +54,138 @@ void BM_Step_Days(benchmark::State& state) {
 }
 BENCHMARK(BM_Step_Days);
 
+// The batch benchmarks bucket days spread over several centuries, using
+// a scalar loop and the corresponding array kernel. The origins are hidden
+// from the optimizer, as they would be in practice.
+std::vector<cctz::diff_t> DayOffsets() {
+  std::vector<cctz::diff_t> offsets(1000);
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<cctz::diff_t> dist(-100000, 100000);
+  for (auto& n : offsets) n = dist(rng);
+  return offsets;
+}
+
+void BM_Step_Days_Loop(benchmark::State& state) {
+  cctz::civil_day epoch(1970, 1, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_day> days(offsets.size());
+  while (state.KeepRunning()) {
+    for (std::size_t i = 0; i != offsets.size(); ++i) {
+      days[i] = epoch + offsets[i];
+    }
+    benchmark::DoNotOptimize(days.data());
+  }
+  state.SetItemsProcessed(state.iterations() * offsets.size());
+}
+BENCHMARK(BM_Step_Days_Loop);
+
+void BM_Step_Days_Batch(benchmark::State& state) {
+  cctz::civil_day epoch(1970, 1, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_day> days(offsets.size());
+  while (state.KeepRunning()) {
+    cctz::add_days(epoch, offsets.data(), offsets.size(), days.data());
+    benchmark::DoNotOptimize(days.data());
+  }
+  state.SetItemsProcessed(state.iterations() * offsets.size());
+}
+BENCHMARK(BM_Step_Days_Batch);
+
+void BM_Difference_Days_Loop(benchmark::State& state) {
+  cctz::civil_day epoch(1970, 1, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_day> days(offsets.size());
+  cctz::add_days(epoch, offsets.data(), offsets.size(), days.data());
+  std::vector<cctz::diff_t> diffs(days.size());
+  while (state.KeepRunning()) {
+    for (std::size_t i = 0; i != days.size(); ++i) {
+      diffs[i] = days[i] - epoch;
+    }
+    benchmark::DoNotOptimize(diffs.data());
+  }
+  state.SetItemsProcessed(state.iterations() * days.size());
+}
+BENCHMARK(BM_Difference_Days_Loop);
+
+void BM_Difference_Days_Batch(benchmark::State& state) {
+  cctz::civil_day epoch(1970, 1, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_day> days(offsets.size());
+  cctz::add_days(epoch, offsets.data(), offsets.size(), days.data());
+  std::vector<cctz::diff_t> diffs(days.size());
+  while (state.KeepRunning()) {
+    cctz::day_differences(days.data(), days.size(), epoch, diffs.data());
+    benchmark::DoNotOptimize(diffs.data());
+  }
+  state.SetItemsProcessed(state.iterations() * days.size());
+}
+BENCHMARK(BM_Difference_Days_Batch);
+
+void BM_Step_Months_Loop(benchmark::State& state) {
+  cctz::civil_month epoch(1970, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_month> months(offsets.size());
+  while (state.KeepRunning()) {
+    for (std::size_t i = 0; i != offsets.size(); ++i) {
+      months[i] = epoch + offsets[i];
+    }
+    benchmark::DoNotOptimize(months.data());
+  }
+  state.SetItemsProcessed(state.iterations() * offsets.size());
+}
+BENCHMARK(BM_Step_Months_Loop);
+
+void BM_Step_Months_Batch(benchmark::State& state) {
+  cctz::civil_month epoch(1970, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_month> months(offsets.size());
+  while (state.KeepRunning()) {
+    cctz::add_months(epoch, offsets.data(), offsets.size(), months.data());
+    benchmark::DoNotOptimize(months.data());
+  }
+  state.SetItemsProcessed(state.iterations() * offsets.size());
+}
+BENCHMARK(BM_Step_Months_Batch);
+
+void BM_Difference_Months_Loop(benchmark::State& state) {
+  cctz::civil_month epoch(1970, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_month> months(offsets.size());
+  cctz::add_months(epoch, offsets.data(), offsets.size(), months.data());
+  std::vector<cctz::diff_t> diffs(months.size());
+  while (state.KeepRunning()) {
+    for (std::size_t i = 0; i != months.size(); ++i) {
+      diffs[i] = months[i] - epoch;
+    }
+    benchmark::DoNotOptimize(diffs.data());
+  }
+  state.SetItemsProcessed(state.iterations() * months.size());
+}
+BENCHMARK(BM_Difference_Months_Loop);
+
+void BM_Difference_Months_Batch(benchmark::State& state) {
+  cctz::civil_month epoch(1970, 1);
+  benchmark::DoNotOptimize(epoch);
+  const std::vector<cctz::diff_t> offsets = DayOffsets();
+  std::vector<cctz::civil_month> months(offsets.size());
+  cctz::add_months(epoch, offsets.data(), offsets.size(), months.data());
+  std::vector<cctz::diff_t> diffs(months.size());
+  while (state.KeepRunning()) {
+    cctz::month_differences(months.data(), months.size(), epoch,
+                            diffs.data());
+    benchmark::DoNotOptimize(diffs.data());
+  }
+  state.SetItemsProcessed(state.iterations() * months.size());
+}
+BENCHMARK(BM_Difference_Months_Batch);
+
 void BM_GetWeekday(benchmark::State& state) {
   const cctz::civil_day c(2014, 8, 22);
   while (state.KeepRunning()) {
@@ -719,6 +860,67 @@ cctz::time_zone TestTimeZone() {
   return tz;
 }
 
+// The shapes of the streams of instants in the "Pattern" benchmarks: in
+// time order, in random order, or in bursts of nearby instants (e.g., the
+// events of one session) at random times.
+enum Pattern { kSorted, kRandom, kClustered };
+const char* const kPatternNames[] = {"sorted", "random", "clustered"};
+
+// Returns instants between 2000 and 2030 in the given pattern. Each call
+// uses a new seed, so that the threads of a benchmark see different ones.
+std::vector<cctz::time_point<cctz::seconds>> Instants(int pattern) {
+  static std::atomic<unsigned> next_seed(42);
+  std::mt19937 urbg(next_seed++);
+  const std::int_fast64_t kStart = 946684800;  // 2000-01-01T00:00:00Z
+  const std::int_fast64_t kSpan = 30 * 365 * 24 * 60 * 60;
+  std::uniform_int_distribution<std::int_fast64_t> any(0, kSpan - 1);
+  std::uniform_int_distribution<std::int_fast64_t> near(-60 * 60, 60 * 60);
+  std::vector<std::int_fast64_t> times(4096);
+  for (std::size_t i = 0; i != times.size(); ++i) {
+    if (pattern == kClustered && i % 64 != 0) {
+      times[i] = times[i - i % 64] + near(urbg);  // near the burst's first
+    } else {
+      times[i] = any(urbg);
+    }
+  }
+  if (pattern == kSorted) std::sort(times.begin(), times.end());
+  std::vector<cctz::time_point<cctz::seconds>> tps;
+  tps.reserve(times.size());
+  for (std::int_fast64_t t : times) {
+    tps.push_back(std::chrono::time_point_cast<cctz::seconds>(
+        std::chrono::system_clock::from_time_t(kStart + t)));
+  }
+  return tps;
+}
+
+// Returns the resident set size of the process, or -1 if it is unknown.
+std::int_fast64_t ResidentBytes() {
+#if defined(__linux__)
+  std::int_fast64_t bytes = -1;
+  if (FILE* fp = std::fopen("/proc/self/statm", "r")) {
+    long size;
+    long resident;
+    if (std::fscanf(fp, "%ld %ld", &size, &resident) == 2) {
+      bytes = static_cast<std::int_fast64_t>(resident) * sysconf(_SC_PAGESIZE);
+    }
+    std::fclose(fp);
+  }
+  return bytes;
+#else
+  return -1;
+#endif
+}
+
+// The same zone, but using the compact transition representation.
+cctz::time_zone CompactTestTimeZone() {
+  cctz::time_zone::Impl::ClearTimeZoneMapTestOnly();
+  cctz::use_compact_time_zones(true);
+  const cctz::time_zone tz = TestTimeZone();
+  cctz::use_compact_time_zones(false);
+  cctz::time_zone::Impl::ClearTimeZoneMapTestOnly();
+  return tz;
+}
+
 void BM_Zone_LoadUTCTimeZoneFirst(benchmark::State& state) {
   cctz::time_zone tz;
   cctz::load_time_zone("UTC", &tz);  // in case we're first
@@ -763,6 +965,16 @@ void BM_Zone_LoadTimeZoneCached(benchmark::State& state) {
 }
 BENCHMARK(BM_Zone_LoadTimeZoneCached);
 
+void BM_Zone_LoadTimeZoneCachedThreads(benchmark::State& state) {
+  cctz::time_zone tz = cctz::utc_time_zone();  // in case we're first
+  const std::string name = "file:America/Los_Angeles";
+  cctz::load_time_zone(name, &tz);  // prime cache
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::load_time_zone(name, &tz));
+  }
+}
+BENCHMARK(BM_Zone_LoadTimeZoneCachedThreads)->ThreadRange(1, 16);
+
 void BM_Zone_LoadLocalTimeZoneCached(benchmark::State& state) {
   cctz::utc_time_zone();  // in case we're first
   cctz::time_zone::Impl::ClearTimeZoneMapTestOnly();
@@ -773,7 +985,13 @@ void BM_Zone_LoadLocalTimeZoneCached(benchmark::State& state) {
 }
 BENCHMARK(BM_Zone_LoadLocalTimeZoneCached);
 
+// Also reports the growth in resident memory per zone over the first pass
+// through the zones. Zones share the tables of any identical zone that is
+// still loaded, including those that ClearTimeZoneMapTestOnly() retains,
+// so run this benchmark alone for the memory cost of a first load.
 void BM_Zone_LoadAllTimeZonesFirst(benchmark::State& state) {
+  static std::int_fast64_t rss_per_zone = -1;  // from our first pass
+  std::int_fast64_t rss_start = -1;
   cctz::time_zone tz;
   const std::vector<std::string> names = AllTimeZoneNames();
   for (auto index = names.size(); state.KeepRunning(); ++index) {
@@ -782,14 +1000,35 @@ void BM_Zone_LoadAllTimeZonesFirst(benchmark::State& state) {
     }
     if (index == 0) {
       state.PauseTiming();
+      if (rss_start >= 0 && rss_per_zone < 0) {
+        const std::int_fast64_t rss = ResidentBytes();
+        rss_per_zone = (rss - rss_start) / static_cast<std::int_fast64_t>(
+                                               names.size());
+      }
       cctz::time_zone::Impl::ClearTimeZoneMapTestOnly();
+      rss_start = ResidentBytes();
       state.ResumeTiming();
     }
     benchmark::DoNotOptimize(cctz::load_time_zone(names[index], &tz));
   }
+  if (rss_per_zone >= 0) {
+    state.counters["rss_per_zone"] = static_cast<double>(rss_per_zone);
+  }
 }
 BENCHMARK(BM_Zone_LoadAllTimeZonesFirst);
 
+void BM_Zone_PreloadAllTimeZones(benchmark::State& state) {
+  const std::vector<std::string> names = AllTimeZoneNames();
+  const int num_threads = static_cast<int>(state.range(0));
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    cctz::time_zone::Impl::ClearTimeZoneMapTestOnly();
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(cctz::preload_time_zones(names, num_threads));
+  }
+}
+BENCHMARK(BM_Zone_PreloadAllTimeZones)->Arg(1)->Arg(4);
+
 void BM_Zone_LoadAllTimeZonesCached(benchmark::State& state) {
   cctz::time_zone tz;
   const std::vector<std::string> names = AllTimeZoneNames();
@@ -805,6 +1044,30 @@ void BM_Zone_LoadAllTimeZonesCached(benchmark::State& state) {
 }
 BENCHMARK(BM_Zone_LoadAllTimeZonesCached);
 
+// Concurrent lookups of every zone, each thread starting at a different one.
+void BM_Zone_LoadAllTimeZonesCachedThreads(benchmark::State& state) {
+  static std::atomic<std::size_t> next_start(0);
+  cctz::time_zone tz;
+  const std::vector<std::string> names = AllTimeZoneNames();
+  for (const auto& name : names) {
+    cctz::load_time_zone(name, &tz);  // prime cache
+  }
+  auto index = (next_start += 97) % names.size();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::load_time_zone(names[index], &tz));
+    if (++index == names.size()) index = 0;
+  }
+}
+BENCHMARK(BM_Zone_LoadAllTimeZonesCachedThreads)->ThreadRange(1, 16);
+
+void BM_Zone_LoadLocalTimeZoneCachedThreads(benchmark::State& state) {
+  cctz::local_time_zone();  // prime cache
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::local_time_zone());
+  }
+}
+BENCHMARK(BM_Zone_LoadLocalTimeZoneCachedThreads)->ThreadRange(1, 16);
+
 void BM_Zone_TimeZoneEqualityImplicit(benchmark::State& state) {
   cctz::time_zone tz;  // implicit UTC
   while (state.KeepRunning()) {
@@ -821,6 +1084,24 @@ void BM_Zone_TimeZoneEqualityExplicit(benchmark::State& state) {
 }
 BENCHMARK(BM_Zone_TimeZoneEqualityExplicit);
 
+void BM_Zone_TimeZoneEqualityMixed(benchmark::State& state) {
+  cctz::time_zone implicit_utc;
+  cctz::time_zone tz = TestTimeZone();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(implicit_utc == tz);
+  }
+}
+BENCHMARK(BM_Zone_TimeZoneEqualityMixed);
+
+void BM_Zone_TimeZoneHash(benchmark::State& state) {
+  const std::hash<cctz::time_zone> hash;
+  cctz::time_zone tz = TestTimeZone();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(hash(tz));
+  }
+}
+BENCHMARK(BM_Zone_TimeZoneHash);
+
 void BM_Zone_UTCTimeZone(benchmark::State& state) {
   cctz::time_zone tz;
   while (state.KeepRunning()) {
@@ -849,6 +1130,147 @@ void BM_Time_ToCivil_CCTZ(benchmark::State& state) {
 }
 BENCHMARK(BM_Time_ToCivil_CCTZ);
 
+void BM_Time_ToCivilCompact_CCTZ(benchmark::State& state) {
+  const cctz::time_zone tz = CompactTestTimeZone();
+  std::chrono::system_clock::time_point tp =
+      std::chrono::system_clock::from_time_t(1384569027);
+  std::chrono::system_clock::time_point tp2 =
+      std::chrono::system_clock::from_time_t(1418962578);
+  while (state.KeepRunning()) {
+    std::swap(tp, tp2);
+    tp += std::chrono::seconds(1);
+    benchmark::DoNotOptimize(cctz::convert(tp, tz));
+  }
+}
+BENCHMARK(BM_Time_ToCivilCompact_CCTZ);
+
+// Instants from the preceding hour, which the zone's current era covers
+// (unless a transition was very recent), in random order.
+void BM_Time_ToCivilNow_CCTZ(benchmark::State& state) {
+  const cctz::time_zone tz = TestTimeZone();
+  const auto now = std::chrono::time_point_cast<cctz::seconds>(
+      std::chrono::system_clock::now());
+  std::mt19937 urbg(42);
+  std::uniform_int_distribution<int> ago(0, 60 * 60 - 1);
+  std::vector<cctz::time_point<cctz::seconds>> tps(4096);
+  for (auto& tp : tps) tp = now - cctz::seconds(ago(urbg));
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(tz.lookup(tps[i++ % tps.size()]));
+  }
+}
+BENCHMARK(BM_Time_ToCivilNow_CCTZ);
+
+void BM_Time_ToCivilBatch_CCTZ(benchmark::State& state) {
+  const cctz::time_zone tz = TestTimeZone();
+  std::vector<cctz::time_point<cctz::seconds>> tps(1000);
+  auto tp = std::chrono::time_point_cast<cctz::seconds>(
+      std::chrono::system_clock::from_time_t(1384569027));
+  for (auto& t : tps) t = (tp += std::chrono::hours(25));  // sorted
+  std::vector<cctz::time_zone::absolute_lookup> als(tps.size());
+  while (state.KeepRunning()) {
+    tz.lookup(tps.data(), tps.size(), als.data());
+    benchmark::DoNotOptimize(als.data());
+  }
+  state.SetItemsProcessed(state.iterations() * tps.size());
+}
+BENCHMARK(BM_Time_ToCivilBatch_CCTZ);
+
+// Each thread converts its own sorted stream of instants. The cursor
+// version keeps a search hint per thread rather than sharing the zone's.
+cctz::time_point<cctz::seconds> StreamStart() {
+  static std::atomic<int> next_stream(0);
+  return std::chrono::time_point_cast<cctz::seconds>(
+             std::chrono::system_clock::from_time_t(1384569027)) +
+         std::chrono::hours(24 * 365 * 3) * next_stream++;
+}
+
+void BM_Time_ToCivilStream_CCTZ(benchmark::State& state) {
+  const cctz::time_zone tz = TestTimeZone();
+  auto tp = StreamStart();
+  while (state.KeepRunning()) {
+    tp += std::chrono::hours(1);
+    benchmark::DoNotOptimize(cctz::convert(tp, tz));
+  }
+}
+BENCHMARK(BM_Time_ToCivilStream_CCTZ)->ThreadRange(1, 16);
+
+void BM_Time_ToCivilStreamCursor_CCTZ(benchmark::State& state) {
+  cctz::time_zone::cursor cur(TestTimeZone());
+  auto tp = StreamStart();
+  while (state.KeepRunning()) {
+    tp += std::chrono::hours(1);
+    benchmark::DoNotOptimize(cur.lookup(tp));
+  }
+}
+BENCHMARK(BM_Time_ToCivilStreamCursor_CCTZ)->ThreadRange(1, 16);
+
+void BM_Time_ToCivilFuture_CCTZ(benchmark::State& state) {
+  // Instants in the years generated from the zone's future specification.
+  const cctz::time_zone tz = TestTimeZone();
+  std::chrono::system_clock::time_point tp =
+      std::chrono::system_clock::from_time_t(4102444800);  // 2100-01-01
+  std::chrono::system_clock::time_point tp2 =
+      std::chrono::system_clock::from_time_t(10413792000);  // 2300-01-01
+  while (state.KeepRunning()) {
+    std::swap(tp, tp2);
+    tp += std::chrono::seconds(1);
+    benchmark::DoNotOptimize(cctz::convert(tp, tz));
+  }
+}
+BENCHMARK(BM_Time_ToCivilFuture_CCTZ);
+
+// Each thread converts its own stream of instants in the given pattern,
+// sharing the zone (and so its hints) with the other threads.
+void BM_Time_ToCivilPattern_CCTZ(benchmark::State& state) {
+  state.SetLabel(kPatternNames[state.range(0)]);
+  const cctz::time_zone tz = TestTimeZone();
+  const auto tps = Instants(static_cast<int>(state.range(0)));
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::convert(tps[i], tz));
+    if (++i == tps.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Time_ToCivilPattern_CCTZ)->DenseRange(0, 2)->ThreadRange(1, 16);
+
+// Lookups that are spread at random over the first range(0) zones (in the
+// same shuffled order as AllTimeZoneNames()), as when serving users across
+// the world, each at a random instant.
+std::vector<std::pair<cctz::time_zone, cctz::time_point<cctz::seconds>>>
+ManyZoneInstants(std::size_t num_zones) {
+  std::vector<std::string> names = AllTimeZoneNames();
+  names.resize(std::min(num_zones, names.size()));
+  std::vector<cctz::time_zone> zones;
+  for (const auto& name : names) {
+    cctz::time_zone tz;
+    cctz::load_time_zone(name, &tz);
+    zones.push_back(tz);
+  }
+  std::mt19937 urbg(42);
+  std::uniform_int_distribution<std::size_t> any(0, zones.size() - 1);
+  std::vector<std::pair<cctz::time_zone, cctz::time_point<cctz::seconds>>>
+      work;
+  for (const auto& tp : Instants(kRandom)) {
+    work.emplace_back(zones[any(urbg)], tp);
+  }
+  return work;
+}
+
+void BM_Time_ToCivilManyZones_CCTZ(benchmark::State& state) {
+  const auto work = ManyZoneInstants(static_cast<std::size_t>(state.range(0)));
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::convert(work[i].second, work[i].first));
+    if (++i == work.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Time_ToCivilManyZones_CCTZ)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(256)
+    ->ThreadRange(1, 16);
+
 void BM_Time_ToCivil_Libc(benchmark::State& state) {
   // No timezone support, so just use localtime.
   time_t t = 1384569027;
@@ -866,6 +1288,22 @@ void BM_Time_ToCivil_Libc(benchmark::State& state) {
 }
 BENCHMARK(BM_Time_ToCivil_Libc);
 
+// As BM_Time_ToCivil_Libc, but through cctz's "libc:localtime" zone.
+void BM_Time_ToCivilLibC_CCTZ(benchmark::State& state) {
+  cctz::time_zone tz;
+  cctz::load_time_zone("libc:localtime", &tz);
+  std::chrono::system_clock::time_point tp =
+      std::chrono::system_clock::from_time_t(1384569027);
+  std::chrono::system_clock::time_point tp2 =
+      std::chrono::system_clock::from_time_t(1418962578);
+  while (state.KeepRunning()) {
+    std::swap(tp, tp2);
+    tp += std::chrono::seconds(1);
+    benchmark::DoNotOptimize(cctz::convert(tp, tz));
+  }
+}
+BENCHMARK(BM_Time_ToCivilLibC_CCTZ);
+
 void BM_Time_ToCivilUTC_CCTZ(benchmark::State& state) {
   const cctz::time_zone tz = cctz::utc_time_zone();
   std::chrono::system_clock::time_point tp =
@@ -877,6 +1315,21 @@ void BM_Time_ToCivilUTC_CCTZ(benchmark::State& state) {
 }
 BENCHMARK(BM_Time_ToCivilUTC_CCTZ);
 
+// The civil_second arithmetic that a UTC lookup cannot avoid, for scale.
+void BM_Time_ToCivilUTC_Arithmetic(benchmark::State& state) {
+  const cctz::civil_second epoch;
+  std::chrono::system_clock::time_point tp =
+      std::chrono::system_clock::from_time_t(1384569027);
+  while (state.KeepRunning()) {
+    tp += std::chrono::seconds(1);
+    benchmark::DoNotOptimize(
+        epoch + std::chrono::duration_cast<cctz::seconds>(
+                    tp - std::chrono::system_clock::from_time_t(0))
+                    .count());
+  }
+}
+BENCHMARK(BM_Time_ToCivilUTC_Arithmetic);
+
 void BM_Time_ToCivilUTC_Libc(benchmark::State& state) {
   time_t t = 1384569027;
   struct tm tm;
@@ -913,6 +1366,87 @@ void BM_Time_FromCivil_CCTZ(benchmark::State& state) {
 }
 BENCHMARK(BM_Time_FromCivil_CCTZ);
 
+void BM_Time_FromCivilCompact_CCTZ(benchmark::State& state) {
+  const cctz::time_zone tz = CompactTestTimeZone();
+  int i = 0;
+  while (state.KeepRunning()) {
+    if ((i++ & 1) == 0) {
+      benchmark::DoNotOptimize(
+          cctz::convert(cctz::civil_second(2014, 12, 18, 20, 16, 18), tz));
+    } else {
+      benchmark::DoNotOptimize(
+          cctz::convert(cctz::civil_second(2013, 11, 15, 18, 30, 27), tz));
+    }
+  }
+}
+BENCHMARK(BM_Time_FromCivilCompact_CCTZ);
+
+void BM_Time_FromCivilBatch_CCTZ(benchmark::State& state) {
+  const cctz::time_zone tz = TestTimeZone();
+  std::vector<cctz::civil_second> css(1000);
+  cctz::civil_second cs(2013, 11, 15, 18, 30, 27);
+  for (auto& c : css) c = (cs += 25 * 60 * 60);  // sorted
+  std::vector<cctz::time_zone::civil_lookup> cls(css.size());
+  while (state.KeepRunning()) {
+    tz.lookup(css.data(), css.size(), cls.data());
+    benchmark::DoNotOptimize(cls.data());
+  }
+  state.SetItemsProcessed(state.iterations() * css.size());
+}
+BENCHMARK(BM_Time_FromCivilBatch_CCTZ);
+
+void BM_Time_FromCivilFuture_CCTZ(benchmark::State& state) {
+  // Civil times in the years generated from the zone's future specification.
+  const cctz::time_zone tz = TestTimeZone();
+  int i = 0;
+  while (state.KeepRunning()) {
+    if ((i++ & 1) == 0) {
+      benchmark::DoNotOptimize(
+          cctz::convert(cctz::civil_second(2114, 12, 18, 20, 16, 18), tz));
+    } else {
+      benchmark::DoNotOptimize(
+          cctz::convert(cctz::civil_second(2313, 11, 15, 18, 30, 27), tz));
+    }
+  }
+}
+BENCHMARK(BM_Time_FromCivilFuture_CCTZ);
+
+// As BM_Time_ToCivilPattern_CCTZ, but converting the civil times back.
+void BM_Time_FromCivilPattern_CCTZ(benchmark::State& state) {
+  state.SetLabel(kPatternNames[state.range(0)]);
+  const cctz::time_zone tz = TestTimeZone();
+  std::vector<cctz::civil_second> css;
+  for (const auto& tp : Instants(static_cast<int>(state.range(0)))) {
+    css.push_back(cctz::convert(tp, tz));
+  }
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::convert(css[i], tz));
+    if (++i == css.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Time_FromCivilPattern_CCTZ)
+    ->DenseRange(0, 2)
+    ->ThreadRange(1, 16);
+
+void BM_Time_FromCivilManyZones_CCTZ(benchmark::State& state) {
+  std::vector<std::pair<cctz::time_zone, cctz::civil_second>> work;
+  for (const auto& w :
+       ManyZoneInstants(static_cast<std::size_t>(state.range(0)))) {
+    work.emplace_back(w.first, cctz::convert(w.second, w.first));
+  }
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::convert(work[i].second, work[i].first));
+    if (++i == work.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Time_FromCivilManyZones_CCTZ)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(256)
+    ->ThreadRange(1, 16);
+
 void BM_Time_FromCivil_Libc(benchmark::State& state) {
   // No timezone support, so just use localtime.
   int i = 0;
@@ -991,6 +1525,47 @@ void BM_Time_FromCivilDay0_Libc(benchmark::State& state) {
 }
 BENCHMARK(BM_Time_FromCivilDay0_Libc);
 
+// Converting a sorted series of civil times from one zone into another,
+// either through absolute time, or with a time_zone_converter.
+std::vector<cctz::civil_second> CivilSeries() {
+  std::vector<cctz::civil_second> css(1000);
+  cctz::civil_second cs(2013, 11, 15, 18, 30, 27);
+  for (auto& c : css) c = (cs += 25 * 60 * 60);  // sorted
+  return css;
+}
+
+void BM_Time_ConvertZones_CCTZ(benchmark::State& state) {
+  const cctz::time_zone from = TestTimeZone();
+  cctz::time_zone to;
+  cctz::load_time_zone("Australia/Sydney", &to);
+  const std::vector<cctz::civil_second> css = CivilSeries();
+  std::vector<cctz::civil_second> out(css.size());
+  while (state.KeepRunning()) {
+    for (std::size_t i = 0; i != css.size(); ++i) {
+      out[i] = cctz::convert(cctz::convert(css[i], from), to);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * css.size());
+}
+BENCHMARK(BM_Time_ConvertZones_CCTZ);
+
+void BM_Time_ConvertZonesConverter_CCTZ(benchmark::State& state) {
+  cctz::time_zone to;
+  cctz::load_time_zone("Australia/Sydney", &to);
+  const cctz::time_zone_converter conv(
+      TestTimeZone(), to, cctz::civil_second(2010, 1, 1, 0, 0, 0),
+      cctz::civil_second(2020, 1, 1, 0, 0, 0));
+  const std::vector<cctz::civil_second> css = CivilSeries();
+  std::vector<cctz::civil_second> out(css.size());
+  while (state.KeepRunning()) {
+    conv.convert(css.data(), css.size(), out.data());
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * css.size());
+}
+BENCHMARK(BM_Time_ConvertZonesConverter_CCTZ);
+
 const char* const kFormats[] = {
     RFC1123_full,           // 0
     RFC1123_no_wday,        // 1
@@ -1014,6 +1589,70 @@ void BM_Format_FormatTime(benchmark::State& state) {
 }
 BENCHMARK(BM_Format_FormatTime)->DenseRange(0, kNumFormats - 1);
 
+void BM_Format_FormatTimeTo(benchmark::State& state) {
+  const char* fmt = kFormats[state.range(0)];
+  state.SetLabel(fmt);
+  const cctz::time_zone tz = TestTimeZone();
+  const std::chrono::system_clock::time_point tp =
+      cctz::convert(cctz::civil_second(1977, 6, 28, 9, 8, 7), tz) +
+      std::chrono::microseconds(1);
+  char buf[64];
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cctz::format_to(buf, sizeof(buf), fmt, tp, tz));
+    benchmark::DoNotOptimize(buf);
+  }
+}
+BENCHMARK(BM_Format_FormatTimeTo)->DenseRange(0, kNumFormats - 1);
+
+void BM_Format_FormatTimePlan(benchmark::State& state) {
+  const cctz::format_plan plan(kFormats[state.range(0)]);
+  state.SetLabel(kFormats[state.range(0)]);
+  const cctz::time_zone tz = TestTimeZone();
+  const std::chrono::system_clock::time_point tp =
+      cctz::convert(cctz::civil_second(1977, 6, 28, 9, 8, 7), tz) +
+      std::chrono::microseconds(1);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(plan.format(tp, tz));
+  }
+}
+BENCHMARK(BM_Format_FormatTimePlan)->DenseRange(0, kNumFormats - 1);
+
+void BM_Format_FormatTimePlanBuffer(benchmark::State& state) {
+  const cctz::format_plan plan(kFormats[state.range(0)]);
+  state.SetLabel(kFormats[state.range(0)]);
+  const cctz::time_zone tz = TestTimeZone();
+  const std::chrono::system_clock::time_point tp =
+      cctz::convert(cctz::civil_second(1977, 6, 28, 9, 8, 7), tz) +
+      std::chrono::microseconds(1);
+  char buf[64];
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(plan.format(buf, sizeof(buf), tp, tz));
+    benchmark::DoNotOptimize(buf);
+  }
+}
+BENCHMARK(BM_Format_FormatTimePlanBuffer)->DenseRange(0, kNumFormats - 1);
+
+// Formats the fields derived from the weekday and the day of the year, for
+// days of a year within (2014) and beyond (2514) the formatter's calendar
+// table, and so using the table or working them out.
+void BM_Format_CalendarFields(benchmark::State& state) {
+  const cctz::format_plan plan("%a %j %U %W %u");
+  const cctz::time_zone tz = cctz::utc_time_zone();
+  std::vector<std::chrono::system_clock::time_point> tps;
+  for (int i = 0; i != 365; ++i) {
+    tps.push_back(cctz::convert(
+        cctz::civil_second(cctz::civil_day(state.range(0), 1, 1) + i), tz));
+  }
+  char buf[64];
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(plan.format(buf, sizeof(buf), tps[i], tz));
+    benchmark::DoNotOptimize(buf);
+    if (++i == tps.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Format_CalendarFields)->Arg(2014)->Arg(2514);
+
 void BM_Format_ParseTime(benchmark::State& state) {
   const std::string fmt = kFormats[state.range(0)];
   state.SetLabel(fmt);
@@ -1028,4 +1667,64 @@ void BM_Format_ParseTime(benchmark::State& state) {
 }
 BENCHMARK(BM_Format_ParseTime)->DenseRange(0, kNumFormats - 1);
 
+void BM_Format_ParseTimePlan(benchmark::State& state) {
+  const cctz::parse_plan plan(kFormats[state.range(0)]);
+  state.SetLabel(kFormats[state.range(0)]);
+  const cctz::time_zone tz = TestTimeZone();
+  std::chrono::system_clock::time_point tp =
+      cctz::convert(cctz::civil_second(1977, 6, 28, 9, 8, 7), tz) +
+      std::chrono::microseconds(1);
+  const std::string when = cctz::format(kFormats[state.range(0)], tp, tz);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(plan.parse(when.data(), when.size(), tz, &tp));
+  }
+}
+BENCHMARK(BM_Format_ParseTimePlan)->DenseRange(0, kNumFormats - 1);
+
+void BM_Format_ParseRFC3339(benchmark::State& state) {
+  const cctz::time_zone tz = TestTimeZone();
+  std::chrono::system_clock::time_point tp =
+      cctz::convert(cctz::civil_second(1977, 6, 28, 9, 8, 7), tz) +
+      std::chrono::microseconds(1);
+  const std::string when = cctz::format("%Y-%m-%d%ET%H:%M:%E*S%Ez", tp, tz);
+  state.SetLabel(when);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        cctz::parse_rfc3339(when.data(), when.size(), &tp));
+  }
+}
+BENCHMARK(BM_Format_ParseRFC3339);
+
+// Concurrent formatting and parsing of random instants.
+void BM_Format_FormatTimePlanThreads(benchmark::State& state) {
+  const cctz::format_plan plan(RFC3339_full);
+  const cctz::time_zone tz = TestTimeZone();
+  const auto tps = Instants(kRandom);
+  char buf[64];
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(plan.format(buf, sizeof(buf), tps[i], tz));
+    benchmark::DoNotOptimize(buf);
+    if (++i == tps.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Format_FormatTimePlanThreads)->ThreadRange(1, 16);
+
+void BM_Format_ParseTimePlanThreads(benchmark::State& state) {
+  const cctz::parse_plan plan(RFC3339_full);
+  const cctz::time_zone tz = TestTimeZone();
+  std::vector<std::string> whens;
+  for (const auto& tp : Instants(kRandom)) {
+    whens.push_back(cctz::format(RFC3339_full, tp, tz));
+  }
+  std::chrono::system_clock::time_point tp;
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    const std::string& when = whens[i];
+    benchmark::DoNotOptimize(plan.parse(when.data(), when.size(), tz, &tp));
+    if (++i == whens.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Format_ParseTimePlanThreads)->ThreadRange(1, 16);
+
 }  // namespace
@@ -0,0 +1,205 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   https://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// A tool that compiles zoneinfo into C++ source, so that a program can
+// use the zones without any zoneinfo files, and without parsing them.
+//
+// Usage: cctz_embed_zoneinfo [--zoneinfo=DIR] OUTPUT.cc ZONE...
+//
+// The output defines the decoded tables of each ZONE (as loaded from DIR,
+// or else from the usual places), and registers them during static
+// initialization. It must be compiled with cctz's src directory on the
+// include path, and linked so that it is not discarded (e.g., directly
+// into the program, or with Bazel's alwayslink).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cctz/civil_time.h"
+#include "time_zone_embedded.h"
+
+namespace {
+
+// An integer literal, even for the most negative value.
+std::string Int(std::int_fast64_t v) {
+  if (v == std::numeric_limits<std::int_fast64_t>::min()) {
+    return "(-" + std::to_string(-(v + 1)) + " - 1)";
+  }
+  return std::to_string(v);
+}
+
+std::string CivilSecond(const cctz::civil_second& cs) {
+  std::ostringstream ss;
+  ss << "civil_second(" << Int(cs.year()) << ", " << cs.month() << ", "
+     << cs.day() << ", " << cs.hour() << ", " << cs.minute() << ", "
+     << cs.second() << ")";
+  return ss.str();
+}
+
+// A string literal for n bytes, one piece per NUL-terminated string.
+std::string Chars(const char* p, std::size_t n) {
+  std::string lit = "\"";
+  for (std::size_t i = 0; i != n; ++i) {
+    const unsigned char c = static_cast<unsigned char>(p[i]);
+    if (c == '\0') {
+      lit += (i + 1 == n) ? "\"" : "\\0\" \"";  // a literal ends in NUL
+    } else if (c == '"' || c == '\\') {
+      lit += '\\';
+      lit += static_cast<char>(c);
+    } else if (c < 0x20 || c >= 0x7f) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\%03o\" \"", c);
+      lit += buf;
+    } else {
+      lit += static_cast<char>(c);
+    }
+  }
+  if (n == 0 || p[n - 1] != '\0') lit += "\"";
+  return lit;
+}
+
+void WriteInts(std::ostream& os, const char* name, std::size_t index,
+               const std::int_least64_t* v, std::size_t n) {
+  os << "CCTZ_EMBEDDED_CONST std::int_least64_t " << name << index
+     << "[] = {\n";
+  for (std::size_t i = 0; i != n; ++i) {
+    os << "    " << Int(v[i]) << ",\n";
+  }
+  os << "};\n";
+}
+
+void WriteZone(std::ostream& os, std::size_t i, const std::string& name,
+               const cctz::EmbeddedZone& z) {
+  os << "\n// " << name << "\n";
+  os << "CCTZ_EMBEDDED_CONST Transition kTransitions" << i << "[] = {\n";
+  for (std::size_t j = 0; j != z.timecnt; ++j) {
+    const cctz::Transition& tr = z.transitions[j];
+    os << "    {" << Int(tr.unix_time) << ", " << int{tr.type_index} << ",\n"
+       << "     " << CivilSecond(tr.civil_sec) << ",\n"
+       << "     " << CivilSecond(tr.prev_civil_sec) << "},\n";
+  }
+  os << "};\n";
+  WriteInts(os, "kUnixTimes", i, z.unix_times, z.timecnt);
+  WriteInts(os, "kCivilKeys", i, z.civil_keys, z.timecnt);
+  os << "CCTZ_EMBEDDED_CONST TransitionType kTransitionTypes" << i
+     << "[] = {\n";
+  for (std::size_t j = 0; j != z.typecnt; ++j) {
+    const cctz::TransitionType& tt = z.transition_types[j];
+    os << "    {" << tt.utc_offset << ",\n"
+       << "     " << CivilSecond(tt.civil_max) << ",\n"
+       << "     " << CivilSecond(tt.civil_min) << ",\n"
+       << "     " << (tt.is_dst ? "true" : "false") << ", "
+       << int{tt.abbr_index} << ", " << tt.abbr_len << "},\n";
+  }
+  os << "};\n";
+  os << "CCTZ_EMBEDDED_CONST char kAbbreviations" << i << "[] =\n"
+     << "    " << Chars(z.abbreviations, z.abbrlen) << ";\n";
+}
+
+bool WriteSource(const std::string& path,
+                 const std::vector<std::string>& names) {
+  std::ostringstream os;
+  os << "// Generated by cctz_embed_zoneinfo. DO NOT EDIT.\n"
+     << "\n"
+     << "#include <cstdint>\n"
+     << "\n"
+     << "#include \"cctz/civil_time.h\"\n"
+     << "#include \"time_zone_embedded.h\"\n"
+     << "\n"
+     << "namespace cctz {\n"
+     << "namespace {\n";
+
+  std::ostringstream zones;
+  for (std::size_t i = 0; i != names.size(); ++i) {
+    cctz::EmbeddedZone z;
+    const auto tables = cctz::LoadEmbeddableZone(names[i], &z);
+    if (tables == nullptr) {
+      std::cerr << names[i] << ": unable to load time zone\n";
+      return false;
+    }
+    if (z.timecnt == 0 || z.typecnt == 0 || z.abbrlen == 0) {
+      std::cerr << names[i] << ": unable to embed time zone\n";
+      return false;
+    }
+    WriteZone(os, i, names[i], z);
+    zones << "    {" << Chars(names[i].c_str(), names[i].size() + 1) << ",\n"
+          << "     kTransitions" << i << ", " << z.timecnt << ", kUnixTimes"
+          << i << ", kCivilKeys" << i << ",\n"
+          << "     kTransitionTypes" << i << ", " << z.typecnt
+          << ", kAbbreviations" << i << ", " << z.abbrlen << ",\n"
+          << "     " << Chars(z.version, std::strlen(z.version) + 1) << ", "
+          << Chars(z.future_spec, std::strlen(z.future_spec) + 1) << ",\n"
+          << "     " << Int(z.last_year) << ", "
+          << int{z.default_transition_type} << ", "
+          << (z.extended ? "true" : "false") << "},\n";
+  }
+
+  os << "\n"
+     << "CCTZ_EMBEDDED_CONST EmbeddedZone kZones[] = {\n"
+     << zones.str() << "};\n"
+     << "\n"
+     << "EmbeddedZoneSet zone_set = {kZones, " << names.size()
+     << ", nullptr};\n"
+     << "struct Registrar {\n"
+     << "  Registrar() { RegisterEmbeddedZones(&zone_set); }\n"
+     << "} registrar;\n"
+     << "\n"
+     << "}  // namespace\n"
+     << "}  // namespace cctz\n";
+
+  std::ofstream out(path, std::ios::out | std::ios::binary);
+  out << os.str();
+  out.close();
+  if (!out) {
+    std::cerr << path << ": unable to write\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  const char* argv0 = (argc > 0) ? (argc--, *argv++) : (argc = 0,
+                                                        "cctz_embed_zoneinfo");
+  if (argc > 0 && std::strncmp(*argv, "--zoneinfo=", 11) == 0) {
+    const char* dir = *argv + 11;
+#if defined(_MSC_VER)
+    _putenv_s("TZDIR", dir);
+#else
+    setenv("TZDIR", dir, 1);
+#endif
+    --argc, ++argv;
+  }
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv0
+              << " [--zoneinfo=DIR] OUTPUT.cc ZONE...\n";
+    return 1;
+  }
+  const std::string path = *argv;
+  std::vector<std::string> names(argv + 1, argv + argc);
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  return WriteSource(path, names) ? 0 : 1;
+}
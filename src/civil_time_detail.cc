@@ -14,6 +14,9 @@
 
 #include "cctz/civil_time_detail.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <iomanip>
 #include <ostream>
 #include <sstream>
@@ -21,6 +24,164 @@
 namespace cctz {
 namespace detail {
 
+// The array kernels use the closed-form algorithms of Neri and Schneider,
+// in 32-bit unsigned arithmetic, after shifting dates forward by a whole
+// number of 400-year cycles so that every value in the (roughly +/- 1.4
+// million year) window is non-negative. Each element is computed the same
+// way, so the loops have no data-dependent branches, and a second pass
+// redoes any elements outside the window with the scalar operators.
+struct civil_time_kernels {
+  template <typename T>
+  static civil_time<T> make(year_t y, std::uint_fast32_t m,
+                            std::uint_fast32_t d) noexcept {
+    return civil_time<T>(fields(y, static_cast<month_t>(m),
+                                static_cast<day_t>(d), 0, 0, 0));
+  }
+};
+
+namespace {
+
+// The shift (in 400-year cycles), and the days from the shifted epoch, a
+// computational year starting on March 1, to 1970-01-01.
+const std::int_fast64_t kCycles = 3670;
+const std::int_fast64_t kShiftYears = 400 * kCycles;
+const std::int_fast64_t kShiftDays = 146097 * kCycles + 719468;
+
+// The days since 1970-01-01 handled by CivilFromDays(), which needs the
+// shifted day number n to satisfy 4 * n + 3 < 2^32.
+const std::int_fast64_t kMinDays = -kShiftDays;
+const std::int_fast64_t kMaxDays =
+    (std::int_fast64_t{1} << 30) - 1 - kShiftDays;
+
+// The years handled by DaysFromCivil(), which needs the shifted year y to
+// satisfy 1461 * y < 2^32.
+const year_t kMinYear = 1 - kShiftYears;
+const year_t kMaxYear = 0xFFFFFFFF / 1461 - kShiftYears;
+
+// The years (and month counts) for which month arithmetic cannot overflow.
+const year_t kMaxMonthYear = std::int_fast64_t{1} << 40;
+const diff_t kMaxMonthStep = std::int_fast64_t{1} << 60;
+
+// Days since 1970-01-01 of y-m-d, for y in [kMinYear, kMaxYear].
+inline std::int_fast64_t DaysFromCivil(year_t y, std::uint_fast32_t m,
+                                       std::uint_fast32_t d) noexcept {
+  const std::uint_fast32_t jan_feb = (m <= 2);
+  const std::uint32_t yy =
+      static_cast<std::uint32_t>(y + kShiftYears) - jan_feb;
+  const std::uint32_t mm = static_cast<std::uint32_t>(m + 12 * jan_feb);
+  const std::uint32_t c = yy / 100;
+  const std::uint32_t year_days = 1461 * yy / 4 - c + c / 4;
+  const std::uint32_t month_days = (979 * mm - 2919) / 32;
+  return static_cast<std::int_fast64_t>(year_days + month_days + d - 1) -
+         kShiftDays;
+}
+
+// The y-m-d that is the given days since 1970-01-01, for days in
+// [kMinDays, kMaxDays].
+template <typename T>
+inline civil_time<T> CivilFromDays(std::int_fast64_t days) noexcept {
+  const std::uint32_t n = static_cast<std::uint32_t>(days + kShiftDays);
+  const std::uint32_t n1 = 4 * n + 3;
+  const std::uint32_t century = n1 / 146097;
+  const std::uint32_t n2 = n1 % 146097 / 4 * 4 + 3;
+  const std::uint64_t p2 = std::uint64_t{2939745} * n2;
+  const std::uint32_t year_of_century = static_cast<std::uint32_t>(p2 >> 32);
+  const std::uint32_t day_of_year = static_cast<std::uint32_t>(p2) / 11758980;
+  const std::uint32_t n3 = 2141 * day_of_year + 197913;
+  const std::uint32_t jan_feb = (day_of_year >= 306);
+  const year_t y = static_cast<year_t>(100 * century + year_of_century) -
+                   kShiftYears + jan_feb;
+  return civil_time_kernels::make<T>(y, (n3 >> 16) - 12 * jan_feb,
+                                     (n3 & 0xFFFF) / 2141 + 1);
+}
+
+}  // namespace
+
+void add_days(const civil_day& origin, const diff_t* n, std::size_t count,
+              civil_day* out) noexcept {
+  if (origin.year() < kMinYear || origin.year() > kMaxYear) {
+    for (std::size_t i = 0; i != count; ++i) out[i] = origin + n[i];
+    return;
+  }
+  const std::int_fast64_t base =
+      DaysFromCivil(origin.year(), static_cast<std::uint_fast32_t>(
+                                       origin.month()),
+                    static_cast<std::uint_fast32_t>(origin.day()));
+  const diff_t lo = kMinDays - base;
+  const diff_t hi = kMaxDays - base;
+  bool clamped = false;
+  for (std::size_t i = 0; i != count; ++i) {
+    const diff_t step = std::min(std::max(n[i], lo), hi);
+    clamped |= (step != n[i]);
+    out[i] = CivilFromDays<day_tag>(base + step);
+  }
+  if (clamped) {
+    for (std::size_t i = 0; i != count; ++i) {
+      if (n[i] < lo || n[i] > hi) out[i] = origin + n[i];
+    }
+  }
+}
+
+void add_months(const civil_month& origin, const diff_t* n,
+                std::size_t count, civil_month* out) noexcept {
+  if (origin.year() < -kMaxMonthYear || origin.year() > kMaxMonthYear) {
+    for (std::size_t i = 0; i != count; ++i) out[i] = origin + n[i];
+    return;
+  }
+  const std::int_fast64_t base = origin.year() * 12 + (origin.month() - 1);
+  bool clamped = false;
+  for (std::size_t i = 0; i != count; ++i) {
+    const diff_t step = std::min(std::max(n[i], -kMaxMonthStep), kMaxMonthStep);
+    clamped |= (step != n[i]);
+    const std::int_fast64_t months = base + step;
+    const std::int_fast64_t y = months / 12 - (months % 12 < 0);  // floor
+    out[i] = civil_time_kernels::make<month_tag>(
+        y, static_cast<std::uint_fast32_t>(months - y * 12 + 1), 1);
+  }
+  if (clamped) {
+    for (std::size_t i = 0; i != count; ++i) {
+      if (n[i] < -kMaxMonthStep || n[i] > kMaxMonthStep) {
+        out[i] = origin + n[i];
+      }
+    }
+  }
+}
+
+void day_differences(const civil_day* cd, std::size_t count,
+                     const civil_day& origin, diff_t* out) noexcept {
+  if (origin.year() < kMinYear || origin.year() > kMaxYear) {
+    for (std::size_t i = 0; i != count; ++i) out[i] = cd[i] - origin;
+    return;
+  }
+  const std::int_fast64_t base =
+      DaysFromCivil(origin.year(), static_cast<std::uint_fast32_t>(
+                                       origin.month()),
+                    static_cast<std::uint_fast32_t>(origin.day()));
+  bool clamped = false;
+  for (std::size_t i = 0; i != count; ++i) {
+    const year_t y = std::min(std::max(cd[i].year(), kMinYear), kMaxYear);
+    clamped |= (y != cd[i].year());
+    out[i] = DaysFromCivil(y, static_cast<std::uint_fast32_t>(cd[i].month()),
+                           static_cast<std::uint_fast32_t>(cd[i].day())) -
+             base;
+  }
+  if (clamped) {
+    for (std::size_t i = 0; i != count; ++i) {
+      if (cd[i].year() < kMinYear || cd[i].year() > kMaxYear) {
+        out[i] = cd[i] - origin;
+      }
+    }
+  }
+}
+
+void month_differences(const civil_month* cm, std::size_t count,
+                       const civil_month& origin, diff_t* out) noexcept {
+  // The scalar difference is already in closed form, without branches.
+  for (std::size_t i = 0; i != count; ++i) out[i] = cm[i] - origin;
+}
+
+////////////////////////////////////////////////////////////////////////
+
 // Output stream operators output a format matching YYYY-MM-DDThh:mm:ss,
 // while omitting fields inferior to the type's alignment. For example,
 // civil_day is formatted only as YYYY-MM-DD.
@@ -19,6 +19,7 @@
 #include <sstream>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -821,6 +822,47 @@ TEST(CivilTime, DifferenceLimits) {
   EXPECT_EQ(kIntMin, d1 - (d2 + 1));
 }
 
+TEST(CivilTime, ArrayArithmetic) {
+  // Steps that straddle every kind of boundary near the origins, plus some
+  // that leave the closed-form window, or the range of years altogether.
+  std::vector<diff_t> steps;
+  for (diff_t n = -1000000; n <= 1000000; n += 997) steps.push_back(n);
+  for (diff_t n = -800; n <= 800; ++n) steps.push_back(n);
+  for (diff_t n : {diff_t{536000000}, diff_t{-536000000},
+                   diff_t{1} << 40, -(diff_t{1} << 40),
+                   std::numeric_limits<diff_t>::max(),
+                   std::numeric_limits<diff_t>::min()}) {
+    steps.push_back(n);
+  }
+  const std::int_fast64_t kBig = std::numeric_limits<int>::max();
+  std::vector<civil_day> cds(steps.size());
+  std::vector<civil_month> cms(steps.size());
+  std::vector<diff_t> diffs(steps.size());
+  for (const civil_day origin :
+       {civil_day(1970, 1, 1), civil_day(2000, 2, 29), civil_day(-4713, 11, 24),
+        civil_day(1468000, 12, 31), civil_day(kBig, 6, 15),
+        civil_day(-kBig, 3, 1)}) {
+    add_days(origin, steps.data(), steps.size(), cds.data());
+    for (std::size_t i = 0; i != steps.size(); ++i) {
+      EXPECT_EQ(origin + steps[i], cds[i]) << origin << " + " << steps[i];
+    }
+    day_differences(cds.data(), cds.size(), origin, diffs.data());
+    for (std::size_t i = 0; i != steps.size(); ++i) {
+      EXPECT_EQ(cds[i] - origin, diffs[i]) << cds[i] << " - " << origin;
+    }
+
+    const civil_month month(origin);
+    add_months(month, steps.data(), steps.size(), cms.data());
+    for (std::size_t i = 0; i != steps.size(); ++i) {
+      EXPECT_EQ(month + steps[i], cms[i]) << month << " + " << steps[i];
+    }
+    month_differences(cms.data(), cms.size(), month, diffs.data());
+    for (std::size_t i = 0; i != steps.size(); ++i) {
+      EXPECT_EQ(cms[i] - month, diffs[i]) << cms[i] << " - " << month;
+    }
+  }
+}
+
 TEST(CivilTime, Properties) {
   civil_second ss(2015, 2, 3, 4, 5, 6);
   EXPECT_EQ(2015, ss.year());
@@ -998,6 +1040,25 @@ TEST(CivilTime, NextPrevWeekday) {
   d = next_weekday(thursday, weekday::wednesday);
   EXPECT_EQ(6, d - thursday) << Format(d);
   EXPECT_EQ(d - 7, prev_weekday(thursday, weekday::wednesday));
+
+  // Every pair of weekdays, including around the extremes of year_t.
+  for (const civil_day start :
+       {thursday, civil_day::min() + 14, civil_day::max() - 14}) {
+    for (int i = 0; i != 7; ++i) {
+      const civil_day from = start + i;
+      for (int w = 0; w != 7; ++w) {
+        const weekday wd = static_cast<weekday>(w);
+        const civil_day next = next_weekday(from, wd);
+        EXPECT_EQ(wd, get_weekday(next)) << Format(from);
+        EXPECT_GE(next - from, 1) << Format(from);
+        EXPECT_LE(next - from, 7) << Format(from);
+        const civil_day prev = prev_weekday(from, wd);
+        EXPECT_EQ(wd, get_weekday(prev)) << Format(from);
+        EXPECT_GE(from - prev, 1) << Format(from);
+        EXPECT_LE(from - prev, 7) << Format(from);
+      }
+    }
+  }
 }
 
 TEST(CivilTime, NormalizeWithHugeYear) {
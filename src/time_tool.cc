@@ -14,16 +14,33 @@
 
 // A command-line tool for exercising the CCTZ library.
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <chrono>
+#include <climits>
+#include <cstdio>
 #include <cstring>
 #include <ctime>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "cctz/civil_time.h"
@@ -296,6 +313,290 @@ bool ParseYearRange(bool zdump, const std::string& args,
   return false;
 }
 
+// Whether parse() will take the absolute time from the input (through an
+// offset, or seconds since the epoch) rather than from the time zone.
+bool FormatHasOffset(const std::string& fmt) {
+  for (std::size_t i = 0; i < fmt.size(); ++i) {
+    if (fmt[i] != '%' || ++i == fmt.size()) continue;
+    if (fmt[i] == 'E') {  // %Ez or %E*z, but also %E4Y, %E*S, ...
+      ++i;
+      while (i < fmt.size() && (fmt[i] == '*' || std::isdigit(fmt[i]))) ++i;
+    } else if (fmt[i] == ':') {  // %:z
+      ++i;
+    }
+    if (i < fmt.size() && (fmt[i] == 'z' || fmt[i] == 's')) return true;
+  }
+  return false;
+}
+
+bool IsSpace(char c) { return std::isspace(static_cast<unsigned char>(c)); }
+
+// The length of the prefix of [p, p + len) that holds the given number of
+// whitespace-separated words.
+std::size_t WordsLength(const char* p, std::size_t len, std::size_t words) {
+  std::size_t i = 0;
+  while (words-- != 0) {
+    while (i != len && IsSpace(p[i])) ++i;
+    while (i != len && !IsSpace(p[i])) ++i;
+  }
+  return i;
+}
+
+std::size_t CountWords(const std::string& s) {
+  std::size_t words = 0;
+  for (std::size_t i = 0; i != s.size(); ++i) {
+    if (!IsSpace(s[i]) && (i == 0 || IsSpace(s[i - 1]))) ++words;
+  }
+  return words;
+}
+
+// The streaming mode (--stream) rewrites the timestamp that starts each
+// input line, as parsed by in_format (in the "from" zone, unless the input
+// includes an offset), using out_format in the "to" zone. Lines without
+// such a timestamp are copied unchanged.
+struct Stream {
+  Stream(const std::string& in_format, const std::string& out_format)
+      : in_plan(in_format),
+        out_plan(out_format),
+        absolute(FormatHasOffset(in_format)),
+        words(CountWords(in_format)),
+        threads(std::max(1u, std::thread::hardware_concurrency())) {}
+
+  cctz::time_zone from;
+  cctz::time_zone to;
+  cctz::parse_plan in_plan;
+  cctz::format_plan out_plan;
+  bool absolute;      // the input gives the offset (or is %s)
+  std::size_t words;  // the number of words in a timestamp
+  unsigned threads;
+};
+
+// Converts the lines in [begin, end), appending the results to *out. The
+// lines are handled in batches, so that those without offsets can share a
+// single batch lookup in the "from" zone.
+void StreamLines(const Stream& st, const char* begin, const char* end,
+                 std::string* out) {
+  using nanotime = time_point<std::chrono::nanoseconds>;
+  const cctz::time_zone utc = cctz::utc_time_zone();
+  const std::size_t kBatch = 1024;
+  struct Line {
+    const char* p;
+    std::size_t len;     // not counting any newline
+    std::size_t ts_len;  // the timestamp, when ok
+    bool ok;
+    nanotime tp;
+  };
+  std::vector<Line> lines;
+  std::vector<cctz::civil_second> css;
+  std::vector<cctz::time_zone::civil_lookup> cls;
+  std::vector<std::size_t> civil_lines;  // lines[civil_lines[i]] is css[i]
+  char buf[128];
+  out->reserve(out->size() + static_cast<std::size_t>(end - begin));
+
+  while (begin != end) {
+    lines.clear();
+    css.clear();
+    civil_lines.clear();
+    while (begin != end && lines.size() != kBatch) {
+      const char* nl = static_cast<const char*>(
+          std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+      Line line;
+      line.p = begin;
+      line.len = static_cast<std::size_t>((nl ? nl : end) - begin);
+      line.ts_len = WordsLength(line.p, line.len, st.words);
+      // Without an offset the timestamp is parsed as UTC, to give the
+      // civil time, which is then converted in the batch below.
+      line.ok = st.in_plan.parse(line.p, line.ts_len, utc, &line.tp);
+      if (line.ok && !st.absolute) {
+        auto sec = std::chrono::time_point_cast<seconds>(line.tp);
+        if (sec > line.tp) sec -= seconds(1);
+        civil_lines.push_back(lines.size());
+        css.push_back(cctz::convert(sec, utc));
+        line.tp -= sec.time_since_epoch();  // just the subseconds
+      }
+      lines.push_back(line);
+      begin = nl ? nl + 1 : end;
+    }
+
+    if (!css.empty()) {
+      cls.resize(css.size());
+      st.from.lookup(css.data(), css.size(), cls.data());
+      for (std::size_t i = 0; i != css.size(); ++i) {
+        Line& line = lines[civil_lines[i]];
+        const time_point<seconds> pre = cls[i].pre;
+        if (pre == time_point<seconds>::min() ||
+            pre == time_point<seconds>::max()) {
+          // Leaves the range checks at the extremes to parse().
+          line.ok = st.in_plan.parse(line.p, line.ts_len, st.from, &line.tp);
+        } else {
+          line.tp += pre.time_since_epoch();
+        }
+      }
+    }
+
+    for (const Line& line : lines) {
+      std::size_t rest = 0;
+      if (line.ok) {
+        const std::size_t n = st.out_plan.format(buf, sizeof(buf), line.tp,
+                                                 st.to);
+        if (n <= sizeof(buf)) {
+          out->append(buf, n);
+        } else {
+          out->append(st.out_plan.format(line.tp, st.to));
+        }
+        rest = line.ts_len;
+      }
+      out->append(line.p + rest, line.len - rest);
+      if (line.p + line.len != end) out->push_back('\n');
+    }
+  }
+}
+
+// Converts [begin, end), which ends at a line boundary (or is the end of
+// the input), and writes the result to std::cout. Large buffers are split
+// at line boundaries across the threads, with the results written in the
+// original order.
+void StreamBuffer(const Stream& st, const char* begin, const char* end) {
+  const std::size_t kMinThreadBytes = 256 * 1024;
+  const std::size_t size = static_cast<std::size_t>(end - begin);
+  const std::size_t nthreads = std::max<std::size_t>(
+      1, std::min<std::size_t>(st.threads, size / kMinThreadBytes));
+  std::vector<std::string> outs(nthreads);
+  std::vector<std::thread> workers;
+  const char* pos = begin;
+  for (std::size_t i = 0; i != nthreads; ++i) {
+    const char* stop = end;
+    if (i + 1 != nthreads) {
+      stop = std::max(pos, begin + size / nthreads * (i + 1));
+      const void* nl =
+          std::memchr(stop, '\n', static_cast<std::size_t>(end - stop));
+      stop = nl ? static_cast<const char*>(nl) + 1 : end;
+    }
+    if (i + 1 == nthreads) {
+      StreamLines(st, pos, stop, &outs[i]);
+    } else {
+      workers.emplace_back(StreamLines, std::cref(st), pos, stop, &outs[i]);
+    }
+    pos = stop;
+  }
+  for (auto& worker : workers) worker.join();
+  for (const std::string& out : outs) std::cout.write(out.data(), out.size());
+}
+
+// The input is converted a window at a time, to bound the memory used.
+const std::size_t kStreamWindow = 16 * 1024 * 1024;
+
+// Converts a whole file, reading it directly from a mapping if possible.
+bool StreamFile(const Stream& st, const std::string& path) {
+  const char* data = nullptr;
+  std::size_t size = 0;
+  std::string contents;
+#if !defined(_WIN32)
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;
+  struct stat sb;
+  if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+    size = static_cast<std::size_t>(sb.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+#if defined(MADV_SEQUENTIAL)
+      madvise(map, size, MADV_SEQUENTIAL);
+#endif
+      data = static_cast<const char*>(map);
+    }
+  }
+  close(fd);
+#endif
+  if (data == nullptr) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    contents.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+    data = contents.data();
+    size = contents.size();
+  }
+
+  const char* const end = data + size;
+  for (const char* pos = data; pos != end;) {
+    const char* stop = end;
+    if (static_cast<std::size_t>(end - pos) > kStreamWindow) {
+      const void* nl = std::memchr(pos + kStreamWindow, '\n',
+                                   static_cast<std::size_t>(
+                                       end - (pos + kStreamWindow)));
+      stop = nl ? static_cast<const char*>(nl) + 1 : end;
+    }
+    StreamBuffer(st, pos, stop);
+    pos = stop;
+  }
+#if !defined(_WIN32)
+  if (contents.empty() && size != 0) {
+    munmap(const_cast<char*>(data), size);
+  }
+#endif
+  return true;
+}
+
+// Reads whatever input is available (waiting for some), up to len bytes,
+// returning zero at the end of the input.
+std::size_t ReadStdin(char* buf, std::size_t len) {
+#if !defined(_WIN32)
+  for (;;) {
+    const ssize_t n = read(STDIN_FILENO, buf, len);
+    if (n >= 0) return static_cast<std::size_t>(n);
+    if (errno != EINTR) return 0;
+  }
+#else
+  const int n = _read(0, buf, static_cast<unsigned int>(
+                                  std::min<std::size_t>(len, INT_MAX)));
+  return n > 0 ? static_cast<std::size_t>(n) : 0;
+#endif
+}
+
+// Converts stdin as it arrives, so that the complete lines from each read
+// (of a pipe or a terminal, say) are written at once, carrying any partial
+// last line over to the next read.
+void StreamStdin(const Stream& st) {
+  std::string window(kStreamWindow, '\0');
+  std::size_t size = 0;
+  for (;;) {
+    if (size == window.size()) window.resize(size * 2);  // a very long line
+    const std::size_t n = ReadStdin(&window[size], window.size() - size);
+    if (n == 0) break;
+    const std::size_t start = size;
+    size += n;
+    std::size_t len = size;  // through the last newline that was read
+    while (len != start && window[len - 1] != '\n') --len;
+    if (len == start) continue;
+    StreamBuffer(st, window.data(), window.data() + len);
+    std::cout.flush();
+    std::memmove(&window[0], window.data() + len, size - len);
+    size -= len;
+  }
+  if (size != 0) StreamBuffer(st, window.data(), window.data() + size);
+}
+
+// Matches "--name=<value>" or "--name <value>" (given opt without its
+// leading dashes), returning false if opt is some other option.
+bool ValueOption(const char* argv0, const char* name, const char* opt,
+                 int* optind, int argc, const char** argv, std::string* value,
+                 int* opterr) {
+  const std::size_t len = std::strlen(name);
+  if (std::strncmp(opt, name, len) != 0) return false;
+  if (opt[len] == '=') {
+    *value = opt + len + 1;
+    return true;
+  }
+  if (opt[len] != '\0') return false;
+  if (*optind + 1 == argc) {
+    std::cerr << argv0 << ": option '--" << name
+              << "' requires an argument\n";
+    ++*opterr;
+  } else {
+    *value = argv[++*optind];
+  }
+  return true;
+}
+
 int main(int argc, const char** argv) {
   const char* argv0 = (argc > 0) ? (argc--, *argv++) : (argc = 0, "time_tool");
   const std::string prog = Basename(argv0);
@@ -317,6 +618,11 @@ int main(int argc, const char** argv) {
   std::string fmt = "%Y-%m-%d %H:%M:%S %E*z (%Z)";
   bool zone_dump = (prog == "zone_dump");
   bool zdump = false;  // Use zdump(8) format.
+  bool stream = false;
+  std::string from_zone;
+  std::string to_zone;
+  std::string in_fmt = "%Y-%m-%d%ET%H:%M:%E*S%Ez";
+  std::string out_fmt;
   int optind = 0;
   int opterr = 0;
   for (; optind < argc && opterr == 0; ++optind) {
@@ -383,7 +689,16 @@ int main(int argc, const char** argv) {
         zdump = true;
       } else if (std::strcmp(opt, "zone_dump") == 0) {
         zone_dump = true;
-      } else {
+      } else if (std::strcmp(opt, "stream") == 0) {
+        stream = true;
+      } else if (!ValueOption(argv0, "from", opt, &optind, argc, argv,
+                              &from_zone, &opterr) &&
+                 !ValueOption(argv0, "to", opt, &optind, argc, argv,
+                              &to_zone, &opterr) &&
+                 !ValueOption(argv0, "in-format", opt, &optind, argc, argv,
+                              &in_fmt, &opterr) &&
+                 !ValueOption(argv0, "out-format", opt, &optind, argc, argv,
+                              &out_fmt, &opterr)) {
         std::cerr << argv0 << ": unrecognized option '--" << opt << "'\n";
         ++opterr;
       }
@@ -399,9 +714,42 @@ int main(int argc, const char** argv) {
       std::cerr << " [<time-spec>]\n";
     }
     std::cerr << "  Default <time-spec> is 'now'.\n";
+    std::cerr << "       " << prog << " --stream [--from=<zone>] [--to=<zone>]"
+              << " [--in-format=<fmt>] [--out-format=<fmt>] [<file>...]\n";
+    std::cerr << "  Converts the timestamp that starts each line of the files"
+              << " (or stdin).\n";
+    std::cerr << "  Default zones are the first --tz, formats are RFC3339.\n";
     return 1;
   }
 
+  if (stream) {
+    const std::vector<std::string> tzs = StrSplit(',', zones);
+    const std::string tz = tzs.empty() ? "localtime" : tzs.front();
+    if (from_zone.empty()) from_zone = tz;
+    if (to_zone.empty()) to_zone = tz;
+    if (out_fmt.empty()) out_fmt = in_fmt;
+    Stream st(in_fmt, out_fmt);
+    for (const auto& zone : {std::make_pair(&from_zone, &st.from),
+                             std::make_pair(&to_zone, &st.to)}) {
+      if (*zone.first == "localtime") {
+        *zone.second = cctz::local_time_zone();
+      } else if (!cctz::load_time_zone(*zone.first, zone.second)) {
+        std::cerr << *zone.first << ": Unrecognized time zone\n";
+        return 1;
+      }
+    }
+    std::ios::sync_with_stdio(false);
+    if (optind == argc) StreamStdin(st);
+    for (int i = optind; i < argc; ++i) {
+      if (!StreamFile(st, argv[i])) {
+        std::cerr << argv[i] << ": Unable to read\n";
+        return 1;
+      }
+    }
+    std::cout.flush();
+    return std::cout ? 0 : 1;
+  }
+
   std::string args;
   for (int i = optind; i < argc; ++i) {
     if (i != optind) args += " ";
@@ -0,0 +1,236 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   https://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include "time_zone_bundle.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cctz/time_zone.h"
+#include "time_zone_info.h"
+
+namespace cctz {
+
+// Bundled tables are used in place, so they must be plain bytes.
+static_assert(std::is_trivially_copyable<Transition>::value,
+              "Transition must be trivially copyable");
+static_assert(std::is_trivially_copyable<TransitionType>::value,
+              "TransitionType must be trivially copyable");
+static_assert(alignof(Transition) <= 8 && alignof(TransitionType) <= 8,
+              "bundled tables are only 8-byte aligned");
+
+namespace {
+
+std::atomic<const ZoneBundle*> zone_bundle(nullptr);
+
+// Keeps a bundle that is no longer installed reachable, as zones loaded
+// from it still use its tables in place.
+void RetireZoneBundle(const ZoneBundle* bundle) {
+  if (bundle == nullptr) return;
+  static std::mutex* mu = new std::mutex;  // never deleted
+  static auto* retired = new std::vector<const ZoneBundle*>;  // likewise
+  std::lock_guard<std::mutex> lock(*mu);
+  retired->push_back(bundle);
+}
+
+// Maps the whole file read-only, returning null on failure.
+const char* MapFile(const std::string& path, std::size_t* size) {
+#if defined(_WIN32)
+  // Without mmap() we read the file into (never freed) memory instead,
+  // which is suitably aligned because it comes from operator new.
+  FILE* fp;
+  if (fopen_s(&fp, path.c_str(), "rb") != 0) return nullptr;
+  std::unique_ptr<FILE, int (*)(FILE*)> file(fp, fclose);
+  if (fseek(fp, 0, SEEK_END) != 0) return nullptr;
+  const long len = ftell(fp);
+  if (len <= 0 || fseek(fp, 0, SEEK_SET) != 0) return nullptr;
+  std::unique_ptr<char[]> data(new char[static_cast<std::size_t>(len)]);
+  if (fread(data.get(), 1, static_cast<std::size_t>(len), fp) !=
+      static_cast<std::size_t>(len)) {
+    return nullptr;
+  }
+  *size = static_cast<std::size_t>(len);
+  return data.release();
+#else
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return nullptr;
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    *size = static_cast<std::size_t>(st.st_size);
+    data = mmap(nullptr, *size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  return (data == MAP_FAILED) ? nullptr : static_cast<const char*>(data);
+#endif
+}
+
+void UnmapFile(const char* data, std::size_t size) {
+#if defined(_WIN32)
+  static_cast<void>(size);
+  delete[] data;
+#else
+  munmap(const_cast<char*>(data), size);
+#endif
+}
+
+}  // namespace
+
+const ZoneBundle* ZoneBundle::Open(const std::string& path) {
+  std::size_t size = 0;
+  const char* data = MapFile(path, &size);
+  if (data == nullptr) return nullptr;
+  std::unique_ptr<ZoneBundle> bundle(new ZoneBundle(data, size));
+
+  // Checks that the bundle was written by a compatible library, and that
+  // its index is intact, so that Find() need not check anything further.
+  bool ok = false;
+  if (const BundleHeader* hdr = bundle->At<BundleHeader>(0, 1)) {
+    if (std::memcmp(hdr->magic, kBundleMagic, sizeof(kBundleMagic)) == 0 &&
+        hdr->format == kBundleFormat && hdr->byte_order == kBundleByteOrder &&
+        hdr->transition_size == sizeof(Transition) &&
+        hdr->type_size == sizeof(TransitionType) && hdr->file_size == size) {
+      bundle->zone_count_ = static_cast<std::size_t>(hdr->zone_count);
+      bundle->entries_ =
+          bundle->At<BundleEntry>(sizeof(BundleHeader), hdr->zone_count);
+      ok = (bundle->entries_ != nullptr);
+      const char* prev = nullptr;
+      for (std::size_t i = 0; ok && i != bundle->zone_count_; ++i) {
+        const char* name = bundle->String(bundle->entries_[i].name);
+        ok = (name != nullptr &&
+              (prev == nullptr || std::strcmp(prev, name) < 0));
+        prev = name;
+      }
+    }
+  }
+  if (!ok) {
+    UnmapFile(data, size);
+    return nullptr;
+  }
+  return bundle.release();
+}
+
+const BundleZone* ZoneBundle::Find(const std::string& name) const {
+  const BundleEntry* const end = entries_ + zone_count_;
+  const BundleEntry* entry = std::lower_bound(
+      entries_, end, name, [this](const BundleEntry& e, const std::string& n) {
+        return n.compare(data_ + e.name) > 0;
+      });
+  if (entry == end || name.compare(data_ + entry->name) != 0) return nullptr;
+  return At<BundleZone>(entry->zone, 1);
+}
+
+const char* ZoneBundle::String(std::uint64_t offset) const {
+  if (offset >= size_) return nullptr;
+  const char* s = data_ + offset;
+  if (std::memchr(s, '\0', size_ - offset) == nullptr) return nullptr;
+  return s;
+}
+
+const ZoneBundle* GetZoneBundle() {
+  return zone_bundle.load(std::memory_order_acquire);
+}
+
+void ClearZoneBundleTestOnly() {
+  RetireZoneBundle(zone_bundle.exchange(nullptr, std::memory_order_acq_rel));
+}
+
+bool write_time_zone_bundle(const std::string& path,
+                            const std::vector<std::string>& names) {
+  std::vector<std::string> sorted(names);
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+  // Reserves space for the header and index, which are filled in last.
+  std::string image(sizeof(BundleHeader) + sorted.size() * sizeof(BundleEntry),
+                    '\0');
+  std::vector<BundleEntry> entries(sorted.size());
+  for (std::size_t i = 0; i != sorted.size(); ++i) {
+    TimeZoneInfo tz;
+    if (!tz.Load(sorted[i])) return false;
+    image.append((8 - image.size() % 8) % 8, '\0');
+    entries[i].zone = image.size();
+    image.append(sizeof(BundleZone), '\0');
+    BundleZone zone;
+    tz.AppendToBundle(&image, &zone);
+    std::memcpy(&image[entries[i].zone], &zone, sizeof(zone));
+  }
+  for (std::size_t i = 0; i != sorted.size(); ++i) {
+    entries[i].name = image.size();
+    image.append(sorted[i].c_str(), sorted[i].size() + 1);
+  }
+  image.append((8 - image.size() % 8) % 8, '\0');
+
+  BundleHeader hdr;
+  std::memcpy(hdr.magic, kBundleMagic, sizeof(hdr.magic));
+  hdr.format = kBundleFormat;
+  hdr.byte_order = kBundleByteOrder;
+  hdr.transition_size = sizeof(Transition);
+  hdr.type_size = sizeof(TransitionType);
+  hdr.file_size = image.size();
+  hdr.zone_count = sorted.size();
+  std::memcpy(&image[0], &hdr, sizeof(hdr));
+  if (!entries.empty()) {
+    std::memcpy(&image[sizeof(hdr)], entries.data(),
+                entries.size() * sizeof(BundleEntry));
+  }
+
+  // Writes a temporary file and renames it into place, so that processes
+  // which have the old bundle mapped are unaffected.
+  const std::string tmp = path + ".tmp";
+#if defined(_MSC_VER)
+  FILE* fp;
+  if (fopen_s(&fp, tmp.c_str(), "wb") != 0) fp = nullptr;
+#else
+  FILE* fp = fopen(tmp.c_str(), "wb");
+#endif
+  if (fp == nullptr) return false;
+  const bool written =
+      fwrite(image.data(), 1, image.size(), fp) == image.size();
+  if (fclose(fp) != 0 || !written) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+#if defined(_WIN32)
+  std::remove(path.c_str());  // rename() does not replace on Windows
+#endif
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool use_time_zone_bundle(const std::string& path) {
+  const ZoneBundle* bundle = ZoneBundle::Open(path);
+  if (bundle == nullptr) return false;
+  RetireZoneBundle(zone_bundle.exchange(bundle, std::memory_order_acq_rel));
+  return true;
+}
+
+}  // namespace cctz
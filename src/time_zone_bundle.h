@@ -0,0 +1,122 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   https://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef CCTZ_TIME_ZONE_BUNDLE_H_
+#define CCTZ_TIME_ZONE_BUNDLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cctz {
+
+// A bundle is a single file holding many zones that have already been
+// loaded, so that their lookup tables can be used in place once the file
+// is mapped into memory (and so that its pages are shared by every process
+// that maps it). The tables are stored in the native representation of the
+// library that wrote them, so a bundle is only accepted by a build with the
+// same format, structure sizes and byte order (see BundleHeader).
+//
+// The file is laid out as:
+//
+//   BundleHeader
+//   BundleEntry[zone_count], sorted by name
+//   for each zone, a BundleZone followed by its tables and strings
+//   the NUL-terminated zone names
+//
+// where every offset is from the start of the file, and everything except
+// the strings is 8-byte aligned.
+
+constexpr char kBundleMagic[8] = {'T', 'Z', 'b', 'u', 'n', 'd', 'l', 'e'};
+constexpr std::uint32_t kBundleFormat = 3;
+constexpr std::uint32_t kBundleByteOrder = 0x01020304;
+
+struct BundleHeader {
+  char magic[8];                  // kBundleMagic
+  std::uint32_t format;           // kBundleFormat
+  std::uint32_t byte_order;       // kBundleByteOrder, as written
+  std::uint32_t transition_size;  // sizeof(Transition)
+  std::uint32_t type_size;        // sizeof(TransitionType)
+  std::uint64_t file_size;        // the size of the whole bundle
+  std::uint64_t zone_count;       // the number of BundleEntry records
+};
+
+struct BundleEntry {
+  std::uint64_t name;  // the offset of the zone name
+  std::uint64_t zone;  // the offset of its BundleZone
+};
+
+// The TimeZoneInfo state for one zone.
+struct BundleZone {
+  std::uint64_t timecnt;           // the number of transitions
+  std::uint64_t typecnt;           // the number of transition types
+  std::uint64_t abbrlen;           // the length of the abbreviations
+  std::uint64_t transitions;       // the offset of Transition[timecnt]
+  std::uint64_t unix_times;        // the offset of int64_t[timecnt]
+  std::uint64_t civil_keys;        // the offset of int64_t[timecnt]
+  std::uint64_t transition_types;  // the offset of TransitionType[typecnt]
+  std::uint64_t abbreviations;     // the offset of char[abbrlen]
+  std::uint64_t version;           // the offset of the tzdata version
+  std::uint64_t future_spec;       // the offset of the POSIX spec
+  std::int64_t last_year;
+  std::uint8_t default_transition_type;
+  std::uint8_t extended;
+  std::uint8_t reserved[6];
+};
+
+// A bundle file that has been mapped (or, where mapping is unavailable,
+// read) into memory. Bundles are never released, as the zones loaded from
+// them refer to their tables directly.
+class ZoneBundle {
+ public:
+  // Returns null if the file cannot be mapped or is not a valid bundle.
+  static const ZoneBundle* Open(const std::string& path);
+
+  // Returns the named zone, or null when the bundle does not contain it.
+  const BundleZone* Find(const std::string& name) const;
+
+  // Returns a pointer to count Ts at the given offset, or null if they
+  // are not properly aligned or do not lie within the bundle.
+  template <typename T>
+  const T* At(std::uint64_t offset, std::uint64_t count) const {
+    if (offset % alignof(T) != 0 || offset > size_ ||
+        count > (size_ - offset) / sizeof(T)) {
+      return nullptr;
+    }
+    return reinterpret_cast<const T*>(data_ + offset);
+  }
+
+  // Returns the NUL-terminated string at the given offset, or null.
+  const char* String(std::uint64_t offset) const;
+
+ private:
+  ZoneBundle(const char* data, std::size_t size)
+      : data_(data), size_(size), entries_(nullptr), zone_count_(0) {}
+
+  const char* const data_;
+  const std::size_t size_;
+  const BundleEntry* entries_;
+  std::size_t zone_count_;
+};
+
+// The bundle that TimeZoneInfo::Load() consults first, if any.
+const ZoneBundle* GetZoneBundle();
+
+// Stops consulting any bundle, for tests. Zones that were loaded from it
+// remain usable.
+void ClearZoneBundleTestOnly();
+
+}  // namespace cctz
+
+#endif  // CCTZ_TIME_ZONE_BUNDLE_H_
@@ -0,0 +1,65 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   https://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include "time_zone_embedded.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "time_zone_info.h"
+
+namespace cctz {
+
+namespace {
+
+// The registered sets, most recent first. Sets are only ever added, so
+// readers can walk the list without locking.
+std::atomic<const EmbeddedZoneSet*> embedded_zone_sets(nullptr);
+
+}  // namespace
+
+void RegisterEmbeddedZones(EmbeddedZoneSet* set) {
+  const EmbeddedZoneSet* head =
+      embedded_zone_sets.load(std::memory_order_relaxed);
+  do {
+    set->next = head;
+  } while (!embedded_zone_sets.compare_exchange_weak(
+      head, set, std::memory_order_release, std::memory_order_relaxed));
+}
+
+const EmbeddedZone* FindEmbeddedZone(const std::string& name) {
+  for (const EmbeddedZoneSet* set =
+           embedded_zone_sets.load(std::memory_order_acquire);
+       set != nullptr; set = set->next) {
+    const EmbeddedZone* const end = set->zones + set->count;
+    const EmbeddedZone* zone = std::lower_bound(
+        set->zones, end, name, [](const EmbeddedZone& z, const std::string& n) {
+          return n.compare(z.name) > 0;
+        });
+    if (zone != end && name.compare(zone->name) == 0) return zone;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<const void> LoadEmbeddableZone(const std::string& name,
+                                               EmbeddedZone* zone) {
+  auto tz = std::make_shared<TimeZoneInfo>();
+  if (!tz->Load(name)) return nullptr;
+  tz->Embed(zone);
+  return tz;
+}
+
+}  // namespace cctz
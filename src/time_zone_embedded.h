@@ -0,0 +1,81 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   https://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef CCTZ_TIME_ZONE_EMBEDDED_H_
+#define CCTZ_TIME_ZONE_EMBEDDED_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "cctz/civil_time.h"
+#include "time_zone_transition.h"
+
+// The generated tables are constexpr whenever civil_second construction
+// is, and otherwise const (and so dynamically initialized).
+#if __cpp_constexpr >= 201304 || (defined(_MSC_VER) && _MSC_VER >= 1910)
+#define CCTZ_EMBEDDED_CONST constexpr
+#else
+#define CCTZ_EMBEDDED_CONST const
+#endif
+
+namespace cctz {
+
+// The decoded TimeZoneInfo state for one zone, referring to tables that
+// live elsewhere. The sources written by cctz_embed_zoneinfo define these
+// (and the tables) as constants, so, when compiled as C++14 or later, the
+// zones occupy shared, read-only memory and need no I/O or parsing at all.
+struct EmbeddedZone {
+  const char* name;
+  const Transition* transitions;
+  std::size_t timecnt;
+  const std::int_least64_t* unix_times;  // [timecnt]
+  const std::int_least64_t* civil_keys;  // [timecnt]
+  const TransitionType* transition_types;
+  std::size_t typecnt;
+  const char* abbreviations;  // NUL-terminated abbreviations
+  std::size_t abbrlen;
+  const char* version;
+  const char* future_spec;
+  year_t last_year;
+  std::uint_least8_t default_transition_type;
+  bool extended;
+};
+
+// A group of embedded zones, sorted by name.
+struct EmbeddedZoneSet {
+  const EmbeddedZone* zones;
+  std::size_t count;
+  const EmbeddedZoneSet* next;  // set by RegisterEmbeddedZones()
+};
+
+// Makes the zones in the set available to TimeZoneInfo::Load(), which
+// prefers them to any ZoneInfoSource. The generated sources call this
+// during static initialization, and the set must outlive every zone.
+void RegisterEmbeddedZones(EmbeddedZoneSet* set);
+
+// Returns the named embedded zone, or null when no set contains it.
+const EmbeddedZone* FindEmbeddedZone(const std::string& name);
+
+// Loads the named zone, as load_time_zone() would, and describes it in
+// *zone (except for its name), for cctz_embed_zoneinfo to write out.
+// Returns the owner of the tables that *zone refers to, or null if the
+// zone cannot be loaded.
+std::shared_ptr<const void> LoadEmbeddableZone(const std::string& name,
+                                               EmbeddedZone* zone);
+
+}  // namespace cctz
+
+#endif  // CCTZ_TIME_ZONE_EMBEDDED_H_
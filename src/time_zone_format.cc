@@ -30,6 +30,7 @@
 // declare strptime.
 #include <time.h>
 
+#include <algorithm>
 #include <cctype>
 #include <chrono>
 #include <cstddef>
@@ -46,6 +47,7 @@
 
 #include "cctz/civil_time.h"
 #include "time_zone_if.h"
+#include "time_zone_impl.h"
 
 namespace cctz {
 namespace detail {
@@ -105,6 +107,62 @@ weekday FromTmWday(int tm_wday) {
   return weekday::sunday; /*NOTREACHED*/
 }
 
+// The years for which ToCalendarDay() uses a table, rather than working
+// out the weekday and the day of the year afresh. Builds may override it.
+#if !defined(CCTZ_CALENDAR_MIN_YEAR)
+#define CCTZ_CALENDAR_MIN_YEAR 1900
+#endif
+#if !defined(CCTZ_CALENDAR_MAX_YEAR)
+#define CCTZ_CALENDAR_MAX_YEAR 2200
+#endif
+
+// For each year of the calendar range, the tm_wday of its January 1st in
+// the low three bits, and whether it is a leap year in the next one.
+class CalendarYears {
+ public:
+  static const year_t kMinYear = CCTZ_CALENDAR_MIN_YEAR;
+  static const year_t kMaxYear = CCTZ_CALENDAR_MAX_YEAR;
+
+  CalendarYears() {
+    for (year_t y = kMinYear; y <= kMaxYear; ++y) {
+      const int jan1 = ToTmWday(get_weekday(civil_day(y, 1, 1)));
+      const bool leap = impl::is_leap_year(y);
+      years_[y - kMinYear] = static_cast<unsigned char>(jan1 | (leap ? 8 : 0));
+    }
+  }
+
+  unsigned char operator[](year_t y) const { return years_[y - kMinYear]; }
+
+ private:
+  unsigned char years_[kMaxYear - kMinYear + 1];
+};
+
+const CalendarYears& Calendar() {
+  static const CalendarYears calendar;  // trivially destructible
+  return calendar;
+}
+
+// The tm_wday [0:6] and tm_yday [0:365] of a civil time.
+struct CalendarDay {
+  int wday;
+  int yday;
+};
+
+CalendarDay ToCalendarDay(const civil_second& cs) {
+  const year_t y = cs.year();
+  if (y < CalendarYears::kMinYear || y > CalendarYears::kMaxYear) {
+    return {ToTmWday(get_weekday(cs)), get_yearday(cs) - 1};
+  }
+  static const int kMonthOffsets[1 + 12] = {
+      -1, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334,
+  };
+  const unsigned year = Calendar()[y];
+  const int yday = kMonthOffsets[cs.month()] +
+                   static_cast<int>((year >> 3) & (cs.month() > 2)) +
+                   cs.day() - 1;
+  return {static_cast<int>((year & 7) + yday) % 7, yday};
+}
+
 std::tm ToTM(const time_zone::absolute_lookup& al) {
   std::tm tm{};
   tm.tm_sec = al.cs.second();
@@ -122,17 +180,17 @@ std::tm ToTM(const time_zone::absolute_lookup& al) {
     tm.tm_year = static_cast<int>(al.cs.year() - 1900);
   }
 
-  tm.tm_wday = ToTmWday(get_weekday(al.cs));
-  tm.tm_yday = get_yearday(al.cs) - 1;
+  const CalendarDay day = ToCalendarDay(al.cs);
+  tm.tm_wday = day.wday;
+  tm.tm_yday = day.yday;
   tm.tm_isdst = al.is_dst ? 1 : 0;
   return tm;
 }
 
-// Returns the week of the year [0:53] given a civil day and the day on
-// which weeks are defined to start.
-int ToWeek(const civil_day& cd, weekday week_start) {
-  const civil_day d(cd.year() % 400, cd.month(), cd.day());
-  return static_cast<int>((d - prev_weekday(civil_year(d), week_start)) / 7);
+// Returns the week of the year [0:53] given a calendar day and the tm_wday
+// on which weeks are defined to start (so 0 for %U, and 1 for %W).
+int ToWeek(const CalendarDay& day, int week_start) {
+  return (day.yday + 7 - (day.wday - week_start + 7) % 7) / 7;
 }
 
 const char kDigits[] = "0123456789";
@@ -207,23 +265,6 @@ char* FormatOffset(char* ep, int offset, const char* mode) {
   return ep;
 }
 
-// Formats a std::tm using strftime(3).
-void FormatTM(std::string* out, const std::string& fmt, const std::tm& tm) {
-  // strftime(3) returns the number of characters placed in the output
-  // array (which may be 0 characters).  It also returns 0 to indicate
-  // an error, like the array wasn't large enough.  To accommodate this,
-  // the following code grows the buffer size from 2x the format string
-  // length up to 32x.
-  for (std::size_t i = 2; i != 32; i *= 2) {
-    std::size_t buf_size = fmt.size() * i;
-    std::vector<char> buf(buf_size);
-    if (std::size_t len = strftime(&buf[0], buf_size, fmt.c_str(), &tm)) {
-      out->append(&buf[0], len);
-      return;
-    }
-  }
-}
-
 // Used for %E#S/%E#f specifiers and for data values in parse().
 template <typename T>
 const char* ParseInt(const char* dp, int width, T min, T max, T* vp) {
@@ -303,6 +344,108 @@ const std::int_fast64_t kExp10[kDigits10_64 + 1] = {
     1000000000000000000,
 };
 
+// The "C" locale names of the days of the week (indexed by tm_wday) and
+// of the months, as rendered by a format_plan. The abbreviated names are
+// just the first three characters.
+const char* const kWeekdayNames[7] = {
+    "Sunday", "Monday", "Tuesday", "Wednesday",
+    "Thursday", "Friday", "Saturday",
+};
+const char* const kMonthNames[12] = {
+    "January", "February", "March", "April", "May", "June",
+    "July", "August", "September", "October", "November", "December",
+};
+
+// The format_plan::Op kinds.
+enum PlanOpKind {
+  kLiteral,       // text_[pos, pos + len)
+  kStrftime,      // strftime() of the specifier at text_[pos]
+  kYear,          // %Y
+  kYear4,         // %E4Y
+  kMonth,         // %m
+  kDay,           // %d
+  kDaySpace,      // %e
+  kYearDay,       // %j
+  kHour,          // %H
+  kHour12,        // %I
+  kMinute,        // %M
+  kSecond,        // %S, and %E#S when arg is the precision
+  kSecondStar,    // %E*S
+  kSubsecond,     // %E#f, where arg is the precision
+  kSubsecondStar, // %E*f
+  kOffset,        // %z, %:z, %::z, %:::z, where arg indexes kOffsetModes
+  kAbbr,          // %Z
+  kUnixSeconds,   // %s
+  kWeekSun,       // %U
+  kWeekMon,       // %W
+  kWeekdayMon1,   // %u
+  kWeekdaySun0,   // %w
+  kWeekdayShort,  // %a
+  kWeekdayLong,   // %A
+  kMonthShort,    // %b, %h
+  kMonthLong,     // %B
+  kAmPm,          // %p
+};
+
+// The FormatOffset() modes for %z, %:z (and %Ez), %::z (and %E*z), %:::z.
+const char* const kOffsetModes[4] = {"", ":", ":*", ":*:"};
+
+// Collects formatted output into a caller-provided buffer, while counting
+// the length of the complete result (which may not fit).
+class Sink {
+ public:
+  Sink(char* buf, std::size_t cap) : buf_(buf), cap_(cap), len_(0) {}
+
+  void Append(const char* bp, std::size_t n) {
+    if (len_ < cap_) std::memcpy(buf_ + len_, bp, std::min(n, cap_ - len_));
+    len_ += n;
+  }
+  void Append(const char* bp, const char* ep) {
+    Append(bp, static_cast<std::size_t>(ep - bp));
+  }
+
+  std::size_t size() const { return len_; }
+
+ private:
+  char* const buf_;
+  const std::size_t cap_;
+  std::size_t len_;
+};
+
+// Formats a std::tm using strftime(3), like FormatTM() above, but only
+// allocating if the result is very long.
+void FormatTM(Sink* out, const char* fmt, std::size_t fmt_len,
+              const std::tm& tm) {
+  char buf[128];
+  if (std::size_t len = strftime(buf, sizeof(buf), fmt, &tm)) {
+    out->Append(buf, len);
+    return;
+  }
+  for (std::size_t i = 2; i != 32; i *= 2) {
+    std::size_t buf_size = std::max(fmt_len * i, sizeof(buf) * i);
+    std::vector<char> vbuf(buf_size);
+    if (std::size_t len = strftime(&vbuf[0], buf_size, fmt, &tm)) {
+      out->Append(&vbuf[0], len);
+      return;
+    }
+  }
+}
+
+// Formats a std::tm using strftime(3) with the format text [bp, ep), which
+// is first copied so that it can be NUL terminated.
+void FormatTM(Sink* out, const char* bp, const char* ep, const std::tm& tm) {
+  const std::size_t n = static_cast<std::size_t>(ep - bp);
+  char buf[64];
+  if (n < sizeof(buf)) {
+    std::memcpy(buf, bp, n);
+    buf[n] = '\0';
+    FormatTM(out, buf, n, tm);
+  } else {
+    const std::string fmt(bp, n);
+    FormatTM(out, fmt.c_str(), n, tm);
+  }
+}
+
 }  // namespace
 
 // Uses strftime(3) to format the given Time.  The following extended format
@@ -326,26 +469,32 @@ const std::int_fast64_t kExp10[kDigits10_64 + 1] = {
 // not support the tm_gmtoff and tm_zone extensions to std::tm.
 //
 // Requires that zero() <= fs < seconds(1).
-std::string format(const std::string& format, const time_point<seconds>& tp,
+//
+// The result is, like snprintf(), truncated to the first cap characters
+// (with no NUL terminator), and the complete length is returned. The
+// format must be NUL terminated at format[format_len].
+std::size_t format(const char* format, std::size_t format_len, char* buf,
+                   std::size_t cap, const time_point<seconds>& tp,
                    const detail::femtoseconds& fs, const time_zone& tz) {
-  std::string result;
-  result.reserve(format.size());  // A reasonable guess for the result size.
-  const time_zone::absolute_lookup al = tz.lookup(tp);
+  Sink out(buf, cap);
+  std::size_t abbr_len;
+  const time_zone::absolute_lookup al =
+      time_zone::Impl::Lookup(tz, tp, &abbr_len);
   const std::tm tm = ToTM(al);
 
   // Scratch buffer for internal conversions.
-  char buf[3 + kDigits10_64];  // enough for longest conversion
-  char* const ep = buf + sizeof(buf);
+  char sbuf[3 + kDigits10_64];  // enough for longest conversion
+  char* const ep = sbuf + sizeof(sbuf);
   char* bp;  // works back from ep
 
   // Maintain three, disjoint subsequences that span format.
-  //   [format.begin() ... pending) : already formatted into result
+  //   [format ... pending) : already formatted into out
   //   [pending ... cur) : formatting pending, but no special cases
-  //   [cur ... format.end()) : unexamined
+  //   [cur ... format + format_len) : unexamined
   // Initially, everything is in the unexamined part.
-  const char* pending = format.c_str();  // NUL terminated
+  const char* pending = format;
   const char* cur = pending;
-  const char* end = pending + format.length();
+  const char* end = pending + format_len;
 
   while (cur != end) {  // while something is unexamined
     // Moves cur to the next percent sign.
@@ -354,7 +503,7 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
 
     // If the new pending text is all ordinary, copy it out.
     if (cur != start && pending == start) {
-      result.append(pending, static_cast<std::size_t>(cur - pending));
+      out.Append(pending, cur);
       pending = start = cur;
     }
 
@@ -366,11 +515,11 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
     // percent for every matched pair, then skip those pairs.
     if (cur != start && pending == start) {
       std::size_t escaped = static_cast<std::size_t>(cur - pending) / 2;
-      result.append(pending, escaped);
+      out.Append(pending, escaped);
       pending += escaped * 2;
       // Also copy out a single trailing percent.
       if (pending != cur && cur == end) {
-        result.push_back(*pending++);
+        out.Append(pending++, 1);
       }
     }
 
@@ -380,66 +529,66 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
     // Simple specifiers that we handle ourselves.
     if (strchr("YmdeUuWwHMSzZs%", *cur)) {
       if (cur - 1 != pending) {
-        FormatTM(&result, std::string(pending, cur - 1), tm);
+        FormatTM(&out, pending, cur - 1, tm);
       }
       switch (*cur) {
         case 'Y':
           // This avoids the tm.tm_year overflow problem for %Y, however
           // tm.tm_year will still be used by other specifiers like %D.
           bp = Format64(ep, 0, al.cs.year());
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'm':
           bp = Format02d(ep, al.cs.month());
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'd':
         case 'e':
           bp = Format02d(ep, al.cs.day());
           if (*cur == 'e' && *bp == '0') *bp = ' ';  // for Windows
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'U':
-          bp = Format02d(ep, ToWeek(civil_day(al.cs), weekday::sunday));
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          bp = Format02d(ep, ToWeek({tm.tm_wday, tm.tm_yday}, 0));
+          out.Append(bp, ep);
           break;
         case 'u':
           bp = Format64(ep, 0, tm.tm_wday ? tm.tm_wday : 7);
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'W':
-          bp = Format02d(ep, ToWeek(civil_day(al.cs), weekday::monday));
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          bp = Format02d(ep, ToWeek({tm.tm_wday, tm.tm_yday}, 1));
+          out.Append(bp, ep);
           break;
         case 'w':
           bp = Format64(ep, 0, tm.tm_wday);
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'H':
           bp = Format02d(ep, al.cs.hour());
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'M':
           bp = Format02d(ep, al.cs.minute());
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'S':
           bp = Format02d(ep, al.cs.second());
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'z':
           bp = FormatOffset(ep, al.offset, "");
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case 'Z':
-          result.append(al.abbr);
+          out.Append(al.abbr, abbr_len);
           break;
         case 's':
           bp = Format64(ep, 0, ToUnixSeconds(tp));
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           break;
         case '%':
-          result.push_back('%');
+          out.Append("%", 1);
           break;
       }
       pending = ++cur;
@@ -451,10 +600,10 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
       if (*(cur + 1) == 'z') {
         // Formats %:z.
         if (cur - 1 != pending) {
-          FormatTM(&result, std::string(pending, cur - 1), tm);
+          FormatTM(&out, pending, cur - 1, tm);
         }
         bp = FormatOffset(ep, al.offset, ":");
-        result.append(bp, static_cast<std::size_t>(ep - bp));
+        out.Append(bp, ep);
         pending = cur += 2;
         continue;
       }
@@ -462,10 +611,10 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
         if (*(cur + 2) == 'z') {
           // Formats %::z.
           if (cur - 1 != pending) {
-            FormatTM(&result, std::string(pending, cur - 1), tm);
+            FormatTM(&out, pending, cur - 1, tm);
           }
           bp = FormatOffset(ep, al.offset, ":*");
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           pending = cur += 3;
           continue;
         }
@@ -473,10 +622,10 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
           if (*(cur + 3) == 'z') {
             // Formats %:::z.
             if (cur - 1 != pending) {
-              FormatTM(&result, std::string(pending, cur - 1), tm);
+              FormatTM(&out, pending, cur - 1, tm);
             }
             bp = FormatOffset(ep, al.offset, ":*:");
-            result.append(bp, static_cast<std::size_t>(ep - bp));
+            out.Append(bp, ep);
             pending = cur += 4;
             continue;
           }
@@ -491,31 +640,31 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
     if (*cur == 'T') {
       // Formats %ET.
       if (cur - 2 != pending) {
-        FormatTM(&result, std::string(pending, cur - 2), tm);
+        FormatTM(&out, pending, cur - 2, tm);
       }
-      result.append("T");
+      out.Append("T", 1);
       pending = ++cur;
     } else if (*cur == 'z') {
       // Formats %Ez.
       if (cur - 2 != pending) {
-        FormatTM(&result, std::string(pending, cur - 2), tm);
+        FormatTM(&out, pending, cur - 2, tm);
       }
       bp = FormatOffset(ep, al.offset, ":");
-      result.append(bp, static_cast<std::size_t>(ep - bp));
+      out.Append(bp, ep);
       pending = ++cur;
     } else if (*cur == '*' && cur + 1 != end && *(cur + 1) == 'z') {
       // Formats %E*z.
       if (cur - 2 != pending) {
-        FormatTM(&result, std::string(pending, cur - 2), tm);
+        FormatTM(&out, pending, cur - 2, tm);
       }
       bp = FormatOffset(ep, al.offset, ":*");
-      result.append(bp, static_cast<std::size_t>(ep - bp));
+      out.Append(bp, ep);
       pending = cur += 2;
     } else if (*cur == '*' && cur + 1 != end &&
                (*(cur + 1) == 'S' || *(cur + 1) == 'f')) {
       // Formats %E*S or %E*F.
       if (cur - 2 != pending) {
-        FormatTM(&result, std::string(pending, cur - 2), tm);
+        FormatTM(&out, pending, cur - 2, tm);
       }
       char* cp = ep;
       bp = Format64(cp, 15, fs.count());
@@ -529,15 +678,15 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
           if (cp == bp) *--bp = '0';
           break;
       }
-      result.append(bp, static_cast<std::size_t>(cp - bp));
+      out.Append(bp, cp);
       pending = cur += 2;
     } else if (*cur == '4' && cur + 1 != end && *(cur + 1) == 'Y') {
       // Formats %E4Y.
       if (cur - 2 != pending) {
-        FormatTM(&result, std::string(pending, cur - 2), tm);
+        FormatTM(&out, pending, cur - 2, tm);
       }
       bp = Format64(ep, 4, al.cs.year());
-      result.append(bp, static_cast<std::size_t>(ep - bp));
+      out.Append(bp, ep);
       pending = cur += 2;
     } else if (std::isdigit(*cur)) {
       // Possibly found %E#S or %E#f.
@@ -546,7 +695,7 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
         if (*np == 'S' || *np == 'f') {
           // Formats %E#S or %E#f.
           if (cur - 2 != pending) {
-            FormatTM(&result, std::string(pending, cur - 2), tm);
+            FormatTM(&out, pending, cur - 2, tm);
           }
           bp = ep;
           if (n > 0) {
@@ -556,7 +705,7 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
             if (*np == 'S') *--bp = '.';
           }
           if (*np == 'S') bp = Format02d(bp, al.cs.second());
-          result.append(bp, static_cast<std::size_t>(ep - bp));
+          out.Append(bp, ep);
           pending = cur = ++np;
         }
       }
@@ -565,9 +714,162 @@ std::string format(const std::string& format, const time_point<seconds>& tp,
 
   // Formats any remaining data.
   if (end != pending) {
-    FormatTM(&result, std::string(pending, end), tm);
+    FormatTM(&out, pending, end, tm);
+  }
+
+  return out.size();
+}
+
+std::string format(const std::string& format, const time_point<seconds>& tp,
+                   const detail::femtoseconds& fs, const time_zone& tz) {
+  char buf[128];
+  const std::size_t len =
+      detail::format(format.data(), format.size(), buf, sizeof(buf), tp, fs,
+                     tz);
+  if (len <= sizeof(buf)) return std::string(buf, len);
+  std::string result(len, '\0');
+  detail::format(format.data(), format.size(), &result[0], len, tp, fs, tz);
+  return result;
+}
+
+std::size_t format(const format_plan& plan, char* buf, std::size_t cap,
+                   const time_point<seconds>& tp,
+                   const detail::femtoseconds& fs, const time_zone& tz) {
+  Sink out(buf, cap);
+  std::size_t abbr_len;
+  const time_zone::absolute_lookup al =
+      time_zone::Impl::Lookup(tz, tp, &abbr_len);
+  std::tm tm{};
+  if (plan.needs_tm_) tm = ToTM(al);
+
+  // Scratch buffer for internal conversions.
+  char sbuf[3 + kDigits10_64];  // enough for longest conversion
+  char* const ep = sbuf + sizeof(sbuf);
+  char* bp;  // works back from ep
+
+  for (const format_plan::Op& op : plan.ops_) {
+    switch (op.kind) {
+      case kLiteral:
+        out.Append(plan.text_.data() + op.pos, op.len);
+        break;
+      case kStrftime:
+        FormatTM(&out, plan.text_.c_str() + op.pos, op.len, tm);
+        break;
+      case kYear:
+        out.Append(Format64(ep, 0, al.cs.year()), ep);
+        break;
+      case kYear4:
+        out.Append(Format64(ep, 4, al.cs.year()), ep);
+        break;
+      case kMonth:
+        out.Append(Format02d(ep, al.cs.month()), ep);
+        break;
+      case kDay:
+        out.Append(Format02d(ep, al.cs.day()), ep);
+        break;
+      case kDaySpace:
+        bp = Format02d(ep, al.cs.day());
+        if (*bp == '0') *bp = ' ';
+        out.Append(bp, ep);
+        break;
+      case kYearDay:
+        out.Append(Format64(ep, 3, ToCalendarDay(al.cs).yday + 1), ep);
+        break;
+      case kHour:
+        out.Append(Format02d(ep, al.cs.hour()), ep);
+        break;
+      case kHour12:
+        out.Append(Format02d(ep, (al.cs.hour() + 11) % 12 + 1), ep);
+        break;
+      case kMinute:
+        out.Append(Format02d(ep, al.cs.minute()), ep);
+        break;
+      case kSecond:
+        bp = ep;
+        if (op.arg > 0) {
+          const int n = op.arg;
+          bp = Format64(bp, n, (n > 15) ? fs.count() * kExp10[n - 15]
+                                        : fs.count() / kExp10[15 - n]);
+          *--bp = '.';
+        }
+        out.Append(Format02d(bp, al.cs.second()), ep);
+        break;
+      case kSecondStar:
+      case kSubsecondStar: {
+        char* cp = ep;
+        bp = Format64(cp, 15, fs.count());
+        while (cp != bp && cp[-1] == '0') --cp;
+        if (op.kind == kSecondStar) {
+          if (cp != bp) *--bp = '.';
+          bp = Format02d(bp, al.cs.second());
+        } else {
+          if (cp == bp) *--bp = '0';
+        }
+        out.Append(bp, cp);
+        break;
+      }
+      case kSubsecond:
+        if (op.arg > 0) {
+          const int n = op.arg;
+          out.Append(Format64(ep, n, (n > 15) ? fs.count() * kExp10[n - 15]
+                                              : fs.count() / kExp10[15 - n]),
+                     ep);
+        }
+        break;
+      case kOffset:
+        out.Append(FormatOffset(ep, al.offset, kOffsetModes[op.arg]), ep);
+        break;
+      case kAbbr:
+        out.Append(al.abbr, abbr_len);
+        break;
+      case kUnixSeconds:
+        out.Append(Format64(ep, 0, ToUnixSeconds(tp)), ep);
+        break;
+      case kWeekSun:
+        out.Append(Format02d(ep, ToWeek(ToCalendarDay(al.cs), 0)), ep);
+        break;
+      case kWeekMon:
+        out.Append(Format02d(ep, ToWeek(ToCalendarDay(al.cs), 1)), ep);
+        break;
+      case kWeekdayMon1: {
+        const int wday = ToCalendarDay(al.cs).wday;
+        out.Append(Format64(ep, 0, wday ? wday : 7), ep);
+        break;
+      }
+      case kWeekdaySun0:
+        out.Append(Format64(ep, 0, ToCalendarDay(al.cs).wday), ep);
+        break;
+      case kWeekdayShort:
+        out.Append(kWeekdayNames[ToCalendarDay(al.cs).wday], 3);
+        break;
+      case kWeekdayLong: {
+        const char* name = kWeekdayNames[ToCalendarDay(al.cs).wday];
+        out.Append(name, std::strlen(name));
+        break;
+      }
+      case kMonthShort:
+        out.Append(kMonthNames[al.cs.month() - 1], 3);
+        break;
+      case kMonthLong: {
+        const char* name = kMonthNames[al.cs.month() - 1];
+        out.Append(name, std::strlen(name));
+        break;
+      }
+      case kAmPm:
+        out.Append(al.cs.hour() < 12 ? "AM" : "PM", 2);
+        break;
+    }
   }
+  return out.size();
+}
 
+std::string format(const format_plan& plan, const time_point<seconds>& tp,
+                   const detail::femtoseconds& fs, const time_zone& tz) {
+  char buf[128];
+  const std::size_t len = format(plan, buf, sizeof(buf), tp, fs, tz);
+  if (len <= sizeof(buf)) return std::string(buf, len);
+  std::string result(len, '\0');
+  format(plan, &result[0], len, tp, fs, tz);
   return result;
 }
 
@@ -668,91 +970,432 @@ bool FromWeek(int week_num, weekday week_start, year_t* year, std::tm* tm) {
   return true;
 }
 
-}  // namespace
+// Converts the parsed fields, which are shifted by offset when it is
+// non-zero, to an absolute time in ptz.  Returns false, after setting
+// any *err, if the fields are out of range.
+bool ToTimePoint(const time_zone& ptz, year_t year, int month, int day,
+                 int hour, int minute, int second, int offset,
+                 detail::femtoseconds subseconds, time_point<seconds>* sec,
+                 detail::femtoseconds* fs, std::string* err) {
+  // Allows a leap second of 60 to normalize forward to the following ":00".
+  if (second == 60) {
+    second -= 1;
+    offset -= 1;
+    subseconds = detail::femtoseconds::zero();
+  }
 
-// Uses strptime(3) to parse the given input.  Supports the same extended
-// format specifiers as format(), although %E#S and %E*S are treated
-// identically (and similarly for %E#f and %E*f).  %Ez and %E*z also accept
-// the same inputs. %ET accepts either 'T' or 't'.
-//
-// The standard specifiers from RFC3339_* (%Y, %m, %d, %H, %M, and %S) are
-// handled internally so that we can normally avoid strptime() altogether
-// (which is particularly helpful when the native implementation is broken).
-//
-// The TZ/GNU %s extension is handled internally because strptime() has to
-// use localtime_r() to generate it, and that assumes the local time zone.
-//
-// We also handle the %z specifier to accommodate platforms that do not
-// support the tm_gmtoff extension to std::tm.  %Z is parsed but ignored.
-bool parse(const std::string& format, const std::string& input,
-           const time_zone& tz, time_point<seconds>* sec,
-           detail::femtoseconds* fs, std::string* err) {
-  // The unparsed input.
-  const char* data = input.c_str();  // NUL terminated
+  civil_second cs(year, month, day, hour, minute, second);
 
-  // Skips leading whitespace.
-  while (std::isspace(*data)) ++data;
+  // parse() should not allow normalization. Due to the restricted field
+  // ranges above (see ParseInt()), the only possibility is for days to roll
+  // into months. That is, parsing "Sep 31" should not produce "Oct 1".
+  if (cs.month() != month || cs.day() != day) {
+    if (err != nullptr) *err = "Out-of-range field";
+    return false;
+  }
 
-  const year_t kyearmax = std::numeric_limits<year_t>::max();
-  const year_t kyearmin = std::numeric_limits<year_t>::min();
+  // Accounts for the offset adjustment before converting to absolute time.
+  if ((offset < 0 && cs > civil_second::max() + offset) ||
+      (offset > 0 && cs < civil_second::min() + offset)) {
+    if (err != nullptr) *err = "Out-of-range field";
+    return false;
+  }
+  cs -= offset;
 
-  // Sets default values for unspecified fields.
-  bool saw_year = false;
-  year_t year = 1970;
-  std::tm tm{};
-  tm.tm_year = 1970 - 1900;
-  tm.tm_mon = 1 - 1;  // Jan
-  tm.tm_mday = 1;
-  tm.tm_hour = 0;
-  tm.tm_min = 0;
-  tm.tm_sec = 0;
-  tm.tm_wday = 4;  // Thu
-  tm.tm_yday = 0;
-  tm.tm_isdst = 0;
-  auto subseconds = detail::femtoseconds::zero();
-  bool saw_offset = false;
-  int offset = 0;  // No offset from passed tz.
-  std::string zone = "UTC";
+  const auto tp = ptz.lookup(cs).pre;
+  // Checks for overflow/underflow and returns an error as necessary.
+  if (tp == time_point<seconds>::max()) {
+    const auto al = ptz.lookup(time_point<seconds>::max());
+    if (cs > al.cs) {
+      if (err != nullptr) *err = "Out-of-range field";
+      return false;
+    }
+  }
+  if (tp == time_point<seconds>::min()) {
+    const auto al = ptz.lookup(time_point<seconds>::min());
+    if (cs < al.cs) {
+      if (err != nullptr) *err = "Out-of-range field";
+      return false;
+    }
+  }
 
-  const char* fmt = format.c_str();  // NUL terminated
-  bool twelve_hour = false;
-  bool afternoon = false;
-  int week_num = -1;
-  weekday week_start = weekday::sunday;
+  *sec = tp;
+  *fs = subseconds;
+  return true;
+}
 
-  bool saw_percent_s = false;
-  std::int_fast64_t percent_s = 0;
+// The parse_plan::Op kinds.
+enum ParseOpKind {
+  kParseLiteral,    // text_[pos, pos + len)
+  kParseSpace,      // any amount of whitespace
+  kParseYear,       // %Y
+  kParseYear4,      // %E4Y
+  kParseMonth,      // %m
+  kParseDay,        // %d, %e
+  kParseHour,       // %H
+  kParseMinute,     // %M
+  kParseSecond,     // %S
+  kParseSecondSub,  // %E*S, %E#S
+  kParseSubsecond,  // %E*f, %E#f
+  kParseOffset,     // %z
+  kParseOffsetSep,  // %:z, %::z, %:::z, %Ez, %E*z
+  kParseDateTime,   // %ET
+  kParseZone,       // %Z
+  kParseSeconds,    // %s
+};
 
-  // Steps through format, one specifier at a time.
-  while (data != nullptr && *fmt != '\0') {
-    if (std::isspace(*fmt)) {
-      while (std::isspace(*data)) ++data;
-      while (std::isspace(*++fmt)) continue;
-      continue;
-    }
+// Versions of the parsing helpers above for the parse_plan input, which
+// ends at ep rather than at a NUL.  The results are otherwise identical.
 
-    if (*fmt != '%') {
-      if (*data == *fmt) {
-        ++data;
-        ++fmt;
+inline bool IsSpace(char c) {
+  return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+inline int DigitAt(const char* dp, const char* ep) {
+  if (dp == ep) return -1;
+  const unsigned d = static_cast<unsigned>(*dp - '0');
+  return d < 10 ? static_cast<int>(d) : -1;
+}
+
+template <typename T>
+const char* ParseInt(const char* dp, const char* ep, int width, T min, T max,
+                     T* vp) {
+  if (dp != nullptr) {
+    const T kmin = std::numeric_limits<T>::min();
+    bool erange = false;
+    bool neg = false;
+    T value = 0;
+    if (dp != ep && *dp == '-') {
+      neg = true;
+      if (width <= 0 || --width != 0) {
+        ++dp;
       } else {
-        data = nullptr;
+        dp = nullptr;  // width was 1
       }
-      continue;
     }
-
-    const char* percent = fmt;
-    if (*++fmt == '\0') {
-      data = nullptr;
-      continue;
+    if (const char* const bp = dp) {
+      for (int d; (d = DigitAt(dp, ep)) >= 0;) {
+        if (value < kmin / 10) {
+          erange = true;
+          break;
+        }
+        value *= 10;
+        if (value < kmin + d) {
+          erange = true;
+          break;
+        }
+        value -= d;
+        dp += 1;
+        if (width > 0 && --width == 0) break;
+      }
+      if (dp != bp && !erange && (neg || value != kmin)) {
+        if (!neg || value != 0) {
+          if (!neg) value = -value;  // make positive
+          if (min <= value && value <= max) {
+            *vp = value;
+          } else {
+            dp = nullptr;
+          }
+        } else {
+          dp = nullptr;
+        }
+      } else {
+        dp = nullptr;
+      }
     }
-    switch (*fmt++) {
-      case 'Y':
-        // Symmetrically with FormatTime(), directly handing %Y avoids the
-        // tm.tm_year overflow problem.  However, tm.tm_year will still be
-        // used by other specifiers like %D.
-        data = ParseInt(data, 0, kyearmin, kyearmax, &year);
-        if (data != nullptr) saw_year = true;
+  }
+  return dp;
+}
+
+// Equivalent to ParseInt(dp, ep, 2, min, max, vp) for a non-negative min,
+// which is all that the two-digit fields need.
+const char* Parse2(const char* dp, const char* ep, int min, int max,
+                   int* vp) {
+  if (dp != nullptr) {
+    int value = DigitAt(dp, ep);
+    if (value >= 0) {
+      const int d = DigitAt(++dp, ep);
+      if (d >= 0) {
+        value = value * 10 + d;
+        ++dp;
+      }
+      if (min <= value && value <= max) {
+        *vp = value;
+      } else {
+        dp = nullptr;
+      }
+    } else {
+      dp = nullptr;
+    }
+  }
+  return dp;
+}
+
+const char* ParseOffset(const char* dp, const char* ep, char sep,
+                        int* offset) {
+  if (dp != nullptr) {
+    const char first = (dp != ep) ? *dp++ : '\0';
+    if (first == '+' || first == '-') {
+      int hours = 0;
+      int minutes = 0;
+      int seconds = 0;
+      const char* ap = Parse2(dp, ep, 0, 23, &hours);
+      if (ap != nullptr && ap - dp == 2) {
+        dp = ap;
+        if (sep != '\0' && ap != ep && *ap == sep) ++ap;
+        const char* bp = Parse2(ap, ep, 0, 59, &minutes);
+        if (bp != nullptr && bp - ap == 2) {
+          dp = bp;
+          if (sep != '\0' && bp != ep && *bp == sep) ++bp;
+          const char* cp = Parse2(bp, ep, 0, 59, &seconds);
+          if (cp != nullptr && cp - bp == 2) dp = cp;
+        }
+        *offset = ((hours * 60 + minutes) * 60) + seconds;
+        if (first == '-') *offset = -*offset;
+      } else {
+        dp = nullptr;
+      }
+    } else if (first == 'Z' || first == 'z') {  // Zulu
+      *offset = 0;
+    } else {
+      dp = nullptr;
+    }
+  }
+  return dp;
+}
+
+const char* ParseSubSeconds(const char* dp, const char* ep,
+                            detail::femtoseconds* subseconds) {
+  if (dp != nullptr) {
+    std::int_fast64_t v = 0;
+    std::int_fast64_t exp = 0;
+    const char* const bp = dp;
+    for (int d; (d = DigitAt(dp, ep)) >= 0; ++dp) {
+      if (exp < 15) {
+        exp += 1;
+        v *= 10;
+        v += d;
+      }
+    }
+    if (dp != bp) {
+      v *= kExp10[15 - exp];
+      *subseconds = detail::femtoseconds(v);
+    } else {
+      dp = nullptr;
+    }
+  }
+  return dp;
+}
+
+// The parse_plan::layout_ bits for formats like "%Y-%m-%d%ET%H:%M:%E*S%Ez",
+// which ParseRFC3339() handles.  The low byte is the date-time separator.
+enum ParseLayoutBits {
+  kLayoutSepMask = 0xff,
+  kLayoutSepFold = 1 << 8,     // the separator is 'T' or 't' (%ET)
+  kLayoutSubseconds = 1 << 9,  // %E*S, rather than %S
+  kLayoutOffset = 1 << 10,     // a trailing %z
+  kLayoutOffsetSep = 1 << 11,  // a trailing %Ez, %E*z, %:z, ...
+};
+
+// Loads eight bytes as a little-endian integer, which compilers reduce
+// to a single load on most targets.
+inline std::uint_fast64_t Load8(const char* p) {
+  const unsigned char* const u = reinterpret_cast<const unsigned char*>(p);
+  return (std::uint_fast64_t{u[0]} << 0) | (std::uint_fast64_t{u[1]} << 8) |
+         (std::uint_fast64_t{u[2]} << 16) | (std::uint_fast64_t{u[3]} << 24) |
+         (std::uint_fast64_t{u[4]} << 32) | (std::uint_fast64_t{u[5]} << 40) |
+         (std::uint_fast64_t{u[6]} << 48) | (std::uint_fast64_t{u[7]} << 56);
+}
+
+// Matches eight bytes against a template in one step (SWAR).  XORing with
+// the template leaves digit positions (where the template holds '0') with
+// their values, and other positions with zero when they match.  Adding 0x76
+// to the digit bytes, and 0x7f to the others, then sets the top bit of any
+// byte that is out of range.  On success, *v holds the XORed bytes.
+inline bool Match8(std::uint_fast64_t x, std::uint_fast64_t tmpl,
+                   std::uint_fast64_t add, std::uint_fast64_t* v) {
+  const std::uint_fast64_t t = x ^ tmpl;
+  *v = t;
+  return (((t + add) | t) & 0x8080808080808080) == 0;
+}
+
+inline int Byte(std::uint_fast64_t v, int i) {
+  return static_cast<int>((v >> (i * 8)) & 0xff);
+}
+
+// Parses input that has exactly the canonical RFC3339 field widths, like
+// "2013-06-28T19:08:09.123456-07:00", for a parse_plan layout.  Returns
+// false if the input differs in any way, including being out of range, so
+// that the general parser can produce the result (or error) instead.
+bool ParseRFC3339(int layout, const char* bp, const char* ep,
+                  const time_zone& tz, time_point<seconds>* sec,
+                  detail::femtoseconds* fs) {
+  if (ep - bp < 19) return false;
+
+  // "YYYY-MM-" and "DD?HH:MM", where '?' is the separator.
+  std::uint_fast64_t date;
+  if (!Match8(Load8(bp), 0x2d30302d30303030, 0x7f76767f76767676, &date)) {
+    return false;
+  }
+  const std::uint_fast64_t sep = layout & kLayoutSepMask;
+  std::uint_fast64_t x = Load8(bp + 8);
+  if (layout & kLayoutSepFold) x |= std::uint_fast64_t{0x20} << 16;
+  std::uint_fast64_t time;
+  if (!Match8(x, 0x30303a3030003030 | (sep << 16), 0x76767f76767f7676,
+              &time)) {
+    return false;
+  }
+  if (bp[16] != ':') return false;
+  const int s0 = DigitAt(bp + 17, ep);
+  const int s1 = DigitAt(bp + 18, ep);
+  if (s0 < 0 || s1 < 0) return false;
+
+  const year_t year = Byte(date, 0) * 1000 + Byte(date, 1) * 100 +
+                      Byte(date, 2) * 10 + Byte(date, 3);
+  const int month = Byte(date, 5) * 10 + Byte(date, 6);
+  const int day = Byte(time, 0) * 10 + Byte(time, 1);
+  const int hour = Byte(time, 3) * 10 + Byte(time, 4);
+  const int minute = Byte(time, 6) * 10 + Byte(time, 7);
+  int second = s0 * 10 + s1;
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 ||
+      minute > 59 || second > 60) {
+    return false;
+  }
+
+  const char* dp = bp + 19;
+  auto subseconds = detail::femtoseconds::zero();
+  if ((layout & kLayoutSubseconds) && dp != ep && *dp == '.') {
+    dp = ParseSubSeconds(dp + 1, ep, &subseconds);
+    if (dp == nullptr) return false;
+  }
+
+  if ((layout & (kLayoutOffset | kLayoutOffsetSep)) == 0) {
+    if (dp != ep) return false;
+    return ToTimePoint(tz, year, month, day, hour, minute, second, 0,
+                       subseconds, sec, fs, nullptr);
+  }
+
+  // A fixed UTC offset, which we apply directly rather than via UTC.
+  int offset = 0;
+  if (dp != ep && (*dp == 'Z' || *dp == 'z')) {
+    ++dp;
+  } else {
+    const bool colon = (layout & kLayoutOffsetSep) != 0;
+    if (ep - dp != (colon ? 6 : 5)) return false;
+    if (dp[0] != '+' && dp[0] != '-') return false;
+    if (colon && dp[3] != ':') return false;
+    const int h0 = DigitAt(dp + 1, ep);
+    const int h1 = DigitAt(dp + 2, ep);
+    const int m0 = DigitAt(dp + (colon ? 4 : 3), ep);
+    const int m1 = DigitAt(dp + (colon ? 5 : 4), ep);
+    if (h0 < 0 || h1 < 0 || m0 < 0 || m1 < 0) return false;
+    const int hours = h0 * 10 + h1;
+    const int minutes = m0 * 10 + m1;
+    if (hours > 23 || minutes > 59) return false;
+    offset = (hours * 60 + minutes) * 60;
+    if (dp[0] == '-') offset = -offset;
+    dp = ep;
+  }
+  if (dp != ep) return false;
+
+  // Allows a leap second of 60 to normalize forward to the following ":00".
+  if (second == 60) {
+    second -= 1;
+    offset -= 1;
+    subseconds = detail::femtoseconds::zero();
+  }
+  const civil_second cs(year, month, day, hour, minute, second);
+  if (cs.day() != day) return false;  // like "Feb 30"
+  *sec = FromUnixSeconds((cs - civil_second()) - offset);
+  *fs = subseconds;
+  return true;
+}
+
+}  // namespace
+
+// Uses strptime(3) to parse the given input.  Supports the same extended
+// format specifiers as format(), although %E#S and %E*S are treated
+// identically (and similarly for %E#f and %E*f).  %Ez and %E*z also accept
+// the same inputs. %ET accepts either 'T' or 't'.
+//
+// The standard specifiers from RFC3339_* (%Y, %m, %d, %H, %M, and %S) are
+// handled internally so that we can normally avoid strptime() altogether
+// (which is particularly helpful when the native implementation is broken).
+//
+// The TZ/GNU %s extension is handled internally because strptime() has to
+// use localtime_r() to generate it, and that assumes the local time zone.
+//
+// We also handle the %z specifier to accommodate platforms that do not
+// support the tm_gmtoff extension to std::tm.  %Z is parsed but ignored.
+bool parse(const std::string& format, const std::string& input,
+           const time_zone& tz, time_point<seconds>* sec,
+           detail::femtoseconds* fs, std::string* err) {
+  // The unparsed input.
+  const char* data = input.c_str();  // NUL terminated
+
+  // Skips leading whitespace.
+  while (std::isspace(*data)) ++data;
+
+  const year_t kyearmax = std::numeric_limits<year_t>::max();
+  const year_t kyearmin = std::numeric_limits<year_t>::min();
+
+  // Sets default values for unspecified fields.
+  bool saw_year = false;
+  year_t year = 1970;
+  std::tm tm{};
+  tm.tm_year = 1970 - 1900;
+  tm.tm_mon = 1 - 1;  // Jan
+  tm.tm_mday = 1;
+  tm.tm_hour = 0;
+  tm.tm_min = 0;
+  tm.tm_sec = 0;
+  tm.tm_wday = 4;  // Thu
+  tm.tm_yday = 0;
+  tm.tm_isdst = 0;
+  auto subseconds = detail::femtoseconds::zero();
+  bool saw_offset = false;
+  int offset = 0;  // No offset from passed tz.
+  std::string zone = "UTC";
+
+  const char* fmt = format.c_str();  // NUL terminated
+  bool twelve_hour = false;
+  bool afternoon = false;
+  int week_num = -1;
+  weekday week_start = weekday::sunday;
+
+  bool saw_percent_s = false;
+  std::int_fast64_t percent_s = 0;
+
+  // Steps through format, one specifier at a time.
+  while (data != nullptr && *fmt != '\0') {
+    if (std::isspace(*fmt)) {
+      while (std::isspace(*data)) ++data;
+      while (std::isspace(*++fmt)) continue;
+      continue;
+    }
+
+    if (*fmt != '%') {
+      if (*data == *fmt) {
+        ++data;
+        ++fmt;
+      } else {
+        data = nullptr;
+      }
+      continue;
+    }
+
+    const char* percent = fmt;
+    if (*++fmt == '\0') {
+      data = nullptr;
+      continue;
+    }
+    switch (*fmt++) {
+      case 'Y':
+        // Symmetrically with FormatTime(), directly handing %Y avoids the
+        // tm.tm_year overflow problem.  However, tm.tm_year will still be
+        // used by other specifiers like %D.
+        data = ParseInt(data, 0, kyearmin, kyearmax, &year);
+        if (data != nullptr) saw_year = true;
         continue;
       case 'm':
         data = ParseInt(data, 2, 1, 12, &tm.tm_mon);
@@ -947,18 +1590,6 @@ bool parse(const std::string& format, const std::string& input,
     return true;
   }
 
-  // If we saw %z, %Ez, or %E*z then we want to interpret the parsed fields
-  // in UTC and then shift by that offset.  Otherwise we want to interpret
-  // the fields directly in the passed time_zone.
-  time_zone ptz = saw_offset ? utc_time_zone() : tz;
-
-  // Allows a leap second of 60 to normalize forward to the following ":00".
-  if (tm.tm_sec == 60) {
-    tm.tm_sec -= 1;
-    offset -= 1;
-    subseconds = detail::femtoseconds::zero();
-  }
-
   if (!saw_year) {
     year = year_t{tm.tm_year};
     if (year > kyearmax - 1900) {
@@ -977,46 +1608,535 @@ bool parse(const std::string& format, const std::string& input,
     }
   }
 
-  const int month = tm.tm_mon + 1;
-  civil_second cs(year, month, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+  // If we saw %z, %Ez, or %E*z then we want to interpret the parsed fields
+  // in UTC and then shift by that offset.  Otherwise we want to interpret
+  // the fields directly in the passed time_zone.
+  return ToTimePoint(saw_offset ? utc_time_zone() : tz, year, tm.tm_mon + 1,
+                     tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, offset,
+                     subseconds, sec, fs, err);
+}
 
-  // parse() should not allow normalization. Due to the restricted field
-  // ranges above (see ParseInt()), the only possibility is for days to roll
-  // into months. That is, parsing "Sep 31" should not produce "Oct 1".
-  if (cs.month() != month || cs.day() != tm.tm_mday) {
-    if (err != nullptr) *err = "Out-of-range field";
+// Follows the same steps as parse() above, but with the specifiers already
+// separated into Ops, and without any std::tm.
+bool parse(const parse_plan& plan, const char* input, std::size_t len,
+           const time_zone& tz, time_point<seconds>* sec,
+           detail::femtoseconds* fs, std::string* err) {
+  if (plan.fallback_) {
+    return parse(plan.text_, std::string(input, len), tz, sec, fs, err);
+  }
+  if (plan.layout_ != 0 &&
+      ParseRFC3339(plan.layout_, input, input + len, tz, sec, fs)) {
+    return true;
+  }
+
+  // The unparsed input.
+  const char* data = input;
+  const char* const end = input + len;
+
+  // Skips leading whitespace.
+  while (data != end && IsSpace(*data)) ++data;
+
+  // Sets default values for unspecified fields.
+  year_t year = 1970;
+  int month = 1;
+  int day = 1;
+  int hour = 0;
+  int minute = 0;
+  int second = 0;
+  auto subseconds = detail::femtoseconds::zero();
+  bool saw_offset = false;
+  int offset = 0;  // No offset from passed tz.
+
+  bool saw_percent_s = false;
+  std::int_fast64_t percent_s = 0;
+
+  for (const parse_plan::Op& op : plan.ops_) {
+    if (data == nullptr) break;
+    switch (op.kind) {
+      case kParseLiteral:
+        if (static_cast<std::size_t>(end - data) >= op.len &&
+            std::memcmp(data, plan.text_.data() + op.pos, op.len) == 0) {
+          data += op.len;
+        } else {
+          data = nullptr;
+        }
+        break;
+      case kParseSpace:
+        while (data != end && IsSpace(*data)) ++data;
+        break;
+      case kParseYear:
+        data = ParseInt(data, end, 0, std::numeric_limits<year_t>::min(),
+                        std::numeric_limits<year_t>::max(), &year);
+        break;
+      case kParseYear4: {
+        const char* bp = data;
+        data = ParseInt(data, end, 4, year_t{-999}, year_t{9999}, &year);
+        if (data != nullptr && data - bp != 4) {
+          data = nullptr;  // stopped too soon
+        }
+        break;
+      }
+      case kParseMonth:
+        data = Parse2(data, end, 1, 12, &month);
+        break;
+      case kParseDay:
+        data = Parse2(data, end, 1, 31, &day);
+        break;
+      case kParseHour:
+        data = Parse2(data, end, 0, 23, &hour);
+        break;
+      case kParseMinute:
+        data = Parse2(data, end, 0, 59, &minute);
+        break;
+      case kParseSecond:
+        data = Parse2(data, end, 0, 60, &second);
+        break;
+      case kParseSecondSub:
+        data = Parse2(data, end, 0, 60, &second);
+        if (data != nullptr && data != end && *data == '.') {
+          data = ParseSubSeconds(data + 1, end, &subseconds);
+        }
+        break;
+      case kParseSubsecond:
+        if (DigitAt(data, end) >= 0) {
+          data = ParseSubSeconds(data, end, &subseconds);
+        }
+        break;
+      case kParseOffset:
+      case kParseOffsetSep:
+        data = ParseOffset(data, end, op.kind == kParseOffset ? '\0' : ':',
+                           &offset);
+        if (data != nullptr) saw_offset = true;
+        break;
+      case kParseDateTime:
+        if (data != end && (*data == 'T' || *data == 't')) {
+          ++data;
+        } else {
+          data = nullptr;
+        }
+        break;
+      case kParseZone: {  // ignored; zone abbreviations are ambiguous
+        const char* bp = data;
+        while (data != end && !IsSpace(*data)) ++data;
+        if (data == bp) data = nullptr;
+        break;
+      }
+      case kParseSeconds:
+        data = ParseInt(data, end, 0,
+                        std::numeric_limits<std::int_fast64_t>::min(),
+                        std::numeric_limits<std::int_fast64_t>::max(),
+                        &percent_s);
+        if (data != nullptr) saw_percent_s = true;
+        break;
+    }
+  }
+
+  if (data == nullptr) {
+    if (err != nullptr) *err = "Failed to parse input";
     return false;
   }
 
-  // Accounts for the offset adjustment before converting to absolute time.
-  if ((offset < 0 && cs > civil_second::max() + offset) ||
-      (offset > 0 && cs < civil_second::min() + offset)) {
-    if (err != nullptr) *err = "Out-of-range field";
+  // Skip any remaining whitespace.
+  while (data != end && IsSpace(*data)) ++data;
+
+  // parse() must consume the entire input string.
+  if (data != end) {
+    if (err != nullptr) *err = "Illegal trailing data in input string";
     return false;
   }
-  cs -= offset;
 
-  const auto tp = ptz.lookup(cs).pre;
-  // Checks for overflow/underflow and returns an error as necessary.
-  if (tp == time_point<seconds>::max()) {
-    const auto al = ptz.lookup(time_point<seconds>::max());
-    if (cs > al.cs) {
-      if (err != nullptr) *err = "Out-of-range field";
-      return false;
+  // If we saw %s then we ignore anything else and return that time.
+  if (saw_percent_s) {
+    *sec = FromUnixSeconds(percent_s);
+    *fs = detail::femtoseconds::zero();
+    return true;
+  }
+
+  return ToTimePoint(saw_offset ? utc_time_zone() : tz, year, month, day,
+                     hour, minute, second, offset, subseconds, sec, fs, err);
+}
+
+bool parse_rfc3339(const char* input, std::size_t len,
+                   time_point<seconds>* sec, detail::femtoseconds* fs) {
+  static const parse_plan plan("%Y-%m-%d%ET%H:%M:%E*S%Ez");
+  return parse(plan, input, len, utc_time_zone(), sec, fs);
+}
+
+}  // namespace detail
+
+// Compiles the format into a sequence of Ops. The format is walked just
+// as detail::format() walks it, so the text that detail::format() would
+// pass to strftime() in one piece (which includes any unknown or
+// incomplete specifier, and whatever follows it up to the next specifier
+// that detail::format() handles itself) is still rendered as one piece.
+format_plan::format_plan(const std::string& fmt) : needs_tm_(false) {
+  auto add = [this](int kind, int arg) {
+    ops_.push_back(Op{kind, arg, 0, 0});
+  };
+  auto literal = [this](const char* bp, std::size_t n) {
+    if (!ops_.empty() && ops_.back().kind == detail::kLiteral &&
+        ops_.back().pos + ops_.back().len == text_.size()) {
+      ops_.back().len += n;  // extend the previous literal
+    } else {
+      ops_.push_back(Op{detail::kLiteral, 0, text_.size(), n});
+    }
+    text_.append(bp, n);
+  };
+
+  // Compiles text [bp, ep) that detail::format() passes to strftime().
+  // Leading literals and specifiers that we render directly get their own
+  // Ops, and the rest, from the first specifier that we do not, is still
+  // passed to strftime().
+  auto strftime_text = [this, &add, &literal](const char* bp,
+                                              const char* ep) {
+    while (bp != ep) {
+      if (*bp != '%') {
+        const char* const start = bp;
+        while (bp != ep && *bp != '%') ++bp;
+        literal(start, static_cast<std::size_t>(bp - start));
+        continue;
+      }
+      switch (ep - bp < 2 ? '\0' : bp[1]) {
+        case '%':
+          literal(bp, 1);
+          break;
+        case 'j':
+          add(detail::kYearDay, 0);
+          break;
+        case 'I':
+          add(detail::kHour12, 0);
+          break;
+        case 'a':
+          add(detail::kWeekdayShort, 0);
+          break;
+        case 'A':
+          add(detail::kWeekdayLong, 0);
+          break;
+        case 'b':
+        case 'h':
+          add(detail::kMonthShort, 0);
+          break;
+        case 'B':
+          add(detail::kMonthLong, 0);
+          break;
+        case 'p':
+          add(detail::kAmPm, 0);
+          break;
+        case 'F':  // %Y-%m-%d
+          add(detail::kYear, 0);
+          literal("-", 1);
+          add(detail::kMonth, 0);
+          literal("-", 1);
+          add(detail::kDay, 0);
+          break;
+        case 'T':  // %H:%M:%S
+          add(detail::kHour, 0);
+          literal(":", 1);
+          add(detail::kMinute, 0);
+          literal(":", 1);
+          add(detail::kSecond, 0);
+          break;
+        case 'R':  // %H:%M
+          add(detail::kHour, 0);
+          literal(":", 1);
+          add(detail::kMinute, 0);
+          break;
+        case 'n':
+          literal("\n", 1);
+          break;
+        case 't':
+          literal("\t", 1);
+          break;
+        default: {
+          const std::size_t n = static_cast<std::size_t>(ep - bp);
+          ops_.push_back(Op{detail::kStrftime, 0, text_.size(), n});
+          text_.append(bp, n);
+          text_.push_back('\0');
+          needs_tm_ = true;
+          return;
+        }
+      }
+      bp += 2;
+    }
+  };
+
+  // The same three subsequences as in detail::format(): [fmt ... pending)
+  // has been compiled, [pending ... cur) awaits strftime_text(), and
+  // [cur ... end) is unexamined.
+  const char* pending = fmt.c_str();  // NUL terminated
+  const char* cur = pending;
+  const char* const end = pending + fmt.size();
+  while (cur != end) {
+    const char* start = cur;
+    while (cur != end && *cur != '%') ++cur;
+    if (cur != start && pending == start) {
+      literal(pending, static_cast<std::size_t>(cur - pending));
+      pending = start = cur;
+    }
+
+    const char* const percent = cur;
+    while (cur != end && *cur == '%') ++cur;
+    if (cur != start && pending == start) {
+      const std::size_t escaped = static_cast<std::size_t>(cur - pending) / 2;
+      if (escaped != 0) literal(pending, escaped);
+      pending += escaped * 2;
+      if (pending != cur && cur == end) {
+        literal(pending++, 1);  // a single trailing percent
+      }
+    }
+    if (cur == end || (cur - percent) % 2 == 0) continue;
+
+    if (std::strchr("YmdeUuWwHMSzZs%", *cur)) {
+      strftime_text(pending, cur - 1);
+      switch (*cur) {
+        case 'Y':
+          add(detail::kYear, 0);
+          break;
+        case 'm':
+          add(detail::kMonth, 0);
+          break;
+        case 'd':
+          add(detail::kDay, 0);
+          break;
+        case 'e':
+          add(detail::kDaySpace, 0);
+          break;
+        case 'U':
+          add(detail::kWeekSun, 0);
+          break;
+        case 'u':
+          add(detail::kWeekdayMon1, 0);
+          break;
+        case 'W':
+          add(detail::kWeekMon, 0);
+          break;
+        case 'w':
+          add(detail::kWeekdaySun0, 0);
+          break;
+        case 'H':
+          add(detail::kHour, 0);
+          break;
+        case 'M':
+          add(detail::kMinute, 0);
+          break;
+        case 'S':
+          add(detail::kSecond, 0);
+          break;
+        case 'z':
+          add(detail::kOffset, 0);
+          break;
+        case 'Z':
+          add(detail::kAbbr, 0);
+          break;
+        case 's':
+          add(detail::kUnixSeconds, 0);
+          break;
+        case '%':
+          literal("%", 1);
+          break;
+      }
+      pending = ++cur;
+      continue;
+    }
+
+    if (*cur == ':') {
+      // Compiles %:z, %::z, or %:::z.
+      int colons = 1;
+      while (colons != 3 && cur + colons != end && cur[colons] == ':') {
+        ++colons;
+      }
+      if (cur + colons != end && cur[colons] == 'z') {
+        strftime_text(pending, cur - 1);
+        add(detail::kOffset, colons);
+        pending = cur += colons + 1;
+        continue;
+      }
+    }
+
+    if (*cur != 'E' || ++cur == end) continue;
+
+    if (*cur == 'T') {
+      strftime_text(pending, cur - 2);
+      literal("T", 1);
+      pending = ++cur;
+    } else if (*cur == 'z') {
+      strftime_text(pending, cur - 2);
+      add(detail::kOffset, 1);
+      pending = ++cur;
+    } else if (*cur == '*' && cur + 1 != end && cur[1] == 'z') {
+      strftime_text(pending, cur - 2);
+      add(detail::kOffset, 2);
+      pending = cur += 2;
+    } else if (*cur == '*' && cur + 1 != end &&
+               (cur[1] == 'S' || cur[1] == 'f')) {
+      strftime_text(pending, cur - 2);
+      add(cur[1] == 'S' ? detail::kSecondStar : detail::kSubsecondStar, 0);
+      pending = cur += 2;
+    } else if (*cur == '4' && cur + 1 != end && cur[1] == 'Y') {
+      strftime_text(pending, cur - 2);
+      add(detail::kYear4, 0);
+      pending = cur += 2;
+    } else if (std::isdigit(*cur)) {
+      int n = 0;
+      if (const char* np = detail::ParseInt(cur, 0, 0, 1024, &n)) {
+        if (*np == 'S' || *np == 'f') {
+          strftime_text(pending, cur - 2);
+          n = std::min(n, detail::kDigits10_64);
+          add(*np == 'S' ? detail::kSecond : detail::kSubsecond, n);
+          pending = cur = ++np;
+        }
+      }
     }
   }
-  if (tp == time_point<seconds>::min()) {
-    const auto al = ptz.lookup(time_point<seconds>::min());
-    if (cs < al.cs) {
-      if (err != nullptr) *err = "Out-of-range field";
-      return false;
+  strftime_text(pending, end);
+}
+
+// Compiles the format into a sequence of Ops, following the same rules as
+// detail::parse() for splitting it into specifiers. Any specifier that
+// would need strptime() makes the whole format fall back to parse().
+parse_plan::parse_plan(const std::string& fmt)
+    : fallback_(false), layout_(0) {
+  auto add = [this](int kind) { ops_.push_back(Op{kind, 0, 0}); };
+  auto literal = [this](const char* bp, std::size_t n) {
+    if (!ops_.empty() && ops_.back().kind == detail::kParseLiteral) {
+      ops_.back().len += n;  // extend the previous literal
+    } else {
+      ops_.push_back(Op{detail::kParseLiteral, text_.size(), n});
+    }
+    text_.append(bp, n);
+  };
+
+  const char* cur = fmt.c_str();  // NUL terminated
+  while (!fallback_ && *cur != '\0') {
+    if (detail::IsSpace(*cur)) {
+      add(detail::kParseSpace);
+      while (detail::IsSpace(*++cur)) continue;
+      continue;
+    }
+    if (*cur != '%') {
+      literal(cur++, 1);
+      continue;
+    }
+    if (*++cur == '\0') {
+      fallback_ = true;  // a trailing percent, which is an error
+      break;
+    }
+    switch (*cur++) {
+      case '%':
+        literal("%", 1);
+        break;
+      case 'Y':
+        add(detail::kParseYear);
+        break;
+      case 'm':
+        add(detail::kParseMonth);
+        break;
+      case 'd':
+      case 'e':
+        add(detail::kParseDay);
+        break;
+      case 'H':
+        add(detail::kParseHour);
+        break;
+      case 'M':
+        add(detail::kParseMinute);
+        break;
+      case 'S':
+        add(detail::kParseSecond);
+        break;
+      case 'z':
+        add(detail::kParseOffset);
+        break;
+      case 'Z':
+        add(detail::kParseZone);
+        break;
+      case 's':
+        add(detail::kParseSeconds);
+        break;
+      case ':':
+        if (cur[0] == 'z' ||
+            (cur[0] == ':' &&
+             (cur[1] == 'z' || (cur[1] == ':' && cur[2] == 'z')))) {
+          add(detail::kParseOffsetSep);
+          cur += (cur[0] == 'z') ? 1 : (cur[1] == 'z') ? 2 : 3;
+        } else {
+          fallback_ = true;
+        }
+        break;
+      case 'E':
+        if (cur[0] == 'T') {
+          add(detail::kParseDateTime);
+          cur += 1;
+        } else if (cur[0] == 'z' || (cur[0] == '*' && cur[1] == 'z')) {
+          add(detail::kParseOffsetSep);
+          cur += (cur[0] == 'z') ? 1 : 2;
+        } else if (cur[0] == '*' && cur[1] == 'S') {
+          add(detail::kParseSecondSub);
+          cur += 2;
+        } else if (cur[0] == '*' && cur[1] == 'f') {
+          add(detail::kParseSubsecond);
+          cur += 2;
+        } else if (cur[0] == '4' && cur[1] == 'Y') {
+          add(detail::kParseYear4);
+          cur += 2;
+        } else {
+          int n = 0;  // value ignored
+          const char* np = std::isdigit(*cur)
+                               ? detail::ParseInt(cur, 0, 0, 1024, &n)
+                               : nullptr;
+          if (np != nullptr && (*np == 'S' || *np == 'f')) {
+            add(*np == 'S' ? detail::kParseSecondSub : detail::kParseSubsecond);
+            cur = np + 1;
+          } else {
+            fallback_ = true;
+          }
+        }
+        break;
+      default:
+        fallback_ = true;
+        break;
     }
   }
 
-  *sec = tp;
-  *fs = subseconds;
-  return true;
+  if (fallback_) {
+    ops_.clear();
+    text_ = fmt;
+    return;
+  }
+
+  // Recognizes "%Y-%m-%d?%H:%M:%S" layouts, where '?' is %ET, a space, or
+  // any other single character, optionally with subseconds (%E*S) and a
+  // trailing UTC offset.
+  auto is = [this](std::size_t i, int kind) {
+    return i < ops_.size() && ops_[i].kind == kind;
+  };
+  auto is_char = [this, &is](std::size_t i, char c) {
+    return is(i, detail::kParseLiteral) && ops_[i].len == 1 &&
+           text_[ops_[i].pos] == c;
+  };
+  if (is(0, detail::kParseYear) && is_char(1, '-') &&
+      is(2, detail::kParseMonth) && is_char(3, '-') &&
+      is(4, detail::kParseDay) && is(6, detail::kParseHour) &&
+      is_char(7, ':') && is(8, detail::kParseMinute) && is_char(9, ':') &&
+      (is(10, detail::kParseSecond) || is(10, detail::kParseSecondSub))) {
+    int layout = 0;
+    if (is(5, detail::kParseDateTime)) {
+      layout = 't' | detail::kLayoutSepFold;
+    } else if (is(5, detail::kParseSpace)) {
+      layout = ' ';
+    } else if (is(5, detail::kParseLiteral) && ops_[5].len == 1) {
+      layout = static_cast<unsigned char>(text_[ops_[5].pos]);
+    }
+    if (is(10, detail::kParseSecondSub)) layout |= detail::kLayoutSubseconds;
+    if (ops_.size() == 12 && is(11, detail::kParseOffset)) {
+      layout |= detail::kLayoutOffset;
+    } else if (ops_.size() == 12 && is(11, detail::kParseOffsetSep)) {
+      layout |= detail::kLayoutOffsetSep;
+    } else if (ops_.size() != 11) {
+      layout = 0;
+    }
+    if ((layout & detail::kLayoutSepMask) != 0) layout_ = layout;
+  }
 }
 
-}  // namespace detail
 }  // namespace cctz
@@ -16,9 +16,12 @@
 
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
+#include <iterator>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "cctz/civil_time.h"
 #include "gmock/gmock.h"
@@ -674,6 +677,32 @@ TEST(Format, RFC1123Format) {  // locale specific
   EXPECT_EQ("28 Jun 1977 09:08:07 -0700", format(RFC1123_no_wday, tp, tz));
 }
 
+TEST(Format, Abbreviation) {
+  // %Z gives the abbreviation that a lookup does, however the zone finds
+  // it (in the current era, its own tables, its rule, or a fixed offset).
+  std::vector<time_zone> zones = {utc_time_zone(),
+                                  fixed_time_zone(chrono::seconds(-3662))};
+  for (const char* name : {"America/Los_Angeles", "Australia/Lord_Howe",
+                           "Asia/Kolkata", "libc:localtime"}) {
+    time_zone tz;
+    EXPECT_TRUE(load_time_zone(name, &tz)) << name;
+    zones.push_back(tz);
+  }
+  const auto now = chrono::time_point_cast<chrono::seconds>(
+      chrono::system_clock::now());
+  const format_plan plan("[%Z]");
+  for (const time_zone& tz : zones) {
+    for (const auto& tp : {now, now + chrono::hours(24 * 200),
+                           convert(civil_second(1850, 1, 1), tz),
+                           convert(civil_second(1977, 6, 28), tz),
+                           convert(civil_second(2500, 7, 1), tz)}) {
+      const std::string abbr = tz.lookup(tp).abbr;
+      EXPECT_EQ(abbr, format("%Z", tp, tz)) << tz.name();
+      EXPECT_EQ("[" + abbr + "]", plan.format(tp, tz)) << tz.name();
+    }
+  }
+}
+
 TEST(Format, Week) {
   const time_zone utc = utc_time_zone();
 
@@ -702,6 +731,124 @@ TEST(Format, Week) {
   EXPECT_EQ("2019-52-2", format("%Y-%W-%w", tp, utc));
 }
 
+TEST(Format, CalendarFields) {
+  // The weekday and week fields repeat every 400 years, so the years just
+  // inside the calendar table (1900 to 2200) must format as those just
+  // outside it do.
+  const time_zone utc = utc_time_zone();
+  const std::string fmt = "%a %A %j %U %W %u %w %b";
+  const format_plan plan(fmt);
+  for (const civil_year y : {civil_year(1899), civil_year(2199)}) {
+    for (civil_day d = civil_day(y); d != civil_day(y + 3); ++d) {
+      const civil_day outer(d.year() + (d.year() < 2000 ? -400 : 400),
+                            d.month(), d.day());
+      const auto tp = convert(civil_second(d), utc);
+      const auto outer_tp = convert(civil_second(outer), utc);
+      const std::string expected = format(fmt, outer_tp, utc);
+      EXPECT_EQ(expected, format(fmt, tp, utc)) << d;
+      EXPECT_EQ(expected, plan.format(tp, utc)) << d;
+      EXPECT_EQ(expected, plan.format(outer_tp, utc)) << d;
+    }
+  }
+}
+
+TEST(Format, FormatTo) {
+  const time_zone utc = utc_time_zone();
+  const auto tp = convert(civil_second(2013, 1, 2, 3, 4, 5), utc) +
+                  chrono::milliseconds(6);
+  const std::string expected = "2013-01-02T03:04:05.006+00:00";
+
+  char buf[64];
+  std::size_t len = format_to(buf, sizeof(buf), RFC3339_full, tp, utc);
+  EXPECT_EQ(expected, std::string(buf, len));
+  len = format_to(buf, sizeof(buf), std::string(RFC3339_full), tp, utc);
+  EXPECT_EQ(expected, std::string(buf, len));
+
+  // A short buffer is filled, but not overrun, and we learn the full size.
+  std::memset(buf, 'x', sizeof(buf));
+  len = format_to(buf, 10, RFC3339_full, tp, utc);
+  EXPECT_EQ(expected.size(), len);
+  EXPECT_EQ("2013-01-02xxx", std::string(buf, 13));
+  EXPECT_EQ(expected.size(), format_to(nullptr, 0, RFC3339_full, tp, utc));
+
+  // Text for strftime() is still handled, even when truncated.
+  len = format_to(buf, 6, "%a, %b %Y", tp, utc);
+  EXPECT_EQ(13, len);  // "Wed, Jan 2013"
+  EXPECT_EQ("Wed, J", std::string(buf, 6));
+
+  // Output iterators receive the complete result.
+  std::string out = "> ";
+  format_to(std::back_inserter(out), RFC3339_full, tp, utc);
+  EXPECT_EQ("> " + expected, out);
+  const std::string big(300, 'a');
+  out.clear();
+  format_to(std::back_inserter(out), big + "%a" + RFC3339_full, tp, utc);
+  EXPECT_EQ(big + "Wed" + expected, out);
+}
+
+TEST(FormatPlan, MatchesFormat) {
+  const char* const kFormats[] = {
+      RFC3339_full, RFC3339_sec, RFC1123_full, RFC1123_no_wday,
+      "%Y-%m-%d %H:%M:%S", "%F %T %R", "%e|%j|%I|%p|%a|%A|%b|%h|%B",
+      "%U %W %u %w %s", "%z %:z %::z %:::z %Ez %E*z %Z",
+      "%E0S %E3S %E*S %E15S %E18S %E0f %E4f %E*f %E20f %E4Y",
+      "%c %x %X %y %C %G %V %D %r",  // passed to strftime()
+      "%Ec %EC %Ex %OH %Oy %E", "%% %%Y %%%Y %n%t %", "", "no specifiers",
+      // Unknown or incomplete specifiers, and what follows them, are
+      // passed to strftime() just as format() passes them.
+      "%E%w", "%E%::z", "%E%%w", "%E%a%Y", "%-%P", "%-%a %b%Y", "%-%%Y",
+      "%a%-%", "%O%e", "%E%E*S", "%5%j", "%:%z", "%::y%z", "%ER%T",
+  };
+  time_zone lax;
+  EXPECT_TRUE(load_time_zone("America/Los_Angeles", &lax));
+  const time_zone utc = utc_time_zone();
+  const time_zone negative = fixed_time_zone(chrono::seconds(-(3600 + 62)));
+
+  for (const char* fmt : kFormats) {
+    const format_plan plan(fmt);
+    for (const time_zone& tz : {lax, utc, negative}) {
+      for (const civil_second cs : {civil_second(1977, 6, 28, 9, 8, 7),
+                                    civil_second(2013, 1, 2, 13, 0, 0),
+                                    civil_second(-7, 12, 31, 0, 0, 0),
+                                    civil_second(12345, 3, 1, 23, 59, 59)}) {
+        const auto tp = convert(cs, tz);
+        EXPECT_EQ(format(fmt, tp, tz), plan.format(tp, tz)) << fmt;
+        // The subseconds are passed separately, as years like -7 and 12345
+        // are beyond the range of a nanosecond time_point.
+        for (const auto fs : {detail::femtoseconds(654321000000),
+                              detail::femtoseconds(123456789012345)}) {
+          EXPECT_EQ(detail::format(fmt, tp, fs, tz),
+                    detail::format(plan, tp, fs, tz))
+              << fmt;
+        }
+      }
+    }
+  }
+}
+
+TEST(FormatPlan, Buffer) {
+  const time_zone utc = utc_time_zone();
+  const auto tp = convert(civil_second(2013, 1, 2, 3, 4, 5), utc);
+  const format_plan plan(RFC3339_sec);
+  const std::string expected = "2013-01-02T03:04:05+00:00";
+
+  char buf[64];
+  std::size_t len = plan.format(buf, sizeof(buf), tp, utc);
+  EXPECT_EQ(expected, std::string(buf, len));
+
+  // A short buffer is filled, but not overrun, and we learn the full size.
+  std::memset(buf, 'x', sizeof(buf));
+  len = plan.format(buf, 10, tp, utc);
+  EXPECT_EQ(expected.size(), len);
+  EXPECT_EQ("2013-01-02xxx", std::string(buf, 13));
+  EXPECT_EQ(expected.size(), plan.format(nullptr, 0, tp, utc));
+
+  // Results longer than the internal buffer are still complete.
+  const std::string big(300, 'a');
+  EXPECT_EQ(big + expected, format_plan(big + RFC3339_sec).format(tp, utc));
+  EXPECT_EQ(big + "Wed", format_plan(big + "%a").format(tp, utc));
+}
+
 //
 // Testing parse()
 //
@@ -1602,6 +1749,155 @@ TEST(Parse, TimePointOverflowFloor) {
 // Roundtrip test for format()/parse().
 //
 
+namespace {
+
+// Expects parse() and the plan to agree on the input. The results are
+// compared as seconds and femtoseconds, which can hold any year that
+// parses, unlike a system_clock::time_point.
+void ExpectPlanMatchesParse(const std::string& fmt, const parse_plan& plan,
+                            const std::string& input, const time_zone& tz) {
+  const time_point<chrono::seconds> sentinel(chrono::seconds(42));
+  const detail::femtoseconds fs_sentinel(7);
+  auto expected = sentinel;
+  auto actual = sentinel;
+  auto expected_fs = fs_sentinel;
+  auto actual_fs = fs_sentinel;
+  const bool ok = detail::parse(fmt, input, tz, &expected, &expected_fs);
+  EXPECT_EQ(ok, detail::parse(plan, input.data(), input.size(), tz, &actual,
+                              &actual_fs))
+      << fmt << " " << input;
+  EXPECT_EQ(expected, actual) << fmt << " " << input;
+  EXPECT_EQ(expected_fs.count(), actual_fs.count()) << fmt << " " << input;
+}
+
+}  // namespace
+
+TEST(ParsePlan, MatchesParse) {
+  time_zone lax;
+  EXPECT_TRUE(load_time_zone("America/Los_Angeles", &lax));
+  const char* const kFormats[] = {
+      RFC3339_full, RFC3339_sec, "%Y-%m-%d", "%Y-%m-%d %H:%M:%S %z",
+      "%Y-%m-%d%ET%H:%M:%E3S%Ez", "%E4Y-%m-%d %H:%M:%E*f", "%s", "%s %Z",
+      "%d/%m/%Y %H:%M:%S %:z", " %Y %::z", "%Y %:::z", "%H%M%S%E*z",
+      "%e %Y%%", "%Y-%m-%d %T",  // falls back to parse()
+      "%Y %b %d",                // falls back to parse()
+  };
+  const char* const kInputs[] = {
+      "2013-06-28T19:08:09.123456-07:00",
+      "2013-06-28T19:08:09-07:00",
+      "2013-06-28T19:08:60Z",
+      "2013-06-28t19:08:09.5+14:00",
+      "2013-02-29T01:02:03Z",
+      "2013-06-28",
+      "  2013-06-28  ",
+      "2013-06-28 19:08:09 -0700",
+      "2013-06-28 19:08:09 +07",
+      "2013-06-28 19:08:09 -07:30:15",
+      "2013-06-28 19:08:09 x",
+      "2013-06-28 19:08:09",
+      "2013-06-28 19:08:09 2013 Jun 28",
+      "-0999-01-02 03:04:05.6",
+      "0123-01-02 03:04:05.",
+      "1234567890",
+      "-1234567890 PST",
+      "9223372036854775808",
+      "28/06/2013 19:08:09 +07:00",
+      " 2013 -07:00",
+      "2013 -07:00:15",
+      "190809+0700",
+      "190809-07:00:01",
+      "28 2013%",
+      "2013 Jun 28",
+      "28 2013",
+      "",
+      "2013-06-2",
+      "2013-6-28",
+  };
+  for (const char* fmt : kFormats) {
+    const parse_plan plan(fmt);
+    for (const char* input : kInputs) {
+      for (const time_zone& tz : {lax, utc_time_zone()}) {
+        ExpectPlanMatchesParse(fmt, plan, input, tz);
+      }
+    }
+  }
+}
+
+TEST(ParsePlan, RFC3339Layouts) {
+  time_zone lax;
+  EXPECT_TRUE(load_time_zone("America/Los_Angeles", &lax));
+  const char* const kFormats[] = {
+      RFC3339_full, RFC3339_sec, "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S%z",
+      "%Y-%m-%d_%H:%M:%E*S%:z", "%Y-%m-%d%ET%H:%M:%E3S",
+  };
+  const char* const kInputs[] = {
+      "2013-06-28T19:08:09.123456-07:00",
+      "2016-02-29t23:59:60.5-00:01",
+      "2013-06-28 19:08:09",
+      "2013-06-28_19:08:09.25+0700",
+      "1999-12-31T23:59:59z",
+  };
+
+  // Compares parse() and a parse_plan on every truncation of each input,
+  // and on every single-character substitution with a troublesome value.
+  for (const char* fmt : kFormats) {
+    const parse_plan plan(fmt);
+    for (const char* base : kInputs) {
+      std::vector<std::string> inputs;
+      const std::string input = base;
+      for (std::size_t n = 0; n <= input.size(); ++n) {
+        inputs.push_back(input.substr(0, n));
+      }
+      for (std::size_t i = 0; i != input.size(); ++i) {
+        for (const char c : std::string("03569:-.+Tt _Zz\x80")) {
+          std::string mutated = input;
+          mutated[i] = c;
+          inputs.push_back(mutated);
+        }
+      }
+      for (const std::string& in : inputs) {
+        ExpectPlanMatchesParse(fmt, plan, in, lax);
+      }
+    }
+  }
+
+  // parse_rfc3339() is parse() with RFC3339_full.
+  const time_point<chrono::nanoseconds> tp0;
+  for (const char* in : kInputs) {
+    auto expected = tp0;
+    auto actual = tp0;
+    const bool ok = parse(RFC3339_full, in, lax, &expected);
+    EXPECT_EQ(ok, parse_rfc3339(in, &actual)) << in;
+    EXPECT_EQ(expected, actual) << in;
+  }
+  time_point<chrono::nanoseconds> tp;
+  EXPECT_TRUE(parse_rfc3339("2013-06-28T19:08:09.123456789-07:00", &tp));
+  EXPECT_EQ("2013-06-29T02:08:09.123456789+00:00",
+            format(RFC3339_full, tp, utc_time_zone()));
+}
+
+TEST(ParsePlan, UnterminatedInput) {
+  const time_zone utc = utc_time_zone();
+  const parse_plan plan(RFC3339_sec);
+  const char kLines[] = "2013-06-28T19:08:09Z\n2013-06-28T19:08:10Z\n";
+  time_point<chrono::seconds> tp;
+
+  // Each line is parsed in place, without seeing what follows.
+  EXPECT_TRUE(plan.parse(kLines, 20, utc, &tp));
+  EXPECT_EQ(convert(civil_second(2013, 6, 28, 19, 8, 9), utc), tp);
+  EXPECT_TRUE(plan.parse(kLines + 21, 20, utc, &tp));
+  EXPECT_EQ(convert(civil_second(2013, 6, 28, 19, 8, 10), utc), tp);
+
+  // Fields that are cut short by the length are errors.
+  EXPECT_FALSE(plan.parse(kLines, 19, utc, &tp));
+  EXPECT_FALSE(plan.parse(kLines, 10, utc, &tp));
+  EXPECT_FALSE(plan.parse(kLines, 0, utc, &tp));
+
+  // As with parse(), trailing whitespace is allowed, but nothing else.
+  EXPECT_TRUE(plan.parse(kLines, 21, utc, &tp));
+  EXPECT_FALSE(plan.parse(kLines, 22, utc, &tp));
+}
+
 TEST(FormatParse, RoundTrip) {
   time_zone lax;
   EXPECT_TRUE(load_time_zone("America/Los_Angeles", &lax));
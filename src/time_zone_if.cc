@@ -13,6 +13,9 @@
 //   limitations under the License.
 
 #include "time_zone_if.h"
+
+#include <cstring>
+
 #include "time_zone_info.h"
 #include "time_zone_libc.h"
 
@@ -31,7 +34,64 @@ std::unique_ptr<TimeZoneIf> TimeZoneIf::Load(const std::string& name) {
   return std::unique_ptr<TimeZoneIf>(tz.release());
 }
 
+std::string TimeZoneIf::SourceVersion() {
+  return TimeZoneInfo::SourceVersion();
+}
+
 // Defined out-of-line to avoid emitting a weak vtable in all TUs.
 TimeZoneIf::~TimeZoneIf() {}
 
+void TimeZoneIf::BreakTime(const time_point<seconds>* tps, std::size_t n,
+                           time_zone::absolute_lookup* als) const {
+  for (std::size_t i = 0; i != n; ++i) als[i] = BreakTime(tps[i]);
+}
+
+time_zone::absolute_lookup TimeZoneIf::BreakTime(const time_point<seconds>& tp,
+                                                 std::size_t*) const {
+  return BreakTime(tp);
+}
+
+time_zone::absolute_lookup TimeZoneIf::BreakTimeAbbr(
+    const time_point<seconds>& tp, std::size_t* abbr_len) const {
+  const time_zone::absolute_lookup al = BreakTime(tp);
+  *abbr_len = std::strlen(al.abbr);
+  return al;
+}
+
+void TimeZoneIf::MakeTime(const civil_second* css, std::size_t n,
+                          time_zone::civil_lookup* cls) const {
+  for (std::size_t i = 0; i != n; ++i) cls[i] = MakeTime(css[i]);
+}
+
+time_zone::civil_lookup TimeZoneIf::MakeTime(const civil_second& cs,
+                                             std::size_t*) const {
+  return MakeTime(cs);
+}
+
+bool TimeZoneIf::NextTransition(const time_point<seconds>& tp,
+                                time_zone::civil_transition* trans,
+                                time_point<seconds>* at, std::size_t*) const {
+  if (!NextTransition(tp, trans)) return false;
+  *at = MakeTime(trans->to).trans;
+  return true;
+}
+
+bool TimeZoneIf::PrevTransition(const time_point<seconds>& tp,
+                                time_zone::civil_transition* trans,
+                                time_point<seconds>* at, std::size_t*) const {
+  if (!PrevTransition(tp, trans)) return false;
+  *at = MakeTime(trans->to).trans;
+  return true;
+}
+
+void TimeZoneIf::Stats(time_zone_stats*) const {}
+
+bool TimeZoneIf::Era(const time_point<seconds>&, ZoneEra*) const {
+  return false;
+}
+
+std::size_t TimeZoneIf::TablesHash() const { return 0; }
+
+bool TimeZoneIf::SourceChanged() const { return true; }
+
 }  // namespace cctz
@@ -16,6 +16,7 @@
 #define CCTZ_TIME_ZONE_IF_H_
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -25,6 +26,17 @@
 
 namespace cctz {
 
+// A span of time between two transitions of a zone, [begin, end), and the
+// offset, etc., that apply throughout it (see TimeZoneIf::Era()).
+struct ZoneEra {
+  time_point<seconds> begin;
+  time_point<seconds> end;
+  int offset;  // seconds east of UTC
+  bool is_dst;
+  const char* abbr;  // lives as long as the zone
+  std::size_t abbr_len;
+};
+
 // A simple interface used to hide time-zone complexities from time_zone::Impl.
 // Subclasses implement the functions for civil-time conversions in the zone.
 class TimeZoneIf {
@@ -32,20 +44,77 @@ class TimeZoneIf {
   // A factory function for TimeZoneIf implementations.
   static std::unique_ptr<TimeZoneIf> Load(const std::string& name);
 
+  // Returns the tzdata version of the zoneinfo that Load() would now read,
+  // or an empty string when the source does not report one.
+  static std::string SourceVersion();
+
   virtual ~TimeZoneIf();
 
   virtual time_zone::absolute_lookup BreakTime(
       const time_point<seconds>& tp) const = 0;
+  // The default batch implementation simply loops over BreakTime(tp).
+  virtual void BreakTime(const time_point<seconds>* tps, std::size_t n,
+                         time_zone::absolute_lookup* als) const;
+  // As BreakTime(tp), but using (and updating) a caller-owned search hint,
+  // which must start as zero. The default implementation ignores it.
+  virtual time_zone::absolute_lookup BreakTime(const time_point<seconds>& tp,
+                                               std::size_t* hint) const;
+  // As BreakTime(tp), but also setting *abbr_len to the length of the
+  // abbreviation, which the zone may know without measuring it (as the
+  // default implementation does).
+  virtual time_zone::absolute_lookup BreakTimeAbbr(
+      const time_point<seconds>& tp, std::size_t* abbr_len) const;
   virtual time_zone::civil_lookup MakeTime(
       const civil_second& cs) const = 0;
+  // The default batch implementation simply loops over MakeTime(cs).
+  virtual void MakeTime(const civil_second* css, std::size_t n,
+                        time_zone::civil_lookup* cls) const;
+  // As MakeTime(cs), but using (and updating) a caller-owned search hint,
+  // which must start as zero. The default implementation ignores it.
+  virtual time_zone::civil_lookup MakeTime(const civil_second& cs,
+                                           std::size_t* hint) const;
 
   virtual bool NextTransition(const time_point<seconds>& tp,
                               time_zone::civil_transition* trans) const = 0;
   virtual bool PrevTransition(const time_point<seconds>& tp,
                               time_zone::civil_transition* trans) const = 0;
+  // As NextTransition()/PrevTransition(), but also setting *at to the
+  // instant of the transition, and using (and updating) a caller-owned
+  // search hint, which must start as zero. The default implementations
+  // ignore the hint, and find the instant with MakeTime().
+  virtual bool NextTransition(const time_point<seconds>& tp,
+                              time_zone::civil_transition* trans,
+                              time_point<seconds>* at,
+                              std::size_t* hint) const;
+  virtual bool PrevTransition(const time_point<seconds>& tp,
+                              time_zone::civil_transition* trans,
+                              time_point<seconds>* at,
+                              std::size_t* hint) const;
+
+  // The strings live as long as the zone.
+  virtual const std::string& Version() const = 0;
+  virtual const std::string& Description() const = 0;
+
+  // Adds the zone's statistics to *stats (except for its name), which are
+  // only maintained when built with CCTZ_ENABLE_STATS. The default
+  // implementation has none to add.
+  virtual void Stats(time_zone_stats* stats) const;
+
+  // Describes the era that contains tp in *era, and returns true, when
+  // BreakTime() gives every instant within it the era's offset, etc., and
+  // the civil time of (instant + offset) in UTC. The default implementation
+  // never does so.
+  virtual bool Era(const time_point<seconds>& tp, ZoneEra* era) const;
+
+  // Returns a hash of the zone's lookup tables, which is the same for two
+  // zones with identical tables however they are stored (e.g., compact or
+  // not), or zero when the zone has no such tables (the default).
+  virtual std::size_t TablesHash() const;
 
-  virtual std::string Version() const = 0;
-  virtual std::string Description() const = 0;
+  // Returns whether the data the zone was read from may have changed since,
+  // so that reading it afresh might give a different zone. The default
+  // implementation assumes that it may.
+  virtual bool SourceChanged() const;
 
  protected:
   TimeZoneIf() {}
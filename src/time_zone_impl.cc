@@ -14,12 +14,21 @@
 
 #include "time_zone_impl.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ctime>
 #include <deque>
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "time_zone_fixed.h"
 
@@ -27,12 +36,34 @@ namespace cctz {
 
 namespace {
 
-// time_zone::Impls are linked into a map to support fast lookup by name.
-using TimeZoneImplByName =
-    std::unordered_map<std::string, const time_zone::Impl*>;
-TimeZoneImplByName* time_zone_map = nullptr;
+// time_zone::Impls are linked into a hash table to support fast lookup by
+// name. The table is insert-only, with a fixed number of buckets, each an
+// atomically published chain of nodes that are never modified or freed
+// once published. So, readers need no lock, while writers serialize on
+// TimeZoneMutex().
+struct TimeZoneNode {
+  std::size_t hash;
+  std::string name;
+  const time_zone::Impl* impl;
+  const TimeZoneNode* next;
+};
 
-// Mutual exclusion for time_zone_map.
+const std::size_t kTimeZoneBuckets = 1024;  // ~600 zones, plus aliases
+std::atomic<const TimeZoneNode*> time_zone_buckets[kTimeZoneBuckets];
+
+std::atomic<const TimeZoneNode*>& TimeZoneBucket(std::size_t hash) {
+  return time_zone_buckets[hash % kTimeZoneBuckets];
+}
+
+const TimeZoneNode* FindTimeZone(const TimeZoneNode* node, std::size_t hash,
+                                 const std::string& name) {
+  for (; node != nullptr; node = node->next) {
+    if (node->hash == hash && node->name == name) return node;
+  }
+  return nullptr;
+}
+
+// Mutual exclusion for writers of time_zone_buckets.
 std::mutex& TimeZoneMutex() {
   // This mutex is intentionally "leaked" to avoid the static deinitialization
   // order fiasco (std::mutex's destructor is not trivial on many platforms).
@@ -40,69 +71,389 @@ std::mutex& TimeZoneMutex() {
   return *time_zone_mutex;
 }
 
+// The current time. It need only be as precise as the eras are long, so
+// we prefer a cheaper, coarse clock where there is one.
+time_point<seconds> CoarseNow() {
+#if defined(CLOCK_REALTIME_COARSE)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+    return FromUnixSeconds(ts.tv_sec);
+  }
+#endif
+  return std::chrono::time_point_cast<seconds>(
+      std::chrono::system_clock::now());
+}
+
 }  // namespace
 
 time_zone time_zone::Impl::UTC() {
   return time_zone(UTCImpl());
 }
 
-bool time_zone::Impl::LoadTimeZone(const std::string& name, time_zone* tz) {
+bool time_zone::Impl::FindLoaded(const std::string& name, time_zone* tz,
+                                 bool* loaded) {
   const Impl* const utc_impl = UTCImpl();
 
-  // Check for UTC (which is never a key in time_zone_map).
+  // Check for UTC (which is never a key in time_zone_buckets).
   auto offset = seconds::zero();
   if (FixedOffsetFromName(name, &offset) && offset == seconds::zero()) {
     *tz = time_zone(utc_impl);
+    *loaded = true;
     return true;
   }
 
-  // Check whether the time zone has already been loaded.
-  {
-    std::lock_guard<std::mutex> lock(TimeZoneMutex());
-    if (time_zone_map != nullptr) {
-      TimeZoneImplByName::const_iterator itr = time_zone_map->find(name);
-      if (itr != time_zone_map->end()) {
-        *tz = time_zone(itr->second);
-        return itr->second != utc_impl;
-      }
-    }
-  }
+  // Check whether the time zone has already been loaded (without a lock).
+  const std::size_t hash = std::hash<std::string>()(name);
+  const TimeZoneNode* node = FindTimeZone(
+      TimeZoneBucket(hash).load(std::memory_order_acquire), hash, name);
+  if (node == nullptr) return false;
+  *tz = time_zone(node->impl);
+  *loaded = (node->impl != utc_impl);
+  return true;
+}
+
+bool time_zone::Impl::LoadTimeZone(const std::string& name, time_zone* tz) {
+  bool loaded;
+  if (FindLoaded(name, tz, &loaded)) return loaded;
 
   // Load the new time zone (outside the lock).
+  const Impl* const utc_impl = UTCImpl();
   std::unique_ptr<const Impl> new_impl(new Impl(name));
 
-  // Add the new time zone to the map.
+  // Add the new time zone to the table, unless another thread won any
+  // load race while we were unlocked.
+  const std::size_t hash = std::hash<std::string>()(name);
+  std::atomic<const TimeZoneNode*>& bucket = TimeZoneBucket(hash);
   std::lock_guard<std::mutex> lock(TimeZoneMutex());
-  if (time_zone_map == nullptr) time_zone_map = new TimeZoneImplByName;
-  const Impl*& impl = (*time_zone_map)[name];
-  if (impl == nullptr) {  // this thread won any load race
-    impl = new_impl->zone_ ? new_impl.release() : utc_impl;
+  const TimeZoneNode* head = bucket.load(std::memory_order_relaxed);
+  const TimeZoneNode* node = FindTimeZone(head, hash, name);
+  if (node == nullptr) {
+    const Impl* impl =
+        new_impl->Zone() != nullptr ? new_impl.release() : utc_impl;
+    node = new TimeZoneNode{hash, name, impl, head};
+    bucket.store(node, std::memory_order_release);
   }
+  *tz = time_zone(node->impl);
+  return node->impl != utc_impl;
+}
+
+bool time_zone::Impl::ReloadTimeZone(const std::string& name, time_zone* tz) {
+  const Impl* const utc_impl = UTCImpl();
+  auto offset = seconds::zero();
+  if (FixedOffsetFromName(name, &offset) && offset == seconds::zero()) {
+    *tz = time_zone(utc_impl);
+    return true;
+  }
+
+  // A new node ahead of any existing one for the name hides it from
+  // FindTimeZone(), while readers already holding it are unaffected.
+  std::unique_ptr<const Impl> new_impl(new Impl(name));
+  const std::size_t hash = std::hash<std::string>()(name);
+  std::atomic<const TimeZoneNode*>& bucket = TimeZoneBucket(hash);
+  std::lock_guard<std::mutex> lock(TimeZoneMutex());
+  const Impl* impl =
+      new_impl->Zone() != nullptr ? new_impl.release() : utc_impl;
+  bucket.store(new TimeZoneNode{hash, name, impl,
+                                bucket.load(std::memory_order_relaxed)},
+               std::memory_order_release);
   *tz = time_zone(impl);
   return impl != utc_impl;
 }
 
+// The shared state of a time_zone_load, which the load completes.
+struct time_zone_load::state {
+  using callback = std::function<void(bool, const time_zone&)>;
+
+  // Calls done with the result, now or when the load finishes.
+  void Then(callback done) {
+    if (!done) return;
+    {
+      std::lock_guard<std::mutex> lock(mu);
+      if (!finished) {
+        callbacks.push_back(std::move(done));
+        return;
+      }
+    }
+    done(loaded, tz);
+  }
+
+  // Records the result, and then wakes the waiters and calls the callbacks.
+  void Finish(bool zone_loaded, const time_zone& zone) {
+    std::vector<callback> to_call;
+    {
+      std::lock_guard<std::mutex> lock(mu);
+      loaded = zone_loaded;
+      tz = zone;
+      finished = true;
+      to_call.swap(callbacks);
+    }
+    done_promise.set_value();
+    for (const callback& done : to_call) done(zone_loaded, zone);
+  }
+
+  std::mutex mu;  // guards the following, until the load is finished
+  bool finished = false;
+  bool loaded = false;
+  time_zone tz;
+  std::vector<callback> callbacks;
+
+  std::promise<void> done_promise;  // set once finished
+  std::shared_future<void> done_future = done_promise.get_future().share();
+};
+
+bool time_zone_load::ready() const {
+  return state_ == nullptr ||
+         state_->done_future.wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready;
+}
+
+bool time_zone_load::get(time_zone* tz) const {
+  if (state_ == nullptr) {
+    *tz = time_zone::Impl::UTC();
+    return false;
+  }
+  state_->done_future.wait();
+  *tz = state_->tz;
+  return state_->loaded;
+}
+
+namespace {
+
+// The loads begun by LoadTimeZoneAsync() that have yet to finish, by name,
+// so that later requests can share them.
+using PendingLoads =
+    std::unordered_map<std::string, std::shared_ptr<time_zone_load::state>>;
+
+std::mutex& PendingMutex() {
+  static std::mutex* pending_mutex = new std::mutex;  // intentionally leaked
+  return *pending_mutex;
+}
+
+PendingLoads& Pending() {
+  static PendingLoads* pending = new PendingLoads;  // intentionally leaked
+  return *pending;
+}
+
+}  // namespace
+
+time_zone_load time_zone::Impl::LoadTimeZoneAsync(
+    const std::string& name, std::function<void(bool, const time_zone&)> done,
+    time_zone_executor executor) {
+  std::shared_ptr<time_zone_load::state> st;
+  bool start = false;
+  time_zone tz;
+  bool loaded;
+  if (!FindLoaded(name, &tz, &loaded)) {
+    std::lock_guard<std::mutex> lock(PendingMutex());
+    PendingLoads& pending = Pending();
+    auto it = pending.find(name);
+    if (it != pending.end()) {
+      st = it->second;  // share the load in progress
+    } else if (!FindLoaded(name, &tz, &loaded)) {  // it may have just ended
+      st = std::make_shared<time_zone_load::state>();
+      pending.emplace(name, st);
+      start = true;
+    }
+  }
+  if (st == nullptr) {  // no load was needed
+    st = std::make_shared<time_zone_load::state>();
+    st->Finish(loaded, tz);
+  }
+  st->Then(std::move(done));
+
+  if (start) {
+    std::function<void()> task = [name, st]() {
+      time_zone zone;
+      const bool zone_loaded = LoadTimeZone(name, &zone);
+      {
+        std::lock_guard<std::mutex> lock(PendingMutex());
+        Pending().erase(name);
+      }
+      st->Finish(zone_loaded, zone);
+    };
+    if (executor) {
+      executor(std::move(task));
+    } else {
+      std::thread(std::move(task)).detach();
+    }
+  }
+  return time_zone_load(std::move(st));
+}
+
+std::size_t time_zone::Impl::PreloadTimeZones(
+    const std::vector<std::string>& names, int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  const std::size_t nthreads = std::max<std::size_t>(
+      1, std::min(names.size(), static_cast<std::size_t>(num_threads)));
+
+  // Each thread claims the next unclaimed name until none remain, so that
+  // a few slow loads do not hold up the rest.
+  std::atomic<std::size_t> next(0);
+  std::atomic<std::size_t> loaded(0);
+  auto worker = [&names, &next, &loaded]() {
+    time_zone tz;
+    for (std::size_t i; (i = next.fetch_add(1)) < names.size();) {
+      if (LoadTimeZone(names[i], &tz)) loaded.fetch_add(1);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < nthreads; ++i) threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads) thread.join();
+  return loaded.load();
+}
+
+std::size_t time_zone::Impl::UpdateTimeZones() {
+  // Updates are serialized, so that each sees the result of the last.
+  static std::mutex* update_mutex = new std::mutex;  // intentionally leaked
+  std::lock_guard<std::mutex> update_lock(*update_mutex);
+
+  // Collect the zones first, as reading them afresh may take a while, and
+  // the chains never lose a node. Those that a reload has since hidden are
+  // included, as there may still be time_zone objects that refer to them.
+  const Impl* const utc_impl = UTCImpl();
+  std::vector<const Impl*> impls;
+  for (const auto& bucket : time_zone_buckets) {
+    const TimeZoneNode* node = bucket.load(std::memory_order_acquire);
+    for (; node != nullptr; node = node->next) {
+      if (node->impl != utc_impl) impls.push_back(node->impl);
+    }
+  }
+  // The version of the data to update to is checked once, so that zones
+  // already at that version need not be read again.
+  const std::string version = TimeZoneIf::SourceVersion();
+  std::size_t updated = 0;
+  for (const Impl* impl : impls) {
+    if (impl->Update(version)) ++updated;
+  }
+  return updated;
+}
+
+void time_zone::Impl::AppendStats(std::vector<time_zone_stats>* zones) {
+  const Impl* const utc_impl = UTCImpl();
+  for (const auto& bucket : time_zone_buckets) {
+    const TimeZoneNode* head = bucket.load(std::memory_order_acquire);
+    for (const TimeZoneNode* node = head; node != nullptr; node = node->next) {
+      if (node->impl == utc_impl) continue;  // failed to load
+      if (FindTimeZone(head, node->hash, node->name) != node) continue;
+      time_zone_stats stats = time_zone_stats();
+      stats.name = node->name;
+      node->impl->Zone()->Stats(&stats);
+      zones->push_back(std::move(stats));
+    }
+  }
+}
+
 void time_zone::Impl::ClearTimeZoneMapTestOnly() {
   std::lock_guard<std::mutex> lock(TimeZoneMutex());
-  if (time_zone_map != nullptr) {
-    // Existing time_zone::Impl* entries are in the wild, so we can't delete
-    // them. Instead, we move them to a private container, where they are
-    // logically unreachable but not "leaked".  Future requests will result
-    // in reloading the data.
-    static auto* cleared = new std::deque<const time_zone::Impl*>;
-    for (const auto& element : *time_zone_map) {
-      cleared->push_back(element.second);
-    }
-    time_zone_map->clear();
+  // Existing time_zone::Impl* entries are in the wild, and lock-free
+  // readers may still be walking the chains, so we can't delete anything.
+  // Instead, we move the chains to a private container, where they are
+  // logically unreachable but not "leaked".  Future requests will result
+  // in reloading the data.
+  static auto* cleared = new std::deque<const TimeZoneNode*>;
+  for (auto& bucket : time_zone_buckets) {
+    const TimeZoneNode* head =
+        bucket.exchange(nullptr, std::memory_order_relaxed);
+    if (head != nullptr) cleared->push_back(head);
   }
 }
 
 time_zone::Impl::Impl(const std::string& name)
-    : name_(name), zone_(TimeZoneIf::Load(name_)) {}
+    : name_(name), zone_(nullptr) {
+  std::unique_ptr<const TimeZoneIf> zone = TimeZoneIf::Load(name_);
+  if (zone == nullptr) return;
+  zone_.store(zone.get(), std::memory_order_relaxed);
+  zones_.push_back(std::move(zone));
+  auto offset = seconds::zero();
+  if (FixedOffsetFromName(name_, &offset)) {
+    fixed_ = true;
+    fixed_offset_ = static_cast<int>(offset.count());
+    fixed_epoch_ = civil_second() + fixed_offset_;
+    fixed_civil_min_ = fixed_epoch_ + seconds::min().count();
+    fixed_civil_max_ = fixed_epoch_ + seconds::max().count();
+    fixed_abbr_ = FixedOffsetToAbbr(offset);
+  } else {
+    era_enabled_ = RefreshEra();
+  }
+}
+
+bool time_zone::Impl::RefreshEra(bool force) const {
+  for (;;) {
+    const TimeZoneIf* const zone = Zone();
+    const time_point<seconds> now = CoarseNow();
+    if (!force && now < era_.end()) return true;
+    ZoneEra era;
+    const bool found = zone->Era(now, &era);
+    if (!found) {
+      if (!force) return false;
+      era = ZoneEra();  // an empty era, so that lookups use the zone
+    }
+    if (!era_.store(era.begin, era.end, era.offset, era.is_dst, era.abbr,
+                    era.abbr_len)) {
+      if (!force) return found;  // the other writer will do
+      std::this_thread::yield();
+      continue;
+    }
+    // An era from zone data that was replaced meanwhile must be redone.
+    if (Zone() == zone) return found;
+    force = true;
+  }
+}
+
+bool time_zone::Impl::Update(const std::string& version) const {
+  const TimeZoneIf* const old_zone = Zone();
+  if (old_zone == nullptr || fixed_) return false;
+  if (version.empty() ? !old_zone->SourceChanged()
+                      : old_zone->Version() == version) {
+    return false;  // nothing new to read
+  }
+  std::unique_ptr<const TimeZoneIf> zone = TimeZoneIf::Load(name_);
+  if (zone == nullptr) return false;  // keep what we have
+  if (zone->Version() == old_zone->Version() &&
+      zone->Description() == old_zone->Description() &&
+      zone->TablesHash() == old_zone->TablesHash()) {
+    return false;  // unchanged
+  }
+  {
+    std::lock_guard<std::mutex> lock(TimeZoneMutex());
+    zone_.store(zone.get(), std::memory_order_release);
+    zones_.push_back(std::move(zone));
+  }
+  if (era_enabled_) RefreshEra(true);
+  return true;
+}
 
 const time_zone::Impl* time_zone::Impl::UTCImpl() {
   static const Impl* utc_impl = new Impl("UTC");  // never fails
   return utc_impl;
 }
 
+namespace detail {
+
+bool time_zone_era::store(const time_point<seconds>& begin,
+                          const time_point<seconds>& end, int offset,
+                          bool is_dst, const char* abbr,
+                          std::size_t abbr_len) {
+  std::uint_fast32_t seq = seq_.load(std::memory_order_relaxed);
+  if ((seq & 1) != 0 ||
+      !seq_.compare_exchange_strong(seq, seq + 1,
+                                    std::memory_order_relaxed)) {
+    return false;  // leave it to the other writer
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  begin_.store(begin.time_since_epoch().count(), std::memory_order_relaxed);
+  end_.store(end.time_since_epoch().count(), std::memory_order_relaxed);
+  offset_.store(offset, std::memory_order_relaxed);
+  is_dst_.store(is_dst, std::memory_order_relaxed);
+  abbr_.store(abbr, std::memory_order_relaxed);
+  abbr_len_.store(abbr_len, std::memory_order_relaxed);
+  seq_.store(seq + 2, std::memory_order_release);
+  return true;
+}
+
+}  // namespace detail
+
 }  // namespace cctz
@@ -15,8 +15,13 @@
 #ifndef CCTZ_TIME_ZONE_IMPL_H_
 #define CCTZ_TIME_ZONE_IMPL_H_
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "cctz/civil_time.h"
 #include "cctz/time_zone.h"
@@ -35,6 +40,32 @@ class time_zone::Impl {
   // some other kind of error occurs. Note that loading "UTC" never fails.
   static bool LoadTimeZone(const std::string& name, time_zone* tz);
 
+  // Like LoadTimeZone(), but always reads the time zone afresh, and then
+  // makes the result the one that later loads of the name return. Any
+  // time_zone that refers to an earlier load is unaffected.
+  static bool ReloadTimeZone(const std::string& name, time_zone* tz);
+
+  // Begins loading the named time zone on the executor (or a new thread),
+  // unless it is already loaded or loading (see load_time_zone_async()).
+  static time_zone_load LoadTimeZoneAsync(
+      const std::string& name,
+      std::function<void(bool, const time_zone&)> done,
+      time_zone_executor executor);
+
+  // Loads the named time zones concurrently, using up to num_threads
+  // threads (including the caller's). Returns the number of successes.
+  static std::size_t PreloadTimeZones(const std::vector<std::string>& names,
+                                      int num_threads);
+
+  // Reads each loaded time zone afresh, unless its data cannot have
+  // changed, and switches those whose data has changed to the new data
+  // (see update_time_zones()). Returns the number of zones that changed.
+  static std::size_t UpdateTimeZones();
+
+  // Appends the statistics of each loaded time zone (see time_zone_stats),
+  // other than UTC, and any that a reload has since replaced.
+  static void AppendStats(std::vector<time_zone_stats>* zones);
+
   // Clears the map of cached time zones.  Primarily for use in benchmarks
   // that gauge the performance of loading/parsing the time-zone data.
   static void ClearTimeZoneMapTestOnly();
@@ -47,40 +78,186 @@ class time_zone::Impl {
 
   // Breaks a time_point down to civil-time components in this time zone.
   time_zone::absolute_lookup BreakTime(const time_point<seconds>& tp) const {
-    return zone_->BreakTime(tp);
+    if (fixed_) return FixedBreakTime(tp);
+    return Zone()->BreakTime(tp);
+  }
+  void BreakTime(const time_point<seconds>* tps, std::size_t n,
+                 time_zone::absolute_lookup* als) const {
+    if (fixed_) {
+      for (std::size_t i = 0; i != n; ++i) als[i] = FixedBreakTime(tps[i]);
+      return;
+    }
+    Zone()->BreakTime(tps, n, als);
+  }
+  time_zone::absolute_lookup BreakTime(const time_point<seconds>& tp,
+                                       std::size_t* hint) const {
+    if (fixed_) return FixedBreakTime(tp);
+    return Zone()->BreakTime(tp, hint);
+  }
+  // As BreakTime(tp), but also setting *abbr_len to the length of the
+  // abbreviation (see TimeZoneIf::BreakTimeAbbr()).
+  time_zone::absolute_lookup BreakTimeAbbr(const time_point<seconds>& tp,
+                                           std::size_t* abbr_len) const {
+    if (fixed_) {
+      *abbr_len = fixed_abbr_.size();
+      return FixedBreakTime(tp);
+    }
+    return Zone()->BreakTimeAbbr(tp, abbr_len);
+  }
+
+  // As tz.lookup(tp), but also setting *abbr_len to the length of the
+  // abbreviation, so that formatting it need not measure it.
+  static time_zone::absolute_lookup Lookup(const time_zone& tz,
+                                           const time_point<seconds>& tp,
+                                           std::size_t* abbr_len) {
+    time_zone::absolute_lookup al;
+    if (tz.era_ != nullptr && tz.era_->lookup(tp, &al, abbr_len)) return al;
+    const Impl& impl = tz.effective_impl();
+    impl.EraMissed(tp);
+    return impl.BreakTimeAbbr(tp, abbr_len);
   }
 
   // Converts the civil-time components in this time zone into a time_point.
   // That is, the opposite of BreakTime(). The requested civil time may be
   // ambiguous or illegal due to a change of UTC offset.
   time_zone::civil_lookup MakeTime(const civil_second& cs) const {
-    return zone_->MakeTime(cs);
+    if (fixed_) return FixedMakeTime(cs);
+    return Zone()->MakeTime(cs);
+  }
+  void MakeTime(const civil_second* css, std::size_t n,
+                time_zone::civil_lookup* cls) const {
+    if (fixed_) {
+      for (std::size_t i = 0; i != n; ++i) cls[i] = FixedMakeTime(css[i]);
+      return;
+    }
+    Zone()->MakeTime(css, n, cls);
+  }
+  time_zone::civil_lookup MakeTime(const civil_second& cs,
+                                   std::size_t* hint) const {
+    if (fixed_) return FixedMakeTime(cs);
+    return Zone()->MakeTime(cs, hint);
   }
 
   // Finds the time of the next/previous offset change in this time zone.
   bool NextTransition(const time_point<seconds>& tp,
                       time_zone::civil_transition* trans) const {
-    return zone_->NextTransition(tp, trans);
+    return Zone()->NextTransition(tp, trans);
   }
   bool PrevTransition(const time_point<seconds>& tp,
                       time_zone::civil_transition* trans) const {
-    return zone_->PrevTransition(tp, trans);
+    return Zone()->PrevTransition(tp, trans);
+  }
+  bool NextTransition(const time_point<seconds>& tp,
+                      time_zone::civil_transition* trans,
+                      time_point<seconds>* at, std::size_t* hint) const {
+    return Zone()->NextTransition(tp, trans, at, hint);
+  }
+  bool PrevTransition(const time_point<seconds>& tp,
+                      time_zone::civil_transition* trans,
+                      time_point<seconds>* at, std::size_t* hint) const {
+    return Zone()->PrevTransition(tp, trans, at, hint);
+  }
+
+  // Describes the era of the zone data that contains tp, as
+  // TimeZoneIf::Era() does. A fixed-offset zone has a single era.
+  bool Era(const time_point<seconds>& tp, ZoneEra* era) const {
+    if (!fixed_) return Zone()->Era(tp, era);
+    const std::int_fast64_t kEraLimit = std::int_fast64_t{1} << 59;
+    era->begin = FromUnixSeconds(-kEraLimit);
+    era->end = FromUnixSeconds(kEraLimit);
+    era->offset = fixed_offset_;
+    era->is_dst = false;
+    era->abbr = fixed_abbr_.c_str();
+    return true;
+  }
+
+  // The era that contained the current time when last refreshed, or null
+  // when the zone does not keep one (see detail::time_zone_era).
+  const detail::time_zone_era* Era() const {
+    return era_enabled_ ? &era_ : nullptr;
+  }
+
+  // Refreshes the era after a lookup of tp that it missed, if that
+  // suggests that the current time may have moved on past its end.
+  void EraMissed(const time_point<seconds>& tp) const {
+    if (!era_enabled_) return;
+    const time_point<seconds> end = era_.end();
+    if (tp >= end && tp - end < std::chrono::hours(24)) RefreshEra();
   }
 
+  // Moves the era on to the one containing the current time, if that has
+  // passed its end (or regardless, when forced, as after an update). Returns
+  // false if the zone cannot describe that era.
+  bool RefreshEra(bool force = false) const;
+
   // Returns an implementation-defined version string for this time zone.
-  std::string Version() const { return zone_->Version(); }
+  const std::string& Version() const { return Zone()->Version(); }
 
   // Returns an implementation-defined description of this time zone.
-  std::string Description() const { return zone_->Description(); }
+  const std::string& Description() const { return Zone()->Description(); }
 
  private:
   explicit Impl(const std::string& name);
   static const Impl* UTCImpl();
 
+  // Sets *tz and *loaded as LoadTimeZone() would, and returns true, if
+  // that needs no load.
+  static bool FindLoaded(const std::string& name, time_zone* tz,
+                         bool* loaded);
+
+  // The current zone data, which UpdateTimeZones() may replace.
+  const TimeZoneIf* Zone() const {
+    return zone_.load(std::memory_order_acquire);
+  }
+
+  // Switches to freshly read zone data, if it differs from the current
+  // data, and returns whether it did. The data is only read afresh when
+  // the current data is not already at the given version (or, when that
+  // is empty, when the current data's source may have changed).
+  bool Update(const std::string& version) const;
+
+  // The lookups of a fixed-offset zone (including UTC), which need only
+  // arithmetic, and so bypass Zone() (giving the same results).
+  time_zone::absolute_lookup FixedBreakTime(
+      const time_point<seconds>& tp) const {
+    return {fixed_epoch_ + ToUnixSeconds(tp), fixed_offset_, false,
+            fixed_abbr_.c_str()};
+  }
+  time_zone::civil_lookup FixedMakeTime(const civil_second& cs) const {
+    time_zone::civil_lookup cl;
+    cl.kind = time_zone::civil_lookup::UNIQUE;
+    if (cs > fixed_civil_max_) {
+      cl.pre = time_point<seconds>::max();
+    } else if (cs < fixed_civil_min_) {
+      cl.pre = time_point<seconds>::min();
+    } else {
+      cl.pre = FromUnixSeconds(cs - fixed_epoch_);
+    }
+    cl.trans = cl.post = cl.pre;
+    return cl;
+  }
+
   const std::string name_;
-  std::unique_ptr<TimeZoneIf> zone_;
+  mutable std::atomic<const TimeZoneIf*> zone_;  // null if the load failed
+
+  // Every version of the zone data, as lookups may still be using (or
+  // returning abbreviations from) any of them. Guarded by TimeZoneMutex().
+  mutable std::vector<std::unique_ptr<const TimeZoneIf>> zones_;
+
+  bool fixed_ = false;            // a fixed-offset zone
+  int fixed_offset_ = 0;          // seconds east of UTC
+  civil_second fixed_epoch_;      // the civil time at the Unix epoch
+  civil_second fixed_civil_min_;  // of time_point<seconds>::min()
+  civil_second fixed_civil_max_;  // of time_point<seconds>::max()
+  std::string fixed_abbr_;
+
+  mutable detail::time_zone_era era_;
+  bool era_enabled_ = false;
 };
 
+inline time_zone::time_zone(const Impl* impl)
+    : impl_(impl), era_(impl != nullptr ? impl->Era() : nullptr) {}
+
 }  // namespace cctz
 
 #endif  // CCTZ_TIME_ZONE_IMPL_H_
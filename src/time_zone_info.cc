@@ -32,7 +32,13 @@
 
 #include "time_zone_info.h"
 
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstdint>
@@ -42,11 +48,15 @@
 #include <fstream>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
 
 #include "cctz/civil_time.h"
+#include "time_zone_bundle.h"
+#include "time_zone_embedded.h"
 #include "time_zone_fixed.h"
 #include "time_zone_posix.h"
 
@@ -74,6 +84,9 @@ const std::int_least32_t kSecsPerDay = 24 * 60 * 60;
 // 400-year chunks always have 146097 days (20871 weeks).
 const std::int_least64_t kSecsPer400Years = 146097LL * kSecsPerDay;
 
+// The average length of a Gregorian year.
+const std::int_least64_t kSecsPerAvgYear = kSecsPer400Years / 400;
+
 // Like kDaysPerYear[] but scaled up by a factor of kSecsPerDay.
 const std::int_least32_t kSecsPerYear[2] = {
   365 * kSecsPerDay,
@@ -130,6 +143,16 @@ std::int_fast64_t Decode64(const char* cp) {
   return static_cast<std::int_fast64_t>(v - s64maxU - 1) - s64max - 1;
 }
 
+// Sets the maximum/minimum civil times that can be converted to a
+// time_point<seconds> for the transition type, as LocalTime() would,
+// but from the UTC civil times of the extremes, which are computed once.
+void SetCivilLimits(TransitionType* tt) {
+  static const civil_second max_utc = civil_second() + seconds::max().count();
+  static const civil_second min_utc = civil_second() + seconds::min().count();
+  tt->civil_max = max_utc + tt->utc_offset;
+  tt->civil_min = min_utc + tt->utc_offset;
+}
+
 // Generate a year-relative offset for a PosixTransition.
 std::int_fast64_t TransOffset(bool leap_year, int jan1_weekday,
                               const PosixTransition& pt) {
@@ -196,6 +219,121 @@ inline civil_second YearShift(const civil_second& cs, year_t shift) {
                       cs.hour(), cs.minute(), cs.second());
 }
 
+// The 64-bit search key for a civil time, which packs the fields so that
+// keys order the same way as the civil times, and which is much cheaper
+// to compute than a civil-time difference. The year is clamped so that
+// the packing cannot overflow. That only affects the sentinels found in
+// some zoneinfo data, and any civil time beyond those is already handled
+// before we compute its key.
+inline std::int_fast64_t CivilKey(const civil_second& cs) {
+  const year_t kMaxYear = year_t{1} << 36;
+  std::int_fast64_t key = std::max(-kMaxYear, std::min(cs.year(), kMaxYear));
+  key = key * 16 + cs.month();
+  key = key * 32 + cs.day();
+  key = key * 32 + cs.hour();
+  key = key * 64 + cs.minute();
+  return key * 64 + cs.second();
+}
+
+// Inverts CivilKey(), which is cheaper than the civil-time addition that
+// would otherwise produce the civil time of a compact transition. Returns
+// false if the year may have been clamped.
+inline bool CivilFromKey(std::int_fast64_t key, civil_second* cs) {
+  const year_t kMaxYear = year_t{1} << 36;
+  const int second = static_cast<int>(key & 63);
+  key >>= 6;
+  const int minute = static_cast<int>(key & 63);
+  key >>= 6;
+  const int hour = static_cast<int>(key & 31);
+  key >>= 5;
+  const int day = static_cast<int>(key & 31);
+  key >>= 5;
+  const int month = static_cast<int>(key & 15);
+  key >>= 4;
+  if (key <= -kMaxYear || key >= kMaxYear) return false;
+  *cs = civil_second(key, month, day, hour, minute, second);
+  return true;
+}
+
+// Whether BuildTables() drops the full transitions (see TimeZoneData).
+std::atomic<bool> compact_time_zones(false);
+
+// Returns the std::upper_bound() of key within the sorted keys, given
+// that keys[first] <= key < keys[last], by walking from an initial guess.
+inline std::size_t UpperBoundFrom(const std::int_least64_t* keys,
+                                  std::size_t first, std::size_t last,
+                                  std::size_t guess, std::int_fast64_t key) {
+  std::size_t i = std::min(std::max(guess, first + 1), last);
+  while (key < keys[i - 1]) --i;
+  while (keys[i] <= key) ++i;
+  return i;
+}
+
+// Increments a statistics counter (see time_zone_stats), if we keep them.
+inline void Count(std::atomic<std::uint_fast64_t>* counter) {
+#if defined(CCTZ_ENABLE_STATS)
+  counter->fetch_add(1, std::memory_order_relaxed);
+#else
+  static_cast<void>(counter);
+#endif
+}
+
+// A monotonic clock for timing loads, if we keep statistics.
+inline std::int_fast64_t StatsNanos() {
+#if defined(CCTZ_ENABLE_STATS)
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#else
+  return 0;
+#endif
+}
+
+// A cursor over the zoneinfo data of a source, from which Load() decodes
+// each section, counting the bytes that it takes. The data is decoded in
+// place when the source exposes it (see ZoneInfoSource::Data()), and is
+// otherwise read a section at a time, as the header calls for it, so that
+// no more is read than the zone occupies.
+class ZoneInfoData {
+ public:
+  ZoneInfoData(ZoneInfoSource* zip, std::size_t* bytes_read)
+      : zip_(zip),
+        next_(zip->Data()),
+        end_(next_ != nullptr ? next_ + zip->Size() : nullptr),
+        bytes_read_(bytes_read) {}
+
+  // Returns the next n bytes, which remain valid until the next call, and
+  // moves past them, or returns null if fewer remain.
+  const char* Take(std::size_t n) {
+    const char* bp = next_;
+    if (bp != nullptr) {
+      if (static_cast<std::size_t>(end_ - bp) < n) return nullptr;
+      next_ += n;
+    } else {
+      buf_.resize(n);
+      if (zip_->Read(buf_.data(), n) != n) return nullptr;
+      bp = buf_.data();
+    }
+    *bytes_read_ += n;
+    return bp;
+  }
+
+  // Moves past the next n bytes, returning false if fewer remain.
+  bool Skip(std::size_t n) {
+    if (next_ == nullptr) return zip_->Skip(n) == 0;
+    if (static_cast<std::size_t>(end_ - next_) < n) return false;
+    next_ += n;
+    return true;
+  }
+
+ private:
+  ZoneInfoSource* const zip_;
+  const char* next_;  // null when reading from zip_
+  const char* const end_;
+  std::vector<char> buf_;  // the last section read from zip_
+  std::size_t* const bytes_read_;
+};
+
 }  // namespace
 
 // What (no leap-seconds) UTC+seconds zoneinfo would look like.
@@ -236,15 +374,129 @@ bool TimeZoneInfo::ResetToBuiltinUTC(const seconds& offset) {
   abbreviations_ = FixedOffsetToAbbr(offset);
   abbreviations_.append(1, '\0');
   future_spec_.clear();  // never needed for a fixed-offset zone
+  extendable_ = false;
   extended_ = false;
 
-  tt.civil_max = LocalTime(seconds::max().count(), tt).cs;
-  tt.civil_min = LocalTime(seconds::min().count(), tt).cs;
+  SetCivilLimits(&tt);
 
   transitions_.shrink_to_fit();
+  BuildTables(compact_time_zones.load(std::memory_order_relaxed));
+  return true;
+}
+
+namespace {
+
+// Mixes v into *hash.
+void MixHash(std::size_t* hash, std::int_fast64_t v) {
+  *hash ^= std::hash<std::int_fast64_t>()(v) + 0x9e3779b9 + (*hash << 6) +
+           (*hash >> 2);
+}
+
+// Returns a hash of the table contents, for use by ShareTimeZoneData().
+std::size_t HashTimeZoneData(const TimeZoneData& data) {
+  std::size_t hash = std::hash<std::string>()(data.abbreviations);
+  MixHash(&hash, static_cast<std::int_fast64_t>(data.transitions.size()));
+  for (std::size_t i = 0; i != data.unix_times.size(); ++i) {
+    MixHash(&hash, data.unix_times[i]);
+    MixHash(&hash, data.type_indexes[i]);
+  }
+  for (const TransitionType& tt : data.transition_types) {
+    MixHash(&hash, tt.utc_offset);
+    MixHash(&hash, tt.is_dst);
+    MixHash(&hash, tt.abbr_index);
+  }
+  return hash;
+}
+
+// Returns whether the two sets of tables are identical (and are both
+// compact or not). The civil times need not be compared, as they follow
+// from the rest.
+bool EqualTimeZoneData(const TimeZoneData& a, const TimeZoneData& b) {
+  if (a.transitions.size() != b.transitions.size() ||
+      a.unix_times != b.unix_times || a.type_indexes != b.type_indexes ||
+      a.abbreviations != b.abbreviations ||
+      a.transition_types.size() != b.transition_types.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i != a.transition_types.size(); ++i) {
+    const TransitionType& att = a.transition_types[i];
+    const TransitionType& btt = b.transition_types[i];
+    if (att.utc_offset != btt.utc_offset || att.is_dst != btt.is_dst ||
+        att.abbr_index != btt.abbr_index) {
+      return false;
+    }
+  }
   return true;
 }
 
+// Returns the previously-built tables that are identical to *data, if any
+// are still in use, and otherwise makes *data the tables to share.
+std::shared_ptr<const TimeZoneData> ShareTimeZoneData(
+    std::unique_ptr<TimeZoneData> data) {
+  using DataMap =
+      std::unordered_multimap<std::size_t, std::weak_ptr<const TimeZoneData>>;
+  // These are intentionally "leaked" to avoid the static deinitialization
+  // order fiasco (zones may be destroyed during exit).
+  static std::mutex* mutex = new std::mutex;
+  static DataMap* shared = new DataMap;
+
+  const std::size_t hash = HashTimeZoneData(*data);
+  std::lock_guard<std::mutex> lock(*mutex);
+  auto range = shared->equal_range(hash);
+  for (auto it = range.first; it != range.second;) {
+    if (std::shared_ptr<const TimeZoneData> other = it->second.lock()) {
+      if (EqualTimeZoneData(*other, *data)) return other;
+      ++it;
+    } else {
+      it = shared->erase(it);  // no longer in use
+    }
+  }
+  std::shared_ptr<const TimeZoneData> result(std::move(data));
+  shared->emplace(hash, result);
+  return result;
+}
+
+}  // namespace
+
+// Moves the tables into a TimeZoneData, along with dense copies of the
+// transition search keys (and type indexes), shares them, and then points
+// the lookup tables at the shared copy.
+void TimeZoneInfo::BuildTables(bool compact) {
+  // Record the length of each abbreviation, so that formatting it (as %Z)
+  // need not measure it.
+  for (TransitionType& tt : transition_types_) {
+    tt.abbr_len = static_cast<std::uint_least32_t>(
+        std::strlen(abbreviations_.c_str() + tt.abbr_index));
+  }
+  std::unique_ptr<TimeZoneData> data(new TimeZoneData);
+  data->transitions.swap(transitions_);
+  data->transition_types.swap(transition_types_);
+  data->abbreviations.swap(abbreviations_);
+  const std::size_t timecnt = data->transitions.size();
+  data->unix_times.reserve(timecnt);
+  data->civil_keys.reserve(timecnt);
+  data->type_indexes.reserve(timecnt);
+  for (const Transition& tr : data->transitions) {
+    data->unix_times.push_back(tr.unix_time);
+    data->civil_keys.push_back(CivilKey(tr.civil_sec));
+    data->type_indexes.push_back(tr.type_index);
+  }
+  if (compact) {
+    std::vector<Transition>().swap(data->transitions);
+  }
+  data_ = ShareTimeZoneData(std::move(data));
+  tab_.transitions =
+      data_->transitions.empty() ? nullptr : data_->transitions.data();
+  tab_.type_indexes = data_->type_indexes.data();
+  tab_.timecnt = timecnt;
+  tab_.unix_times = data_->unix_times.data();
+  tab_.civil_keys = data_->civil_keys.data();
+  tab_.transition_types = data_->transition_types.data();
+  tab_.typecnt = data_->transition_types.size();
+  tab_.abbreviations = data_->abbreviations.data();
+  tab_.abbrlen = data_->abbreviations.size();
+}
+
 // Builds the in-memory header using the raw bytes from the file.
 bool TimeZoneInfo::Header::Build(const tzhead& tzh) {
   std::int_fast32_t v;
@@ -279,11 +531,12 @@ std::size_t TimeZoneInfo::Header::DataLength(std::size_t time_len) const {
 // zic(8) can generate no-op transitions when a zone changes rules at an
 // instant when there is actually no discontinuity.  So we check whether
 // two transitions have equivalent types (same offset/is_dst/abbr).
-bool TimeZoneInfo::EquivTransitions(std::uint_fast8_t tt1_index,
-                                    std::uint_fast8_t tt2_index) const {
+bool TimeZoneInfo::EquivTransitions(const TransitionType* types,
+                                    std::uint_fast8_t tt1_index,
+                                    std::uint_fast8_t tt2_index) {
   if (tt1_index == tt2_index) return true;
-  const TransitionType& tt1(transition_types_[tt1_index]);
-  const TransitionType& tt2(transition_types_[tt2_index]);
+  const TransitionType& tt1(types[tt1_index]);
+  const TransitionType& tt2(types[tt2_index]);
   if (tt1.utc_offset != tt2.utc_offset) return false;
   if (tt1.is_dst != tt2.is_dst) return false;
   if (tt1.abbr_index != tt2.abbr_index) return false;
@@ -322,9 +575,25 @@ bool TimeZoneInfo::GetTransitionType(std::int_fast32_t utc_offset, bool is_dst,
   return true;
 }
 
+// Find an existing transition type with these attributes.
+bool TimeZoneInfo::FindTransitionType(std::int_fast32_t utc_offset,
+                                      bool is_dst, const std::string& abbr,
+                                      std::uint_least8_t* index) const {
+  for (std::size_t type_index = 0; type_index != tab_.typecnt; ++type_index) {
+    const TransitionType& tt(tab_.transition_types[type_index]);
+    if (tt.utc_offset == utc_offset && tt.is_dst == is_dst &&
+        abbr == tab_.abbreviations + tt.abbr_index) {
+      *index = static_cast<std::uint_least8_t>(type_index);
+      return true;
+    }
+  }
+  return false;
+}
+
 // Use the POSIX-TZ-environment-variable-style string to handle times
 // in years after the last transition stored in the zoneinfo data.
 bool TimeZoneInfo::ExtendTransitions() {
+  extendable_ = false;
   extended_ = false;
   if (future_spec_.empty()) return true;  // last transition prevails
 
@@ -339,7 +608,8 @@ bool TimeZoneInfo::ExtendTransitions() {
   if (posix.dst_abbr.empty()) {  // std only
     // The future specification should match the last transition, and
     // that means that handling the future will fall out naturally.
-    return EquivTransitions(transitions_.back().type_index, std_ti);
+    return EquivTransitions(transition_types_.data(),
+                            transitions_.back().type_index, std_ti);
   }
 
   // Find transition type for the future dst specification.
@@ -347,49 +617,183 @@ bool TimeZoneInfo::ExtendTransitions() {
   if (!GetTransitionType(posix.dst_offset, true, posix.dst_abbr, &dst_ti))
     return false;
 
-  // Extend the transitions for an additional 400 years using the
-  // future specification. Years beyond those can be handled by
-  // mapping back to a cycle-equivalent year within that range.
-  // We may need two additional transitions for the current year.
-  transitions_.reserve(transitions_.size() + 400 * 2 + 2);
-  extended_ = true;
+  // The rule prescribes two transitions per year. We store those in the
+  // year of the last transition now, but leave the following 400 years
+  // to Future(), which most zones never need. Years beyond those can be
+  // handled by mapping back to a cycle-equivalent year within that range.
+  rule_.dst_start = posix.dst_start;
+  rule_.dst_end = posix.dst_end;
+  rule_.std_offset = static_cast<std::int_least32_t>(posix.std_offset);
+  rule_.dst_offset = static_cast<std::int_least32_t>(posix.dst_offset);
+  rule_.std_type_index = std_ti;
+  rule_.dst_type_index = dst_ti;
 
   const Transition& last(transitions_.back());
   const std::int_fast64_t last_time = last.unix_time;
   const TransitionType& last_tt(transition_types_[last.type_index]);
-  last_year_ = LocalTime(last_time, last_tt).cs.year();
-  bool leap_year = IsLeap(last_year_);
-  const civil_second jan1(last_year_);
-  std::int_fast64_t jan1_time = jan1 - civil_second();
-  int jan1_weekday = ToPosixWeekday(get_weekday(jan1));
-
-  Transition dst = {0, dst_ti, civil_second(), civil_second()};
-  Transition std = {0, std_ti, civil_second(), civil_second()};
-  for (const year_t limit = last_year_ + 400;; ++last_year_) {
-    auto dst_trans_off = TransOffset(leap_year, jan1_weekday, posix.dst_start);
-    auto std_trans_off = TransOffset(leap_year, jan1_weekday, posix.dst_end);
-    dst.unix_time = jan1_time + dst_trans_off - posix.std_offset;
-    std.unix_time = jan1_time + std_trans_off - posix.dst_offset;
-    const auto* ta = dst.unix_time < std.unix_time ? &dst : &std;
-    const auto* tb = dst.unix_time < std.unix_time ? &std : &dst;
-    if (last_time < tb->unix_time) {
-      if (last_time < ta->unix_time) transitions_.push_back(*ta);
-      transitions_.push_back(*tb);
+  const year_t last_year = LocalTime(last_time, last_tt).cs.year();
+  Transition trs[2];
+  RuleTransitions(last_year, trs);
+  for (const Transition& tr : trs) {
+    if (last_time < tr.unix_time) transitions_.push_back(tr);
+  }
+  extendable_ = true;
+  last_year_ = last_year + 400;
+  return true;
+}
+
+// Restores rule_ from future_spec_ for a zone whose tables were built
+// elsewhere, and which therefore already contain the rule's types.
+bool TimeZoneInfo::LoadFutureRule() {
+  if (!extendable_) return true;
+  PosixTimeZone posix;
+  if (!ParsePosixSpec(future_spec_, &posix)) return false;
+  std::uint_least8_t std_ti;
+  std::uint_least8_t dst_ti;
+  if (!FindTransitionType(posix.std_offset, false, posix.std_abbr, &std_ti) ||
+      !FindTransitionType(posix.dst_offset, true, posix.dst_abbr, &dst_ti)) {
+    return false;
+  }
+  rule_.dst_start = posix.dst_start;
+  rule_.dst_end = posix.dst_end;
+  rule_.std_offset = static_cast<std::int_least32_t>(posix.std_offset);
+  rule_.dst_offset = static_cast<std::int_least32_t>(posix.dst_offset);
+  rule_.std_type_index = std_ti;
+  rule_.dst_type_index = dst_ti;
+  return true;
+}
+
+// Sets trs[0] and trs[1] to the unix_time and type_index of the two
+// transitions that rule_ prescribes for the given year, in order.
+void TimeZoneInfo::RuleTransitions(year_t year, Transition* trs) const {
+  const bool leap_year = IsLeap(year);
+  const civil_second jan1(year);
+  const std::int_fast64_t jan1_time = jan1 - civil_second();
+  const int jan1_weekday = ToPosixWeekday(get_weekday(jan1));
+  const std::int_fast64_t dst_time =
+      jan1_time + TransOffset(leap_year, jan1_weekday, rule_.dst_start) -
+      rule_.std_offset;
+  const std::int_fast64_t std_time =
+      jan1_time + TransOffset(leap_year, jan1_weekday, rule_.dst_end) -
+      rule_.dst_offset;
+  const bool dst_first = dst_time < std_time;
+  trs[0].unix_time = dst_first ? dst_time : std_time;
+  trs[0].type_index = dst_first ? rule_.dst_type_index : rule_.std_type_index;
+  trs[1].unix_time = dst_first ? std_time : dst_time;
+  trs[1].type_index = dst_first ? rule_.std_type_index : rule_.dst_type_index;
+}
+
+// Builds the Future() of the given zone: its last transition, followed by
+// the rule's transitions for the next 400 years, with the same layout.
+void TimeZoneInfo::ExtendFrom(const TimeZoneInfo& zone) {
+  const Tables& tab = zone.tab_;
+  const std::size_t last = tab.timecnt - 1;
+  transition_types_.assign(tab.transition_types,
+                           tab.transition_types + tab.typecnt);
+  abbreviations_.assign(tab.abbreviations, tab.abbrlen);
+  default_transition_type_ =
+      (last == 0) ? zone.default_transition_type_ : zone.TypeIndexAt(last - 1);
+  version_ = zone.version_;
+  future_spec_ = zone.future_spec_;
+  extendable_ = false;
+  rule_ = zone.rule_;
+
+  transitions_.reserve(1 + 400 * 2 + 1);
+  Transition& first(*transitions_.emplace(transitions_.end()));
+  first.unix_time = tab.unix_times[last];
+  first.type_index = zone.TypeIndexAt(last);
+  last_year_ = zone.last_year_;
+  Transition trs[2];
+  for (year_t year = last_year_ - 400 + 1; year <= last_year_; ++year) {
+    RuleTransitions(year, trs);
+    transitions_.insert(transitions_.end(), trs, trs + 2);
+  }
+
+  // Every year has exactly two transitions, so we can index them by year
+  // rather than by searching.
+  extended_ = true;
+  extended_index_ = 1;
+  extended_year_ = last_year_ - 400 + 1;
+  if (!FinishTransitions()) {
+    // The rule's transitions are out of order, which zic never produces,
+    // so we fall back to the last transition as it is.
+    transitions_.resize(1);
+    extended_ = false;
+    FinishTransitions();
+  }
+  BuildTables(tab.transitions == nullptr);
+}
+
+// Returns the zone of the transitions after our last one, building it on
+// first use. Racing builders are harmless, as only one is published.
+const TimeZoneInfo* TimeZoneInfo::Future() const {
+  const TimeZoneInfo* future = future_.load(std::memory_order_acquire);
+  if (future == nullptr) {
+    const std::int_fast64_t start = StatsNanos();
+    std::unique_ptr<TimeZoneInfo> tz(new TimeZoneInfo);
+    tz->ExtendFrom(*this);
+    extend_nanos_.fetch_add(StatsNanos() - start, std::memory_order_relaxed);
+    if (future_.compare_exchange_strong(future, tz.get(),
+                                        std::memory_order_acq_rel,
+                                        std::memory_order_acquire)) {
+      future = tz.release();
     }
-    if (last_year_ == limit) break;
-    jan1_time += kSecsPerYear[leap_year];
-    jan1_weekday = (jan1_weekday + kDaysPerYear[leap_year]) % 7;
-    leap_year = !leap_year && IsLeap(last_year_ + 1);
   }
+  return future;
+}
+
+TimeZoneInfo::~TimeZoneInfo() {
+  delete future_.load(std::memory_order_acquire);
+}
+
+// Completes the transitions (and types) once they are all present.
+bool TimeZoneInfo::FinishTransitions() {
+  // Ensure that there is always a transition in the second half of the
+  // time line (Load() handles the first half) so that the signed
+  // difference between a civil_second and the civil_second of its
+  // previous transition is always representable, without overflow.
+  // An extendable zone hands the second half to Future() instead.
+  const Transition& last(transitions_.back());
+  if (!extendable_ && last.unix_time < 0) {
+    const std::uint_fast8_t type_index = last.type_index;
+    Transition& tr(*transitions_.emplace(transitions_.end()));
+    tr.unix_time = 2147483647;  // 2038-01-19T03:14:07+00:00
+    tr.type_index = type_index;
+  }
+
+  // Compute the local civil time for each transition and the preceding
+  // second. These will be used for reverse conversions in MakeTime().
+  const TransitionType* ttp = &transition_types_[default_transition_type_];
+  for (std::size_t i = 0; i != transitions_.size(); ++i) {
+    Transition& tr(transitions_[i]);
+    tr.prev_civil_sec = LocalTime(tr.unix_time, *ttp).cs - 1;
+    ttp = &transition_types_[tr.type_index];
+    tr.civil_sec = LocalTime(tr.unix_time, *ttp).cs;
+    if (i != 0) {
+      // Check that the transitions are ordered by civil time. Essentially
+      // this means that an offset change cannot cross another such change.
+      // No one does this in practice, and we depend on it in MakeTime().
+      if (!Transition::ByCivilTime()(transitions_[i - 1], tr))
+        return false;  // out of order
+    }
+  }
+
+  // Compute the maximum/minimum civil times that can be converted to a
+  // time_point<seconds> for each of the zone's transition types.
+  for (auto& tt : transition_types_) SetCivilLimits(&tt);
 
   return true;
 }
 
 bool TimeZoneInfo::Load(ZoneInfoSource* zip) {
+  ZoneInfoData zid(zip, &bytes_read_);
+
   // Read and validate the header.
   tzhead tzh;
-  if (zip->Read(&tzh, sizeof(tzh)) != sizeof(tzh))
+  const char* hp = zid.Take(sizeof(tzh));
+  if (hp == nullptr)
     return false;
+  memcpy(&tzh, hp, sizeof(tzh));
   if (strncmp(tzh.tzh_magic, TZ_MAGIC, sizeof(tzh.tzh_magic)) != 0)
     return false;
   Header hdr;
@@ -398,11 +802,12 @@ bool TimeZoneInfo::Load(ZoneInfoSource* zip) {
   std::size_t time_len = 4;
   if (tzh.tzh_version[0] != '\0') {
     // Skip the 4-byte data.
-    if (zip->Skip(hdr.DataLength(time_len)) != 0)
+    if (!zid.Skip(hdr.DataLength(time_len)))
       return false;
     // Read and validate the header for the 8-byte data.
-    if (zip->Read(&tzh, sizeof(tzh)) != sizeof(tzh))
+    if ((hp = zid.Take(sizeof(tzh))) == nullptr)
       return false;
+    memcpy(&tzh, hp, sizeof(tzh));
     if (strncmp(tzh.tzh_magic, TZ_MAGIC, sizeof(tzh.tzh_magic)) != 0)
       return false;
     if (tzh.tzh_version[0] == '\0')
@@ -425,12 +830,12 @@ bool TimeZoneInfo::Load(ZoneInfoSource* zip) {
   if (hdr.ttisutcnt != 0 && hdr.ttisutcnt != hdr.typecnt)
     return false;
 
-  // Read the data into a local buffer.
-  std::size_t len = hdr.DataLength(time_len);
-  std::vector<char> tbuf(len);
-  if (zip->Read(tbuf.data(), len) != len)
+  // Decode the data (in place, if the source allows).
+  const std::size_t len = hdr.DataLength(time_len);
+  const char* bp = zid.Take(len);
+  if (bp == nullptr)
     return false;
-  const char* bp = tbuf.data();
+  const char* const ep = bp + len;
 
   // Decode and validate the transitions.
   transitions_.reserve(hdr.timecnt + 2);
@@ -496,23 +901,21 @@ bool TimeZoneInfo::Load(ZoneInfoSource* zip) {
   bp += (8 + 4) * hdr.leapcnt;  // leap-time + TAI-UTC
   bp += 1 * hdr.ttisstdcnt;     // UTC/local indicators
   bp += 1 * hdr.ttisutcnt;      // standard/wall indicators
-  assert(bp == tbuf.data() + tbuf.size());
+  assert(bp == ep);
+  static_cast<void>(ep);
 
   future_spec_.clear();
   if (tzh.tzh_version[0] != '\0') {
     // Snarf up the NL-enclosed future POSIX spec. Note
     // that version '3' files utilize an extended format.
-    auto get_char = [](ZoneInfoSource* azip) -> int {
-      unsigned char ch;  // all non-EOF results are positive
-      return (azip->Read(&ch, 1) == 1) ? ch : EOF;
-    };
-    if (get_char(zip) != '\n')
+    const char* cp = zid.Take(1);
+    if (cp == nullptr || *cp != '\n')
       return false;
-    for (int c = get_char(zip); c != '\n'; c = get_char(zip)) {
-      if (c == EOF)
-        return false;
-      future_spec_.push_back(static_cast<char>(c));
+    while ((cp = zid.Take(1)) != nullptr && *cp != '\n') {
+      future_spec_.push_back(*cp);
     }
+    if (cp == nullptr)
+      return false;
   }
 
   // We don't check for EOF so that we're forwards compatible.
@@ -529,7 +932,8 @@ bool TimeZoneInfo::Load(ZoneInfoSource* zip) {
   // zic.c:dontmerge) and the Qt library (see zic.c:WORK_AROUND_QTBUG_53071).
   // For us, they just get in the way when we do future_spec_ extension.
   while (hdr.timecnt > 1) {
-    if (!EquivTransitions(transitions_[hdr.timecnt - 1].type_index,
+    if (!EquivTransitions(transition_types_.data(),
+                          transitions_[hdr.timecnt - 1].type_index,
                           transitions_[hdr.timecnt - 2].type_index)) {
       break;
     }
@@ -548,46 +952,158 @@ bool TimeZoneInfo::Load(ZoneInfoSource* zip) {
   }
 
   // Extend the transitions using the future specification.
+  const std::int_fast64_t extend_start = StatsNanos();
   if (!ExtendTransitions()) return false;
+  extend_nanos_.store(StatsNanos() - extend_start, std::memory_order_relaxed);
 
-  // Ensure that there is always a transition in the second half of the
-  // time line (the first half is handled above) so that the signed
-  // difference between a civil_second and the civil_second of its
-  // previous transition is always representable, without overflow.
-  const Transition& last(transitions_.back());
-  if (last.unix_time < 0) {
-    const std::uint_fast8_t type_index = last.type_index;
-    Transition& tr(*transitions_.emplace(transitions_.end()));
-    tr.unix_time = 2147483647;  // 2038-01-19T03:14:07+00:00
-    tr.type_index = type_index;
-  }
+  if (!FinishTransitions()) return false;
 
-  // Compute the local civil time for each transition and the preceding
-  // second. These will be used for reverse conversions in MakeTime().
-  const TransitionType* ttp = &transition_types_[default_transition_type_];
-  for (std::size_t i = 0; i != transitions_.size(); ++i) {
-    Transition& tr(transitions_[i]);
-    tr.prev_civil_sec = LocalTime(tr.unix_time, *ttp).cs - 1;
-    ttp = &transition_types_[tr.type_index];
-    tr.civil_sec = LocalTime(tr.unix_time, *ttp).cs;
+  transitions_.shrink_to_fit();
+  BuildTables(compact_time_zones.load(std::memory_order_relaxed));
+  return true;
+}
+
+// Points the lookup tables into the bundle, after checking that they lie
+// within it, and that their contents are as consistent as those that the
+// TZif loader accepts, so that a corrupt bundle cannot lead a lookup out
+// of bounds.
+bool TimeZoneInfo::Load(const ZoneBundle& bundle, const BundleZone& zone) {
+  Tables tab;
+  tab.timecnt = static_cast<std::size_t>(zone.timecnt);
+  tab.typecnt = static_cast<std::size_t>(zone.typecnt);
+  tab.abbrlen = static_cast<std::size_t>(zone.abbrlen);
+  tab.transitions = bundle.At<Transition>(zone.transitions, zone.timecnt);
+  tab.unix_times = bundle.At<std::int_least64_t>(zone.unix_times, zone.timecnt);
+  tab.civil_keys = bundle.At<std::int_least64_t>(zone.civil_keys, zone.timecnt);
+  tab.transition_types =
+      bundle.At<TransitionType>(zone.transition_types, zone.typecnt);
+  tab.abbreviations = bundle.At<char>(zone.abbreviations, zone.abbrlen);
+  const char* version = bundle.String(zone.version);
+  const char* future_spec = bundle.String(zone.future_spec);
+  if (tab.transitions == nullptr || tab.unix_times == nullptr ||
+      tab.civil_keys == nullptr || tab.transition_types == nullptr ||
+      tab.abbreviations == nullptr || version == nullptr ||
+      future_spec == nullptr) {
+    return false;
+  }
+  if (tab.timecnt == 0 || tab.typecnt == 0 || tab.typecnt > 256 ||
+      zone.default_transition_type >= tab.typecnt || tab.abbrlen == 0 ||
+      tab.abbreviations[tab.abbrlen - 1] != '\0') {
+    return false;
+  }
+  for (std::size_t i = 0; i != tab.typecnt; ++i) {
+    const TransitionType& tt = tab.transition_types[i];
+    if (tt.utc_offset >= kSecsPerDay || tt.utc_offset <= -kSecsPerDay ||
+        tt.abbr_index >= tab.abbrlen ||
+        tt.abbr_len != std::strlen(tab.abbreviations + tt.abbr_index)) {
+      return false;
+    }
+  }
+  for (std::size_t i = 0; i != tab.timecnt; ++i) {
+    const Transition& tr = tab.transitions[i];
+    if (tr.type_index >= tab.typecnt || tr.unix_time != tab.unix_times[i] ||
+        CivilKey(tr.civil_sec) != tab.civil_keys[i]) {
+      return false;
+    }
     if (i != 0) {
-      // Check that the transitions are ordered by civil time. Essentially
-      // this means that an offset change cannot cross another such change.
-      // No one does this in practice, and we depend on it in MakeTime().
-      if (!Transition::ByCivilTime()(transitions_[i - 1], tr))
+      const Transition& prev = tab.transitions[i - 1];
+      if (!Transition::ByUnixTime()(prev, tr) ||
+          !Transition::ByCivilTime()(prev, tr)) {
         return false;  // out of order
+      }
     }
   }
 
-  // Compute the maximum/minimum civil times that can be converted to a
-  // time_point<seconds> for each of the zone's transition types.
-  for (auto& tt : transition_types_) {
-    tt.civil_max = LocalTime(seconds::max().count(), tt).cs;
-    tt.civil_min = LocalTime(seconds::min().count(), tt).cs;
-  }
+  EmbeddedZone ez;
+  ez.name = nullptr;
+  ez.transitions = tab.transitions;
+  ez.timecnt = tab.timecnt;
+  ez.unix_times = tab.unix_times;
+  ez.civil_keys = tab.civil_keys;
+  ez.transition_types = tab.transition_types;
+  ez.typecnt = tab.typecnt;
+  ez.abbreviations = tab.abbreviations;
+  ez.abbrlen = tab.abbrlen;
+  ez.version = version;
+  ez.future_spec = future_spec;
+  ez.last_year = zone.last_year;
+  ez.default_transition_type = zone.default_transition_type;
+  ez.extended = (zone.extended != 0);
+  return Load(ez);
+}
 
-  transitions_.shrink_to_fit();
-  return true;
+// Uses the tables of a zone that was compiled into the program.
+bool TimeZoneInfo::Load(const EmbeddedZone& zone) {
+  tab_.transitions = zone.transitions;
+  tab_.timecnt = zone.timecnt;
+  tab_.unix_times = zone.unix_times;
+  tab_.civil_keys = zone.civil_keys;
+  tab_.transition_types = zone.transition_types;
+  tab_.typecnt = zone.typecnt;
+  tab_.abbreviations = zone.abbreviations;
+  tab_.abbrlen = zone.abbrlen;
+  default_transition_type_ = zone.default_transition_type;
+  version_ = zone.version;
+  future_spec_ = zone.future_spec;
+  extendable_ = zone.extended;
+  extended_ = false;
+  last_year_ = zone.last_year;
+  return LoadFutureRule();
+}
+
+void TimeZoneInfo::Embed(EmbeddedZone* zone) const {
+  assert(tab_.transitions != nullptr);
+  zone->name = nullptr;
+  zone->transitions = tab_.transitions;
+  zone->timecnt = tab_.timecnt;
+  zone->unix_times = tab_.unix_times;
+  zone->civil_keys = tab_.civil_keys;
+  zone->transition_types = tab_.transition_types;
+  zone->typecnt = tab_.typecnt;
+  zone->abbreviations = tab_.abbreviations;
+  zone->abbrlen = tab_.abbrlen;
+  zone->version = version_.c_str();
+  zone->future_spec = future_spec_.c_str();
+  zone->last_year = last_year_;
+  zone->default_transition_type =
+      static_cast<std::uint_least8_t>(default_transition_type_);
+  zone->extended = extendable_;
+}
+
+void TimeZoneInfo::AppendToBundle(std::string* image, BundleZone* zone) const {
+  auto append = [image](const void* data, std::size_t size) {
+    image->append((8 - image->size() % 8) % 8, '\0');
+    const std::uint64_t offset = image->size();
+    image->append(static_cast<const char*>(data), size);
+    return offset;
+  };
+  std::memset(zone, 0, sizeof(*zone));
+  zone->timecnt = tab_.timecnt;
+  zone->typecnt = tab_.typecnt;
+  zone->abbrlen = tab_.abbrlen;
+  std::vector<Transition> transitions;  // for a compact zone
+  const Transition* trs = tab_.transitions;
+  if (trs == nullptr) {
+    Transition buf;
+    for (std::size_t i = 0; i != tab_.timecnt; ++i) {
+      transitions.push_back(TransitionAt(i, &buf));
+    }
+    trs = transitions.data();
+  }
+  zone->transitions = append(trs, tab_.timecnt * sizeof(Transition));
+  zone->unix_times =
+      append(tab_.unix_times, tab_.timecnt * sizeof(std::int_least64_t));
+  zone->civil_keys =
+      append(tab_.civil_keys, tab_.timecnt * sizeof(std::int_least64_t));
+  zone->transition_types =
+      append(tab_.transition_types, tab_.typecnt * sizeof(TransitionType));
+  zone->abbreviations = append(tab_.abbreviations, tab_.abbrlen);
+  zone->version = append(version_.c_str(), version_.size() + 1);
+  zone->future_spec = append(future_spec_.c_str(), future_spec_.size() + 1);
+  zone->last_year = last_year_;
+  zone->default_transition_type =
+      static_cast<std::uint8_t>(default_transition_type_);
+  zone->extended = extendable_ ? 1 : 0;
 }
 
 namespace {
@@ -606,23 +1122,25 @@ inline FilePtr FOpen(const char* path, const char* mode) {
 #endif
 }
 
-// A stdio(3)-backed implementation of ZoneInfoSource.
+// A file-backed implementation of ZoneInfoSource, which reads the data
+// (at most len bytes from the current position) with one bulk fread(3)
+// when it is opened, and then serves it from memory.
 class FileZoneInfoSource : public ZoneInfoSource {
  public:
   static std::unique_ptr<ZoneInfoSource> Open(const std::string& name);
 
   std::size_t Read(void* ptr, std::size_t size) override {
-    size = std::min(size, len_);
-    std::size_t nread = fread(ptr, 1, size, fp_.get());
-    len_ -= nread;
-    return nread;
+    size = std::min(size, data_.size() - pos_);
+    memcpy(ptr, data_.data() + pos_, size);
+    pos_ += size;
+    return size;
   }
   int Skip(std::size_t offset) override {
-    offset = std::min(offset, len_);
-    int rc = fseek(fp_.get(), static_cast<long>(offset), SEEK_CUR);
-    if (rc == 0) len_ -= offset;
-    return rc;
+    pos_ += std::min(offset, data_.size() - pos_);
+    return 0;
   }
+  const char* Data() const override { return data_.data() + pos_; }
+  std::size_t Size() const override { return data_.size() - pos_; }
   std::string Version() const override {
     // TODO: It would nice if the zoneinfo data included the tzdb version.
     return std::string();
@@ -630,20 +1148,42 @@ class FileZoneInfoSource : public ZoneInfoSource {
 
  protected:
   explicit FileZoneInfoSource(
-      FilePtr fp, std::size_t len = std::numeric_limits<std::size_t>::max())
-      : fp_(std::move(fp)), len_(len) {}
+      FilePtr fp, std::size_t len = std::numeric_limits<std::size_t>::max());
 
  private:
-  FilePtr fp_;
-  std::size_t len_;
+  std::string data_;
+  std::size_t pos_ = 0;
 };
 
-std::unique_ptr<ZoneInfoSource> FileZoneInfoSource::Open(
-    const std::string& name) {
+FileZoneInfoSource::FileZoneInfoSource(FilePtr fp, std::size_t len) {
+  FILE* f = fp.get();
+#if !defined(_WIN32)
+  // Without a length, size the buffer from the file (which was just
+  // opened, and so is read from its start) when it is a regular one.
+  struct stat st;
+  if (len == std::numeric_limits<std::size_t>::max() &&
+      fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode)) {
+    len = static_cast<std::size_t>(st.st_size);
+  }
+#endif
+  if (len != std::numeric_limits<std::size_t>::max()) {
+    // One read(2), straight into the buffer, rather than through stdio's.
+    setvbuf(f, nullptr, _IONBF, 0);
+    data_.resize(len);
+    data_.resize(fread(&data_[0], 1, len, f));
+    return;
+  }
+  // Otherwise read until EOF.
+  char buf[4096];
+  std::size_t nread;
+  while ((nread = fread(buf, 1, sizeof(buf), f)) != 0) data_.append(buf, nread);
+}
+
+// Maps a time-zone name to a path name.
+std::string ZoneInfoPath(const std::string& name) {
   // Use of the "file:" prefix is intended for testing purposes only.
   const std::size_t pos = (name.compare(0, 5, "file:") == 0) ? 5 : 0;
 
-  // Map the time-zone name to a path name.
   std::string path;
   if (pos == name.size() || name[pos] != '/') {
     const char* tzdir = "/usr/share/zoneinfo";
@@ -661,8 +1201,13 @@ std::unique_ptr<ZoneInfoSource> FileZoneInfoSource::Open(
 #endif
   }
   path.append(name, pos, std::string::npos);
+  return path;
+}
 
+std::unique_ptr<ZoneInfoSource> FileZoneInfoSource::Open(
+    const std::string& name) {
   // Open the zoneinfo file.
+  const std::string path = ZoneInfoPath(name);
   auto fp = FOpen(path.c_str(), "rb");
   if (fp == nullptr) return nullptr;
   return std::unique_ptr<ZoneInfoSource>(new FileZoneInfoSource(std::move(fp)));
@@ -785,9 +1330,42 @@ std::unique_ptr<ZoneInfoSource> FuchsiaZoneInfoSource::Open(
   return nullptr;
 }
 
+// The fallback factory that cctz_extension::zone_info_source_factory is
+// given, which reads the platform's zoneinfo.
+std::unique_ptr<ZoneInfoSource> DefaultZoneInfoSource(const std::string& name) {
+  if (auto z = FileZoneInfoSource::Open(name)) return z;
+  if (auto z = AndroidZoneInfoSource::Open(name)) return z;
+  if (auto z = FuchsiaZoneInfoSource::Open(name)) return z;
+  return nullptr;
+}
+
 }  // namespace
 
+FileStamp StampFile(const std::string& path) {
+  FileStamp stamp;
+#if !defined(_WIN32)
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {  // follows an /etc/localtime symlink
+    stamp.exists = true;
+    stamp.dev = st.st_dev;
+    stamp.ino = st.st_ino;
+    stamp.size = st.st_size;
+    stamp.mtime = st.st_mtime;
+  }
+#else
+  static_cast<void>(path);
+#endif
+  return stamp;
+}
+
 bool TimeZoneInfo::Load(const std::string& name) {
+  const std::int_fast64_t start = StatsNanos();
+  const bool loaded = LoadNamed(name);
+  load_nanos_ = StatsNanos() - start;
+  return loaded;
+}
+
+bool TimeZoneInfo::LoadNamed(const std::string& name) {
   // We can ensure that the loading of UTC or any other fixed-offset
   // zone never fails because the simple, fixed-offset state can be
   // internally generated. Note that this depends on our choice to not
@@ -797,42 +1375,162 @@ bool TimeZoneInfo::Load(const std::string& name) {
     return ResetToBuiltinUTC(offset);
   }
 
-  // Find and use a ZoneInfoSource to load the named zone.
-  auto zip = cctz_extension::zone_info_source_factory(
-      name, [](const std::string& n) -> std::unique_ptr<ZoneInfoSource> {
-        if (auto z = FileZoneInfoSource::Open(n)) return z;
-        if (auto z = AndroidZoneInfoSource::Open(n)) return z;
-        if (auto z = FuchsiaZoneInfoSource::Open(n)) return z;
-        return nullptr;
-      });
-  return zip != nullptr && Load(zip.get());
+  // Use the tables from any bundle that contains the named zone, or
+  // failing that, any tables compiled into the program.
+  if (const ZoneBundle* bundle = GetZoneBundle()) {
+    if (const BundleZone* zone = bundle->Find(name)) {
+      if (Load(*bundle, *zone)) return true;
+    }
+  }
+  if (const EmbeddedZone* zone = FindEmbeddedZone(name)) {
+    return Load(*zone);
+  }
+
+  // Find and use a ZoneInfoSource to load the named zone. Any file that
+  // the fallback factory reads is stamped first, so that SourceChanged()
+  // can later tell whether it has since been replaced or rewritten.
+  auto fallback = [this](const std::string& source_name) {
+    path_ = ZoneInfoPath(source_name);
+    stamp_ = StampFile(path_);
+    return DefaultZoneInfoSource(source_name);
+  };
+  auto zip = cctz_extension::zone_info_source_factory(name, fallback);
+  if (zip == nullptr) return false;
+  return Load(zip.get());
+}
+
+void use_compact_time_zones(bool compact) {
+  compact_time_zones.store(compact, std::memory_order_relaxed);
+}
+
+std::string TimeZoneInfo::SourceVersion() {
+  auto zip =
+      cctz_extension::zone_info_source_factory("UTC", DefaultZoneInfoSource);
+  if (zip == nullptr) return std::string();
+  return zip->Version();
+}
+
+bool TimeZoneInfo::ListZones(std::vector<std::string>* names) {
+  // The table is obtained like the data for any zone, so that it comes
+  // from the same place as the zones themselves.
+  auto zip = cctz_extension::zone_info_source_factory("zone1970.tab",
+                                                      DefaultZoneInfoSource);
+  if (zip == nullptr) return false;
+  std::string tab;
+  char buf[4096];
+  for (std::size_t n; (n = zip->Read(buf, sizeof(buf))) != 0;) {
+    tab.append(buf, n);
+  }
+  for (std::size_t pos = 0; pos < tab.size();) {
+    std::size_t eol = tab.find('\n', pos);
+    if (eol == std::string::npos) eol = tab.size();
+    const std::string line = tab.substr(pos, eol - pos);
+    pos = eol + 1;
+    if (line.empty() || line[0] == '#') continue;
+    // The fields are country codes, coordinates, zone name, and comments.
+    const std::size_t b = line.find('\t', line.find('\t') + 1);
+    if (b == std::string::npos) continue;
+    const std::size_t e = line.find('\t', b + 1);
+    const std::size_t len = (e == std::string::npos) ? e : e - b - 1;
+    names->push_back(line.substr(b + 1, len));
+  }
+  return true;
 }
 
 // BreakTime() translation for a particular transition type.
 time_zone::absolute_lookup TimeZoneInfo::LocalTime(
     std::int_fast64_t unix_time, const TransitionType& tt) const {
-  // A civil time in "+offset" looks like (time+offset) in UTC.
-  // Note: We perform two additions in the civil_second domain to
+  // A civil time in "+offset" looks like (time+offset) in UTC. That is
+  // computed in closed form, rather than by civil_second arithmetic,
+  // which steps through the centuries to get there, except for extreme
+  // times, where we perform two additions in the civil_second domain to
   // sidestep the chance of overflow in (unix_time + tt.utc_offset).
-  return {(civil_second() + unix_time) + tt.utc_offset,
-          tt.utc_offset, tt.is_dst, &abbreviations_[tt.abbr_index]};
+  const std::int_fast64_t kLimit = std::int_fast64_t{1} << 62;
+  const civil_second cs =
+      (unix_time > -kLimit && unix_time < kLimit)
+          ? detail::time_zone_era::civil_at(unix_time + tt.utc_offset)
+          : (civil_second() + unix_time) + tt.utc_offset;
+  return {cs, tt.utc_offset, tt.is_dst, tab_.abbreviations + tt.abbr_index};
 }
 
 // BreakTime() translation for a particular transition.
 time_zone::absolute_lookup TimeZoneInfo::LocalTime(
     std::int_fast64_t unix_time, const Transition& tr) const {
-  const TransitionType& tt = transition_types_[tr.type_index];
+  const TransitionType& tt = tab_.transition_types[tr.type_index];
   // Note: (unix_time - tr.unix_time) will never overflow as we
   // have ensured that there is always a "nearby" transition.
   return {tr.civil_sec + (unix_time - tr.unix_time),  // TODO: Optimize.
-          tt.utc_offset, tt.is_dst, &abbreviations_[tt.abbr_index]};
+          tt.utc_offset, tt.is_dst, tab_.abbreviations + tt.abbr_index};
+}
+
+// The parts of transition i. A compact zone stores only the unix_time and
+// type_index, so we derive the civil times from those. The kCompact forms
+// let MakeTime() decide that only once.
+inline std::uint_fast8_t TimeZoneInfo::TypeIndexAt(std::size_t i) const {
+  return tab_.transitions != nullptr ? tab_.transitions[i].type_index
+                                     : tab_.type_indexes[i];
+}
+
+template <bool kCompact>
+inline civil_second TimeZoneInfo::CivilSecAt(std::size_t i) const {
+  if (!kCompact) return tab_.transitions[i].civil_sec;
+  civil_second cs;
+  if (CivilFromKey(tab_.civil_keys[i], &cs)) return cs;
+  const TransitionType& tt(tab_.transition_types[tab_.type_indexes[i]]);
+  return LocalTime(tab_.unix_times[i], tt).cs;
+}
+
+inline civil_second TimeZoneInfo::CivilSecAt(std::size_t i) const {
+  return tab_.transitions != nullptr ? CivilSecAt<false>(i)
+                                     : CivilSecAt<true>(i);
+}
+
+inline civil_second TimeZoneInfo::PrevCivilSecAt(std::size_t i) const {
+  if (tab_.transitions != nullptr) return tab_.transitions[i].prev_civil_sec;
+  const std::uint_fast8_t prev_type_index =
+      (i == 0) ? default_transition_type_ : tab_.type_indexes[i - 1];
+  const TransitionType* types = tab_.transition_types;
+  return CivilSecAt<true>(i) + (types[prev_type_index].utc_offset -
+                                types[tab_.type_indexes[i]].utc_offset - 1);
+}
+
+template <bool kCompact>
+inline const Transition& TimeZoneInfo::TransitionAt(std::size_t i,
+                                                    Transition* buf) const {
+  if (!kCompact) return tab_.transitions[i];
+  buf->unix_time = tab_.unix_times[i];
+  buf->type_index = tab_.type_indexes[i];
+  buf->civil_sec = CivilSecAt<true>(i);
+  buf->prev_civil_sec = PrevCivilSecAt(i);
+  return *buf;
+}
+
+inline const Transition& TimeZoneInfo::TransitionAt(std::size_t i,
+                                                    Transition* buf) const {
+  return tab_.transitions != nullptr ? TransitionAt<false>(i, buf)
+                                     : TransitionAt<true>(i, buf);
+}
+
+// BreakTime() translation for the transition at the given index.
+inline time_zone::absolute_lookup TimeZoneInfo::LocalTimeAt(
+    std::int_fast64_t unix_time, std::size_t i, std::size_t* abbr_len) const {
+  if (tab_.transitions != nullptr) {
+    const Transition& tr = tab_.transitions[i];
+    *abbr_len = tab_.transition_types[tr.type_index].abbr_len;
+    return LocalTime(unix_time, tr);
+  }
+  const TransitionType& tt(tab_.transition_types[tab_.type_indexes[i]]);
+  *abbr_len = tt.abbr_len;
+  return {CivilSecAt<true>(i) + (unix_time - tab_.unix_times[i]), tt.utc_offset,
+          tt.is_dst, tab_.abbreviations + tt.abbr_index};
 }
 
 // MakeTime() translation with a conversion-preserving +N * 400-year shift.
 time_zone::civil_lookup TimeZoneInfo::TimeLocal(const civil_second& cs,
-                                                year_t c4_shift) const {
+                                                year_t c4_shift,
+                                                std::size_t* hint) const {
   assert(last_year_ - 400 < cs.year() && cs.year() <= last_year_);
-  time_zone::civil_lookup cl = MakeTime(cs);
+  time_zone::civil_lookup cl = TimeZoneInfo::MakeTime(cs, hint);
   if (c4_shift > seconds::max().count() / kSecsPer400Years) {
     cl.pre = cl.trans = cl.post = time_point<seconds>::max();
   } else {
@@ -851,188 +1549,562 @@ time_zone::civil_lookup TimeZoneInfo::TimeLocal(const civil_second& cs,
 
 time_zone::absolute_lookup TimeZoneInfo::BreakTime(
     const time_point<seconds>& tp) const {
+  std::size_t hint = local_time_hint_.load(std::memory_order_relaxed);
+  const std::size_t prev_hint = hint;
+  const time_zone::absolute_lookup al = TimeZoneInfo::BreakTime(tp, &hint);
+  if (hint != prev_hint) {
+    local_time_hint_.store(hint, std::memory_order_relaxed);
+  }
+  return al;
+}
+
+void TimeZoneInfo::BreakTime(const time_point<seconds>* tps, std::size_t n,
+                             time_zone::absolute_lookup* als) const {
+  // A single hint is threaded through the whole batch, so when the input
+  // is sorted we usually just walk forward through the transitions.
+  std::size_t hint = local_time_hint_.load(std::memory_order_relaxed);
+  for (std::size_t i = 0; i != n; ++i) {
+    als[i] = TimeZoneInfo::BreakTime(tps[i], &hint);
+  }
+  local_time_hint_.store(hint, std::memory_order_relaxed);
+}
+
+time_zone::absolute_lookup TimeZoneInfo::BreakTime(
+    const time_point<seconds>& tp, std::size_t* hint) const {
+  std::size_t abbr_len;
+  return TimeZoneInfo::BreakTime(tp, hint, &abbr_len);
+}
+
+time_zone::absolute_lookup TimeZoneInfo::BreakTimeAbbr(
+    const time_point<seconds>& tp, std::size_t* abbr_len) const {
+  std::size_t hint = local_time_hint_.load(std::memory_order_relaxed);
+  const std::size_t prev_hint = hint;
+  const time_zone::absolute_lookup al =
+      TimeZoneInfo::BreakTime(tp, &hint, abbr_len);
+  if (hint != prev_hint) {
+    local_time_hint_.store(hint, std::memory_order_relaxed);
+  }
+  return al;
+}
+
+time_zone::absolute_lookup TimeZoneInfo::BreakTime(
+    const time_point<seconds>& tp, std::size_t* hint,
+    std::size_t* abbr_len) const {
   std::int_fast64_t unix_time = ToUnixSeconds(tp);
-  const std::size_t timecnt = transitions_.size();
+  const std::size_t timecnt = tab_.timecnt;
   assert(timecnt != 0);  // We always add a transition.
+  const std::int_least64_t* unix_times = tab_.unix_times;
 
-  if (unix_time < transitions_[0].unix_time) {
-    return LocalTime(unix_time, transition_types_[default_transition_type_]);
+  if (unix_time < unix_times[0]) {
+    const TransitionType& tt(tab_.transition_types[default_transition_type_]);
+    *abbr_len = tt.abbr_len;
+    return LocalTime(unix_time, tt);
   }
-  if (unix_time >= transitions_[timecnt - 1].unix_time) {
+  if (unix_time >= unix_times[timecnt - 1]) {
+    if (extendable_) {
+      return Future()->TimeZoneInfo::BreakTime(tp, hint, abbr_len);
+    }
     // After the last transition. If we extended the transitions using
     // future_spec_, shift back to a supported year using the 400-year
     // cycle of calendaric equivalence and then compensate accordingly.
     if (extended_) {
-      const std::int_fast64_t diff =
-          unix_time - transitions_[timecnt - 1].unix_time;
+      const std::int_fast64_t diff = unix_time - unix_times[timecnt - 1];
       const year_t shift = diff / kSecsPer400Years + 1;
       const auto d = seconds(shift * kSecsPer400Years);
-      time_zone::absolute_lookup al = BreakTime(tp - d);
+      Count(&break_counters_.shifts);
+      time_zone::absolute_lookup al =
+          TimeZoneInfo::BreakTime(tp - d, hint, abbr_len);
       al.cs = YearShift(al.cs, shift * 400);
       return al;
     }
-    return LocalTime(unix_time, transitions_[timecnt - 1]);
+    return LocalTimeAt(unix_time, timecnt - 1, abbr_len);
   }
 
-  const std::size_t hint = local_time_hint_.load(std::memory_order_relaxed);
-  if (0 < hint && hint < timecnt) {
-    if (transitions_[hint - 1].unix_time <= unix_time) {
-      if (unix_time < transitions_[hint].unix_time) {
-        return LocalTime(unix_time, transitions_[hint - 1]);
+  const std::size_t h = *hint;
+  if (0 < h && h < timecnt) {
+    if (unix_times[h - 1] <= unix_time) {
+      if (unix_time < unix_times[h]) {
+        Count(&break_counters_.hint_hits);
+        return LocalTimeAt(unix_time, h - 1, abbr_len);
+      }
+      // Sorted input often moves on to the very next transition.
+      if (h + 1 < timecnt && unix_time < unix_times[h + 1]) {
+        Count(&break_counters_.hint_hits);
+        *hint = h + 1;
+        return LocalTimeAt(unix_time, h, abbr_len);
       }
     }
   }
+  Count(&break_counters_.hint_misses);
+
+  if (extended_ && unix_time >= unix_times[extended_index_]) {
+    // Within the two-transitions-per-year span, so estimate the index
+    // from the elapsed years, and then correct it by a step or two.
+    const std::int_fast64_t years =
+        (unix_time - unix_times[extended_index_]) / kSecsPerAvgYear;
+    const std::size_t guess =
+        extended_index_ + 1 + 2 * static_cast<std::size_t>(years);
+    *hint = UpperBoundFrom(unix_times, extended_index_, timecnt - 1, guess,
+                           unix_time);
+    return LocalTimeAt(unix_time, *hint - 1, abbr_len);
+  }
 
-  const Transition target = {unix_time, 0, civil_second(), civil_second()};
-  const Transition* begin = &transitions_[0];
-  const Transition* tr = std::upper_bound(begin, begin + timecnt, target,
-                                          Transition::ByUnixTime());
-  local_time_hint_.store(static_cast<std::size_t>(tr - begin),
-                         std::memory_order_relaxed);
-  return LocalTime(unix_time, *--tr);
+  Count(&break_counters_.searches);
+  const std::int_least64_t* ut =
+      std::upper_bound(unix_times, unix_times + timecnt, unix_time);
+  *hint = static_cast<std::size_t>(ut - unix_times);
+  return LocalTimeAt(unix_time, *hint - 1, abbr_len);
 }
 
 time_zone::civil_lookup TimeZoneInfo::MakeTime(const civil_second& cs) const {
-  const std::size_t timecnt = transitions_.size();
+  std::size_t hint = time_local_hint_.load(std::memory_order_relaxed);
+  const std::size_t prev_hint = hint;
+  const time_zone::civil_lookup cl = TimeZoneInfo::MakeTime(cs, &hint);
+  if (hint != prev_hint) {
+    time_local_hint_.store(hint, std::memory_order_relaxed);
+  }
+  return cl;
+}
+
+void TimeZoneInfo::MakeTime(const civil_second* css, std::size_t n,
+                            time_zone::civil_lookup* cls) const {
+  if (n == 0) return;
+  const std::size_t timecnt = tab_.timecnt;
+  assert(timecnt != 0);  // We always add a transition.
+  std::size_t hint = time_local_hint_.load(std::memory_order_relaxed);
+
+  civil_second lo = css[0];
+  civil_second hi = css[0];
+  for (std::size_t i = 1; i != n; ++i) {
+    if (css[i] < lo) lo = css[i];
+    if (hi < css[i]) hi = css[i];
+  }
+  if (extendable_ && CivilKey(lo) >= tab_.civil_keys[timecnt - 1]) {
+    return Future()->TimeZoneInfo::MakeTime(css, n, cls);
+  }
+
+  // If the whole batch falls strictly between two transitions, where no
+  // civil time is skipped or repeated, then every result is UNIQUE and we
+  // can convert using the earlier transition alone.
+  if (CivilSecAt(0) <= lo && hi < CivilSecAt(timecnt - 1)) {
+    const std::int_least64_t* civil_keys = tab_.civil_keys;
+    const std::int_fast64_t lo_key = CivilKey(lo);
+    std::size_t h = hint;
+    if (h == 0 || h >= timecnt || lo_key < civil_keys[h - 1] ||
+        civil_keys[h] <= lo_key) {
+      Count(&make_counters_.hint_misses);
+      Count(&make_counters_.searches);
+      h = static_cast<std::size_t>(
+          std::upper_bound(civil_keys, civil_keys + timecnt, lo_key) -
+          civil_keys);
+    }
+    Transition prev_buf;
+    Transition next_buf;
+    const Transition& prev = TransitionAt(h - 1, &prev_buf);
+    const Transition& next = TransitionAt(h, &next_buf);
+    if (prev.prev_civil_sec < lo && hi < next.civil_sec &&
+        hi <= next.prev_civil_sec) {
+      if (h == hint) Count(&make_counters_.hint_hits);
+      for (std::size_t i = 0; i != n; ++i) {
+        cls[i] = MakeUnique(prev.unix_time + (css[i] - prev.civil_sec));
+      }
+      time_local_hint_.store(h, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  for (std::size_t i = 0; i != n; ++i) {
+    cls[i] = TimeZoneInfo::MakeTime(css[i], &hint);
+  }
+  time_local_hint_.store(hint, std::memory_order_relaxed);
+}
+
+time_zone::civil_lookup TimeZoneInfo::MakeTime(const civil_second& cs,
+                                               std::size_t* hint) const {
+  const std::int_fast64_t key = CivilKey(cs);
+  return tab_.transitions != nullptr ? MakeTime<false>(cs, key, hint)
+                                     : MakeTime<true>(cs, key, hint);
+}
+
+template <bool kCompact>
+time_zone::civil_lookup TimeZoneInfo::MakeTime(const civil_second& cs,
+                                               std::int_fast64_t key,
+                                               std::size_t* hint) const {
+  const std::size_t timecnt = tab_.timecnt;
   assert(timecnt != 0);  // We always add a transition.
 
   // Find the first transition after our target civil time.
-  const Transition* tr = nullptr;
-  const Transition* begin = &transitions_[0];
-  const Transition* end = begin + timecnt;
-  if (cs < begin->civil_sec) {
-    tr = begin;
-  } else if (cs >= transitions_[timecnt - 1].civil_sec) {
-    tr = end;
+  const std::int_least64_t* civil_keys = tab_.civil_keys;
+  std::size_t i;
+  if (key < civil_keys[0]) {
+    i = 0;
+  } else if (key >= civil_keys[timecnt - 1]) {
+    // Future() starts with our last transition, so it handles all of the
+    // civil times from that one on.
+    if (extendable_) return Future()->MakeTime<kCompact>(cs, key, hint);
+    i = timecnt;
   } else {
-    const std::size_t hint = time_local_hint_.load(std::memory_order_relaxed);
-    if (0 < hint && hint < timecnt) {
-      if (transitions_[hint - 1].civil_sec <= cs) {
-        if (cs < transitions_[hint].civil_sec) {
-          tr = begin + hint;
+    i = 0;  // not yet found, as the answer cannot be 0 here
+    const std::size_t h = *hint;
+    if (0 < h && h < timecnt) {
+      if (civil_keys[h - 1] <= key) {
+        if (key < civil_keys[h]) {
+          i = h;
+        } else if (h + 1 < timecnt && key < civil_keys[h + 1]) {
+          // Sorted input often moves on to the very next transition.
+          i = h + 1;
+          *hint = h + 1;
         }
       }
     }
-    if (tr == nullptr) {
-      const Transition target = {0, 0, cs, civil_second()};
-      tr = std::upper_bound(begin, end, target, Transition::ByCivilTime());
-      time_local_hint_.store(static_cast<std::size_t>(tr - begin),
-                             std::memory_order_relaxed);
+    if (i != 0) {
+      Count(&make_counters_.hint_hits);
+    } else {
+      Count(&make_counters_.hint_misses);
+      if (extended_ && key >= civil_keys[extended_index_]) {
+        // Within the two-transitions-per-year span, so estimate the index
+        // from the year, and then correct it by a step or two.
+        const year_t years = std::max(cs.year() - extended_year_, year_t{0});
+        const std::size_t guess =
+            extended_index_ + 1 + 2 * static_cast<std::size_t>(years);
+        *hint = UpperBoundFrom(civil_keys, extended_index_, timecnt - 1,
+                               guess, key);
+      } else {
+        Count(&make_counters_.searches);
+        const std::int_least64_t* ck =
+            std::upper_bound(civil_keys, civil_keys + timecnt, key);
+        *hint = static_cast<std::size_t>(ck - civil_keys);
+      }
+      i = *hint;
     }
   }
 
-  if (tr == begin) {
-    if (tr->prev_civil_sec >= cs) {
+  Transition buf;
+  if (i == 0) {
+    const Transition& tr = TransitionAt<kCompact>(0, &buf);
+    if (tr.prev_civil_sec >= cs) {
       // Before first transition, so use the default offset.
-      const TransitionType& tt(transition_types_[default_transition_type_]);
+      const TransitionType& tt(tab_.transition_types[default_transition_type_]);
       if (cs < tt.civil_min) return MakeUnique(time_point<seconds>::min());
       return MakeUnique(cs - (civil_second() + tt.utc_offset));
     }
-    // tr->prev_civil_sec < cs < tr->civil_sec
-    return MakeSkipped(*tr, cs);
+    // tr.prev_civil_sec < cs < tr.civil_sec
+    return MakeSkipped(tr, cs);
   }
 
-  if (tr == end) {
-    if (cs > (--tr)->prev_civil_sec) {
+  if (i == timecnt) {
+    const Transition& tr = TransitionAt<kCompact>(timecnt - 1, &buf);
+    if (cs > tr.prev_civil_sec) {
       // After the last transition. If we extended the transitions using
       // future_spec_, shift back to a supported year using the 400-year
       // cycle of calendaric equivalence and then compensate accordingly.
       if (extended_ && cs.year() > last_year_) {
         const year_t shift = (cs.year() - last_year_ - 1) / 400 + 1;
-        return TimeLocal(YearShift(cs, shift * -400), shift);
+        Count(&make_counters_.shifts);
+        return TimeLocal(YearShift(cs, shift * -400), shift, hint);
       }
-      const TransitionType& tt(transition_types_[tr->type_index]);
+      const TransitionType& tt(tab_.transition_types[tr.type_index]);
       if (cs > tt.civil_max) return MakeUnique(time_point<seconds>::max());
-      return MakeUnique(tr->unix_time + (cs - tr->civil_sec));
+      return MakeUnique(tr.unix_time + (cs - tr.civil_sec));
+    }
+    // tr.civil_sec <= cs <= tr.prev_civil_sec
+    return MakeRepeated(tr, cs);
+  }
+
+  if (kCompact) {
+    // Classifies cs using the offsets on either side of the transitions,
+    // rather than deriving their civil times.
+    const TransitionType* types = tab_.transition_types;
+    const std::int_fast64_t offset = types[tab_.type_indexes[i - 1]].utc_offset;
+    const std::int_fast64_t unix_time = (cs - civil_second()) - offset;
+    if (unix_time >= tab_.unix_times[i]) {
+      return MakeSkipped(TransitionAt<kCompact>(i, &buf), cs);
+    }
+    const std::uint_fast8_t prev_type_index =
+        (i == 1) ? default_transition_type_ : tab_.type_indexes[i - 2];
+    if (unix_time - tab_.unix_times[i - 1] <
+        types[prev_type_index].utc_offset - offset) {
+      return MakeRepeated(TransitionAt<kCompact>(i - 1, &buf), cs);
     }
-    // tr->civil_sec <= cs <= tr->prev_civil_sec
-    return MakeRepeated(*tr, cs);
+    return MakeUnique(unix_time);
   }
 
-  if (tr->prev_civil_sec < cs) {
-    // tr->prev_civil_sec < cs < tr->civil_sec
-    return MakeSkipped(*tr, cs);
+  const Transition& tr = TransitionAt<kCompact>(i, &buf);
+  if (tr.prev_civil_sec < cs) {
+    // tr.prev_civil_sec < cs < tr.civil_sec
+    return MakeSkipped(tr, cs);
   }
 
-  if (cs <= (--tr)->prev_civil_sec) {
-    // tr->civil_sec <= cs <= tr->prev_civil_sec
-    return MakeRepeated(*tr, cs);
+  const Transition& prev = TransitionAt<kCompact>(i - 1, &buf);
+  if (cs <= prev.prev_civil_sec) {
+    // prev.civil_sec <= cs <= prev.prev_civil_sec
+    return MakeRepeated(prev, cs);
   }
 
   // In between transitions.
-  return MakeUnique(tr->unix_time + (cs - tr->civil_sec));
+  return MakeUnique(prev.unix_time + (cs - prev.civil_sec));
 }
 
-std::string TimeZoneInfo::Version() const {
+const std::string& TimeZoneInfo::Version() const {
   return version_;
 }
 
-std::string TimeZoneInfo::Description() const {
-  std::ostringstream oss;
-  oss << "#trans=" << transitions_.size();
-  oss << " #types=" << transition_types_.size();
-  oss << " spec='" << future_spec_ << "'";
-  return oss.str();
+// The description is built on first use, as the zone is complete by then.
+const std::string& TimeZoneInfo::Description() const {
+  std::call_once(description_once_, [this]() {
+    std::ostringstream oss;
+    oss << "#trans=" << tab_.timecnt;
+    oss << " #types=" << tab_.typecnt;
+    oss << " spec='" << future_spec_ << "'";
+    description_ = oss.str();
+  });
+  return description_;
+}
+
+void TimeZoneInfo::LookupCounters::AddTo(
+    time_zone_stats::lookup_counts* counts) const {
+  counts->hint_hits += hint_hits.load(std::memory_order_relaxed);
+  counts->hint_misses += hint_misses.load(std::memory_order_relaxed);
+  counts->searches += searches.load(std::memory_order_relaxed);
+  counts->shifts += shifts.load(std::memory_order_relaxed);
+}
+
+void TimeZoneInfo::Stats(time_zone_stats* stats) const {
+  break_counters_.AddTo(&stats->absolute);
+  make_counters_.AddTo(&stats->civil);
+  stats->load_nanos += load_nanos_;
+  stats->extend_nanos += extend_nanos_.load(std::memory_order_relaxed);
+  stats->bytes_read += bytes_read_;
+  stats->transitions += tab_.timecnt;
+  if (const TimeZoneInfo* future = future_.load(std::memory_order_acquire)) {
+    future->break_counters_.AddTo(&stats->absolute);
+    future->make_counters_.AddTo(&stats->civil);
+    stats->transitions += future->tab_.timecnt - 1;  // shares our last one
+  }
+}
+
+// Era() after the last transition of an extendable zone, which is what
+// Future() would give, but taken from that last transition and the rule's
+// transitions (those that follow it) for the years around unix_time.
+bool TimeZoneInfo::RuleEra(std::int_fast64_t unix_time, ZoneEra* era) const {
+  const year_t year = (civil_second() + unix_time).year();
+  if (year + 1 > last_year_) return false;
+  Transition trs[1 + 3 * 2];
+  std::size_t n = 0;
+  trs[n].unix_time = tab_.unix_times[tab_.timecnt - 1];
+  trs[n++].type_index = TypeIndexAt(tab_.timecnt - 1);
+  for (year_t y = year - 1; y <= year + 1; ++y) {
+    Transition rule_trs[2];
+    RuleTransitions(y, rule_trs);
+    for (const Transition& tr : rule_trs) {
+      if (tr.unix_time > trs[0].unix_time) trs[n++] = tr;
+    }
+  }
+  std::size_t i = 0;  // the transition that begins the era
+  while (i + 1 != n && trs[i + 1].unix_time <= unix_time) ++i;
+  if (i + 1 == n) return false;
+  const TransitionType& tt(tab_.transition_types[trs[i].type_index]);
+  era->begin = FromUnixSeconds(trs[i].unix_time);
+  era->end = FromUnixSeconds(trs[i + 1].unix_time);
+  era->offset = tt.utc_offset;
+  era->is_dst = tt.is_dst;
+  era->abbr = tab_.abbreviations + tt.abbr_index;
+  era->abbr_len = tt.abbr_len;
+  return true;
+}
+
+bool TimeZoneInfo::Era(const time_point<seconds>& tp, ZoneEra* era) const {
+  const std::int_fast64_t unix_time = ToUnixSeconds(tp);
+  const std::size_t timecnt = tab_.timecnt;
+  const std::int_least64_t* unix_times = tab_.unix_times;
+  // The open-ended first and last eras stop short of any overflow in
+  // their lookups.
+  const std::int_fast64_t kEraLimit = std::int_fast64_t{1} << 59;
+  if (unix_time < unix_times[0]) {
+    if (unix_time < -kEraLimit) return false;
+    const TransitionType& tt(tab_.transition_types[default_transition_type_]);
+    era->begin = FromUnixSeconds(-kEraLimit);
+    era->end = FromUnixSeconds(unix_times[0]);
+    era->offset = tt.utc_offset;
+    era->is_dst = tt.is_dst;
+    era->abbr = tab_.abbreviations + tt.abbr_index;
+    era->abbr_len = tt.abbr_len;
+    return true;
+  }
+  std::size_t i = timecnt;  // the transition that ends the era
+  if (unix_time >= unix_times[timecnt - 1]) {
+    if (extendable_) {
+      // Rather than build Future() for this, use the rule directly.
+      if (const TimeZoneInfo* future = future_.load(std::memory_order_acquire))
+        return future->TimeZoneInfo::Era(tp, era);
+      return RuleEra(unix_time, era);
+    }
+    if (extended_ || unix_time >= kEraLimit) return false;  // shifted years
+  } else {
+    i = static_cast<std::size_t>(
+        std::upper_bound(unix_times, unix_times + timecnt, unix_time) -
+        unix_times);
+  }
+  const TransitionType& tt(tab_.transition_types[TypeIndexAt(i - 1)]);
+  era->begin = FromUnixSeconds(unix_times[i - 1]);
+  era->end = FromUnixSeconds(i == timecnt ? kEraLimit : unix_times[i]);
+  era->offset = tt.utc_offset;
+  era->is_dst = tt.is_dst;
+  era->abbr = tab_.abbreviations + tt.abbr_index;
+  era->abbr_len = tt.abbr_len;
+  return true;
+}
+
+// Only the tables that both layouts keep are hashed, so that a compact
+// zone and a full one with the same rules hash alike.
+std::size_t TimeZoneInfo::TablesHash() const {
+  std::size_t hash = std::hash<std::string>()(
+      std::string(tab_.abbreviations, tab_.abbrlen));
+  for (std::size_t i = 0; i != tab_.timecnt; ++i) {
+    MixHash(&hash, tab_.unix_times[i]);
+    MixHash(&hash, TypeIndexAt(i));
+  }
+  for (std::size_t i = 0; i != tab_.typecnt; ++i) {
+    const TransitionType& tt = tab_.transition_types[i];
+    MixHash(&hash, tt.utc_offset);
+    MixHash(&hash, tt.is_dst);
+    MixHash(&hash, tt.abbr_index);
+  }
+  return hash;
+}
+
+// A zone that was not read from a file in ${TZDIR}, or whose file could
+// not be stamped, may have changed for all we know.
+bool TimeZoneInfo::SourceChanged() const {
+  if (!stamp_.exists) return true;
+  return !(StampFile(path_) == stamp_);
 }
 
 bool TimeZoneInfo::NextTransition(const time_point<seconds>& tp,
                                   time_zone::civil_transition* trans) const {
-  if (transitions_.empty()) return false;
-  const Transition* begin = &transitions_[0];
-  const Transition* end = begin + transitions_.size();
-  if (begin->unix_time <= -(1LL << 59)) {
+  time_point<seconds> at;
+  std::size_t hint = 0;
+  return NextTransition(tp, trans, &at, &hint);
+}
+
+bool TimeZoneInfo::PrevTransition(const time_point<seconds>& tp,
+                                  time_zone::civil_transition* trans) const {
+  time_point<seconds> at;
+  std::size_t hint = 0;
+  return PrevTransition(tp, trans, &at, &hint);
+}
+
+// A hint is one more than the position that the last search found in the
+// transitions, or, when that was among the Future() transitions, one more
+// than the count of our transitions plus Future()'s own hint. So a walk
+// over the transitions carries on into those of the Future() zone (and
+// back), without searching again.
+bool TimeZoneInfo::NextTransition(const time_point<seconds>& tp,
+                                  time_zone::civil_transition* trans,
+                                  time_point<seconds>* at,
+                                  std::size_t* hint) const {
+  if (tab_.timecnt == 0) return false;
+  const std::int_least64_t* unix_times = tab_.unix_times;
+  std::size_t begin = 0;
+  const std::size_t end = tab_.timecnt;
+  if (unix_times[begin] <= -(1LL << 59)) {
     // Do not report the BIG_BANG found in some zoneinfo data as it is
     // really a sentinel, not a transition.  See pre-2018f tz/zic.c.
     ++begin;
   }
   std::int_fast64_t unix_time = ToUnixSeconds(tp);
-  const Transition target = {unix_time, 0, civil_second(), civil_second()};
-  const Transition* tr = std::upper_bound(begin, end, target,
-                                          Transition::ByUnixTime());
-  for (; tr != end; ++tr) {  // skip no-op transitions
+  std::size_t i = *hint - 1;  // where the hint puts the upper bound
+  if (*hint > end + 1 && unix_time >= unix_times[end - 1]) {
+    i = end;  // still among the Future() transitions
+  } else if (*hint == 0 || i < begin || i > end ||
+             (i != begin && unix_times[i - 1] > unix_time) ||
+             (i != end && unix_times[i] <= unix_time)) {
+    i = static_cast<std::size_t>(
+        std::upper_bound(unix_times + begin, unix_times + end, unix_time) -
+        unix_times);
+  }
+  for (; i != end; ++i) {  // skip no-op transitions
     std::uint_fast8_t prev_type_index =
-        (tr == begin) ? default_transition_type_ : tr[-1].type_index;
-    if (!EquivTransitions(prev_type_index, tr[0].type_index)) break;
+        (i == begin) ? default_transition_type_ : TypeIndexAt(i - 1);
+    const auto* types = tab_.transition_types;
+    if (!EquivTransitions(types, prev_type_index, TypeIndexAt(i))) break;
+  }
+  if (i == end && extendable_) {
+    std::size_t future_hint = (*hint > end + 1) ? *hint - (end + 1) : 0;
+    if (!Future()->NextTransition(tp, trans, at, &future_hint)) return false;
+    *hint = end + 1 + future_hint;
+    return true;
   }
-  // When tr == end we return false, ignoring future_spec_.
-  if (tr == end) return false;
-  trans->from = tr->prev_civil_sec + 1;
-  trans->to = tr->civil_sec;
+  // When i == end we return false, ignoring future_spec_.
+  if (i == end) return false;
+  trans->from = PrevCivilSecAt(i) + 1;
+  trans->to = CivilSecAt(i);
+  *at = FromUnixSeconds(unix_times[i]);
+  *hint = i + 2;  // the upper bound of *at
   return true;
 }
 
 bool TimeZoneInfo::PrevTransition(const time_point<seconds>& tp,
-                                  time_zone::civil_transition* trans) const {
-  if (transitions_.empty()) return false;
-  const Transition* begin = &transitions_[0];
-  const Transition* end = begin + transitions_.size();
-  if (begin->unix_time <= -(1LL << 59)) {
+                                  time_zone::civil_transition* trans,
+                                  time_point<seconds>* at,
+                                  std::size_t* hint) const {
+  if (tab_.timecnt == 0) return false;
+  const std::int_least64_t* unix_times = tab_.unix_times;
+  std::size_t begin = 0;
+  std::size_t end = tab_.timecnt;
+  if (unix_times[begin] <= -(1LL << 59)) {
     // Do not report the BIG_BANG found in some zoneinfo data as it is
     // really a sentinel, not a transition.  See pre-2018f tz/zic.c.
     ++begin;
   }
+  std::size_t future_hint = (*hint > end + 1) ? *hint - (end + 1) : 0;
   std::int_fast64_t unix_time = ToUnixSeconds(tp);
   if (FromUnixSeconds(unix_time) != tp) {
     if (unix_time == std::numeric_limits<std::int_fast64_t>::max()) {
+      if (extendable_) {
+        if (!Future()->PrevTransition(tp, trans, at, &future_hint))
+          return false;
+        *hint = end + 1 + future_hint;
+        return true;
+      }
       if (end == begin) return false;  // Ignore future_spec_.
-      trans->from = (--end)->prev_civil_sec + 1;
-      trans->to = end->civil_sec;
+      --end;
+      trans->from = PrevCivilSecAt(end) + 1;
+      trans->to = CivilSecAt(end);
+      *at = FromUnixSeconds(unix_times[end]);
+      *hint = end + 1;
       return true;
     }
     unix_time += 1;  // ceils
   }
-  const Transition target = {unix_time, 0, civil_second(), civil_second()};
-  const Transition* tr = std::lower_bound(begin, end, target,
-                                          Transition::ByUnixTime());
-  for (; tr != begin; --tr) {  // skip no-op transitions
+  std::size_t i = *hint - 1;  // where the hint puts the lower bound
+  if (*hint > end + 1 && unix_time > unix_times[end - 1]) {
+    i = end;  // still among the Future() transitions
+  } else if (*hint == 0 || i < begin || i > end ||
+             (i != begin && unix_times[i - 1] >= unix_time) ||
+             (i != end && unix_times[i] < unix_time)) {
+    i = static_cast<std::size_t>(
+        std::lower_bound(unix_times + begin, unix_times + end, unix_time) -
+        unix_times);
+  }
+  if (i == end && extendable_ &&
+      Future()->PrevTransition(tp, trans, at, &future_hint)) {
+    *hint = end + 1 + future_hint;
+    return true;
+  }
+  for (; i != begin; --i) {  // skip no-op transitions
     std::uint_fast8_t prev_type_index =
-        (tr - 1 == begin) ? default_transition_type_ : tr[-2].type_index;
-    if (!EquivTransitions(prev_type_index, tr[-1].type_index)) break;
+        (i - 1 == begin) ? default_transition_type_ : TypeIndexAt(i - 2);
+    const auto* types = tab_.transition_types;
+    if (!EquivTransitions(types, prev_type_index, TypeIndexAt(i - 1))) break;
   }
-  // When tr == end we return the "last" transition, ignoring future_spec_.
-  if (tr == begin) return false;
-  trans->from = (--tr)->prev_civil_sec + 1;
-  trans->to = tr->civil_sec;
+  // When i == end we return the "last" transition, ignoring future_spec_.
+  if (i == begin) return false;
+  --i;
+  trans->from = PrevCivilSecAt(i) + 1;
+  trans->to = CivilSecAt(i);
+  *at = FromUnixSeconds(unix_times[i]);
+  *hint = i + 1;  // the lower bound of *at
   return true;
 }
 
@@ -15,9 +15,15 @@
 #ifndef CCTZ_TIME_ZONE_INFO_H_
 #define CCTZ_TIME_ZONE_INFO_H_
 
+#if !defined(_WIN32)
+#include <sys/types.h>
+#endif
+
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -25,36 +31,55 @@
 #include "cctz/time_zone.h"
 #include "cctz/zone_info_source.h"
 #include "time_zone_if.h"
+#include "time_zone_posix.h"
+#include "time_zone_transition.h"
 #include "tzfile.h"
 
 namespace cctz {
 
-// A transition to a new UTC offset.
-struct Transition {
-  std::int_least64_t unix_time;   // the instant of this transition
-  std::uint_least8_t type_index;  // index of the transition type
-  civil_second civil_sec;         // local civil time of transition
-  civil_second prev_civil_sec;    // local civil time one second earlier
+class ZoneBundle;
+struct BundleZone;
+struct EmbeddedZone;
 
-  struct ByUnixTime {
-    inline bool operator()(const Transition& lhs, const Transition& rhs) const {
-      return lhs.unix_time < rhs.unix_time;
-    }
-  };
-  struct ByCivilTime {
-    inline bool operator()(const Transition& lhs, const Transition& rhs) const {
-      return lhs.civil_sec < rhs.civil_sec;
+// Identifies a version of a file, such that replacing or rewriting the
+// file (e.g., changing the system time zone) changes the stamp. On Windows
+// every file is stamped as missing.
+struct FileStamp {
+  bool exists = false;
+#if !defined(_WIN32)
+  dev_t dev = 0;
+  ino_t ino = 0;
+  off_t size = 0;
+  time_t mtime = 0;
+#endif
+
+  bool operator==(const FileStamp& other) const {
+#if !defined(_WIN32)
+    if (exists && other.exists) {
+      return dev == other.dev && ino == other.ino && size == other.size &&
+             mtime == other.mtime;
     }
-  };
+#endif
+    return exists == other.exists;
+  }
 };
 
-// The characteristics of a particular transition.
-struct TransitionType {
-  std::int_least32_t utc_offset;  // the new prevailing UTC offset
-  civil_second civil_max;         // max convertible civil time for offset
-  civil_second civil_min;         // min convertible civil time for offset
-  bool is_dst;                    // did we move into daylight-saving time
-  std::uint_least8_t abbr_index;  // index of the new abbreviation
+// Stamps the file at the path, following any symlink.
+FileStamp StampFile(const std::string& path);
+
+// The decoded tables of a zone. They are immutable once built, and are
+// shared by every TimeZoneInfo with identical contents (e.g., the links
+// to a zone). A compact zone (see use_compact_time_zones()) drops the
+// transitions, keeping only their unix_times and type_indexes.
+struct TimeZoneData {
+  std::vector<Transition> transitions;  // ordered by unix_time and civil_sec
+  std::vector<std::uint_least8_t> type_indexes;
+  // Dense copies of each transition's unix_time and civil_sec (as a 64-bit
+  // key) so that searches only touch the keys, not whole Transitions.
+  std::vector<std::int_least64_t> unix_times;
+  std::vector<std::int_least64_t> civil_keys;
+  std::vector<TransitionType> transition_types;  // distinct transition types
+  std::string abbreviations;  // all the NUL-terminated abbreviations
 };
 
 // A time zone backed by the IANA Time Zone Database (zoneinfo).
@@ -63,21 +88,66 @@ class TimeZoneInfo : public TimeZoneIf {
   TimeZoneInfo() = default;
   TimeZoneInfo(const TimeZoneInfo&) = delete;
   TimeZoneInfo& operator=(const TimeZoneInfo&) = delete;
+  ~TimeZoneInfo() override;
 
   // Loads the zoneinfo for the given name, returning true if successful.
   bool Load(const std::string& name);
 
+  // Appends the names of the zones listed in zone1970.tab, as provided by
+  // the ZoneInfoSource factory, returning false if there is no such file.
+  static bool ListZones(std::vector<std::string>* names);
+
+  // Returns the version that the ZoneInfoSource factory reports for its
+  // zoneinfo (taken from its source for "UTC"), or an empty string.
+  static std::string SourceVersion();
+
+  // Appends the lookup tables, and everything else needed to Load() them
+  // again, to a bundle file image, describing them in *zone.
+  void AppendToBundle(std::string* image, BundleZone* zone) const;
+
+  // Describes the loaded zone in *zone (except for its name), referring to
+  // the tables within this object, which must not be compact.
+  void Embed(EmbeddedZone* zone) const;
+
+  // Returns true if the two zones use the same tables (not merely equal
+  // ones), as happens when one zone is a link to the other.
+  bool SharesTables(const TimeZoneInfo& other) const {
+    return tab_.transition_types == other.tab_.transition_types;
+  }
+
   // TimeZoneIf implementations.
   time_zone::absolute_lookup BreakTime(
       const time_point<seconds>& tp) const override;
+  void BreakTime(const time_point<seconds>* tps, std::size_t n,
+                 time_zone::absolute_lookup* als) const override;
+  time_zone::absolute_lookup BreakTime(const time_point<seconds>& tp,
+                                       std::size_t* hint) const override;
+  time_zone::absolute_lookup BreakTimeAbbr(
+      const time_point<seconds>& tp, std::size_t* abbr_len) const override;
   time_zone::civil_lookup MakeTime(
       const civil_second& cs) const override;
+  void MakeTime(const civil_second* css, std::size_t n,
+                time_zone::civil_lookup* cls) const override;
+  time_zone::civil_lookup MakeTime(const civil_second& cs,
+                                   std::size_t* hint) const override;
   bool NextTransition(const time_point<seconds>& tp,
                       time_zone::civil_transition* trans) const override;
   bool PrevTransition(const time_point<seconds>& tp,
                       time_zone::civil_transition* trans) const override;
-  std::string Version() const override;
-  std::string Description() const override;
+  bool NextTransition(const time_point<seconds>& tp,
+                      time_zone::civil_transition* trans,
+                      time_point<seconds>* at,
+                      std::size_t* hint) const override;
+  bool PrevTransition(const time_point<seconds>& tp,
+                      time_zone::civil_transition* trans,
+                      time_point<seconds>* at,
+                      std::size_t* hint) const override;
+  const std::string& Version() const override;
+  const std::string& Description() const override;
+  void Stats(time_zone_stats* stats) const override;
+  bool Era(const time_point<seconds>& tp, ZoneEra* era) const override;
+  std::size_t TablesHash() const override;
+  bool SourceChanged() const override;
 
  private:
   struct Header {  // counts of:
@@ -94,36 +164,132 @@ class TimeZoneInfo : public TimeZoneIf {
 
   bool GetTransitionType(std::int_fast32_t utc_offset, bool is_dst,
                          const std::string& abbr, std::uint_least8_t* index);
-  bool EquivTransitions(std::uint_fast8_t tt1_index,
-                        std::uint_fast8_t tt2_index) const;
+  bool FindTransitionType(std::int_fast32_t utc_offset, bool is_dst,
+                          const std::string& abbr,
+                          std::uint_least8_t* index) const;
+  static bool EquivTransitions(const TransitionType* types,
+                               std::uint_fast8_t tt1_index,
+                               std::uint_fast8_t tt2_index);
   bool ExtendTransitions();
+  bool LoadFutureRule();
+  void RuleTransitions(year_t year, Transition* trs) const;
+  void ExtendFrom(const TimeZoneInfo& zone);
+  const TimeZoneInfo* Future() const;
+  bool RuleEra(std::int_fast64_t unix_time, ZoneEra* era) const;
+  bool FinishTransitions();
+  void BuildTables(bool compact);
 
   bool ResetToBuiltinUTC(const seconds& offset);
+  bool LoadNamed(const std::string& name);
   bool Load(ZoneInfoSource* zip);
+  bool Load(const ZoneBundle& bundle, const BundleZone& zone);
+  bool Load(const EmbeddedZone& zone);
+
+  // Accessors for the transition at an index, for use when it might not
+  // be stored in full (see TimeZoneData). TransitionAt() uses *buf when
+  // it has to reconstruct the whole transition.
+  std::uint_fast8_t TypeIndexAt(std::size_t i) const;
+  template <bool kCompact>
+  civil_second CivilSecAt(std::size_t i) const;
+  civil_second CivilSecAt(std::size_t i) const;
+  civil_second PrevCivilSecAt(std::size_t i) const;
+  template <bool kCompact>
+  const Transition& TransitionAt(std::size_t i, Transition* buf) const;
+  const Transition& TransitionAt(std::size_t i, Transition* buf) const;
+
+  // BreakTime(tp, hint), also giving the length of the abbreviation.
+  time_zone::absolute_lookup BreakTime(const time_point<seconds>& tp,
+                                       std::size_t* hint,
+                                       std::size_t* abbr_len) const;
 
   // Helpers for BreakTime() and MakeTime().
+  time_zone::absolute_lookup LocalTimeAt(std::int_fast64_t unix_time,
+                                         std::size_t i,
+                                         std::size_t* abbr_len) const;
   time_zone::absolute_lookup LocalTime(std::int_fast64_t unix_time,
                                        const TransitionType& tt) const;
   time_zone::absolute_lookup LocalTime(std::int_fast64_t unix_time,
                                        const Transition& tr) const;
-  time_zone::civil_lookup TimeLocal(const civil_second& cs,
-                                    year_t c4_shift) const;
+  time_zone::civil_lookup TimeLocal(const civil_second& cs, year_t c4_shift,
+                                    std::size_t* hint) const;
+  template <bool kCompact>
+  time_zone::civil_lookup MakeTime(const civil_second& cs,
+                                   std::int_fast64_t key,  // CivilKey(cs)
+                                   std::size_t* hint) const;
 
-  std::vector<Transition> transitions_;  // ordered by unix_time and civil_sec
-  std::vector<TransitionType> transition_types_;  // distinct transition types
+  // The tables as they are being loaded, which BuildTables() then moves
+  // into data_ (see TimeZoneData).
+  std::vector<Transition> transitions_;
+  std::vector<TransitionType> transition_types_;
   std::uint_fast8_t default_transition_type_;  // for before first transition
-  std::string abbreviations_;  // all the NUL-terminated abbreviations
+  std::string abbreviations_;
+  std::shared_ptr<const TimeZoneData> data_;
+
+  // The tables that lookups use, which refer either to data_, or to the
+  // same tables in place within a mapped ZoneBundle or an EmbeddedZone.
+  struct Tables {
+    const Transition* transitions;  // null for a compact zone
+    const std::uint_least8_t* type_indexes;  // [timecnt], if compact
+    std::size_t timecnt;
+    const std::int_least64_t* unix_times;  // [timecnt]
+    const std::int_least64_t* civil_keys;  // [timecnt]
+    const TransitionType* transition_types;
+    std::size_t typecnt;
+    const char* abbreviations;
+    std::size_t abbrlen;
+  };
+  Tables tab_ = {};
 
   std::string version_;      // the tzdata version if available
+  std::string path_;         // the file in ${TZDIR} for the zone's name
+  FileStamp stamp_;          // of path_, taken before the zone was read
   std::string future_spec_;  // for after the last zic transition
+  mutable std::once_flag description_once_;
+  mutable std::string description_;  // built by Description()
+  bool extendable_;          // use Future() after the last transition
   bool extended_;            // future_spec_ was used to generate transitions
   year_t last_year_;         // the final year of the generated transitions
+  std::size_t extended_index_;  // first of the two-per-year transitions
+  year_t extended_year_;        // the year of transitions_[extended_index_]
+
+  // The DST rule of future_spec_, from which Future() is generated.
+  struct FutureRule {
+    PosixTransition dst_start;
+    PosixTransition dst_end;
+    std::int_least32_t std_offset;
+    std::int_least32_t dst_offset;
+    std::uint_least8_t std_type_index;
+    std::uint_least8_t dst_type_index;
+  };
+  FutureRule rule_;
+
+  // The 400 years of transitions that future_spec_ generates, as a zone
+  // of their own, which is only built (and then published through this
+  // pointer, so that readers need no lock) when a lookup first needs it.
+  mutable std::atomic<const TimeZoneInfo*> future_ = {nullptr};
 
   // We remember the transitions found during the last BreakTime() and
   // MakeTime() calls. If the next request is for the same transition we
   // will avoid re-searching.
   mutable std::atomic<std::size_t> local_time_hint_ = {};  // BreakTime() hint
   mutable std::atomic<std::size_t> time_local_hint_ = {};  // MakeTime() hint
+
+  // The counts behind Stats(), which are only maintained when built with
+  // CCTZ_ENABLE_STATS, but are always present so that the layout of this
+  // class does not depend upon it.
+  struct LookupCounters {
+    std::atomic<std::uint_fast64_t> hint_hits = {};
+    std::atomic<std::uint_fast64_t> hint_misses = {};
+    std::atomic<std::uint_fast64_t> searches = {};
+    std::atomic<std::uint_fast64_t> shifts = {};
+
+    void AddTo(time_zone_stats::lookup_counts* counts) const;
+  };
+  mutable LookupCounters break_counters_;  // BreakTime() lookups
+  mutable LookupCounters make_counters_;   // MakeTime() lookups
+  std::int_fast64_t load_nanos_ = 0;
+  mutable std::atomic<std::int_fast64_t> extend_nanos_ = {};
+  std::size_t bytes_read_ = 0;
 };
 
 }  // namespace cctz
@@ -18,9 +18,15 @@
 
 #include "time_zone_libc.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <limits>
+#include <mutex>
 #include <utility>
 
 #include "cctz/civil_time.h"
@@ -179,20 +185,149 @@ std::time_t find_trans(std::time_t lo, std::time_t hi, int offset) {
   return hi;
 }
 
+// Makes libc read ${TZ} (and any file it names) again.
+inline void tz_set() {
+#if defined(_WIN32) || defined(_WIN64)
+  _tzset();
+#else
+  tzset();
+#endif
+}
+
+// How far either side of a missed instant TimeZoneLibC probes libc, and
+// so the time within which it assumes that a change of offset, etc., is
+// not undone.
+const std::int_fast64_t kProbeSeconds = 60 * 60;
+
+// Eras are only learned this close to the epoch, which keeps the probes
+// and the eras well within range.
+const std::int_fast64_t kEraLimit = std::int_fast64_t{1} << 58;
+
+bool SameLocalTime(const time_zone::absolute_lookup& a,
+                   const time_zone::absolute_lookup& b) {
+  return a.offset == b.offset && a.is_dst == b.is_dst &&
+         std::strcmp(a.abbr, b.abbr) == 0;
+}
+
+// Returns true if the civil time is simply that of (s + offset) in UTC,
+// as an era requires. It is not so when libc counts leap seconds (as for
+// the "right/" zones), or when the lookup failed.
+bool IsLinear(std::int_fast64_t s, const time_zone::absolute_lookup& al) {
+  return al.cs == civil_second() + (s + al.offset);
+}
+
 }  // namespace
 
 TimeZoneLibC::TimeZoneLibC(const std::string& name)
-    : local_(name == "localtime") {}
+    : local_(name == "localtime"),
+      eras_tz_(nullptr),
+      spans_(),
+      next_span_(0) {}
 
 time_zone::absolute_lookup TimeZoneLibC::BreakTime(
     const time_point<seconds>& tp) const {
+  if (!local_) return LibCBreakTime(ToUnixSeconds(tp));
+  const char* const tz = std::getenv("TZ");
+  const TZValue* const eras_tz = eras_tz_.load(std::memory_order_acquire);
+  if (eras_tz != nullptr && eras_tz->Is(tz)) {
+    time_zone::absolute_lookup al;
+    for (const detail::time_zone_era& era : eras_) {
+      if (era.lookup(tp, &al)) return al;
+    }
+  }
+  return LearnBreakTime(ToUnixSeconds(tp), tz);
+}
+
+// The eras know the lengths of their abbreviations, so only the lookups
+// that they miss need measure them.
+time_zone::absolute_lookup TimeZoneLibC::BreakTimeAbbr(
+    const time_point<seconds>& tp, std::size_t* abbr_len) const {
+  if (local_) {
+    const TZValue* const eras_tz = eras_tz_.load(std::memory_order_acquire);
+    if (eras_tz != nullptr && eras_tz->Is(std::getenv("TZ"))) {
+      time_zone::absolute_lookup al;
+      for (const detail::time_zone_era& era : eras_) {
+        if (era.lookup(tp, &al, abbr_len)) return al;
+      }
+    }
+  }
+  const time_zone::absolute_lookup al = TimeZoneLibC::BreakTime(tp);
+  *abbr_len = std::strlen(al.abbr);
+  return al;
+}
+
+time_zone::absolute_lookup TimeZoneLibC::LearnBreakTime(
+    std::int_fast64_t s, const char* tz) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  const TZValue* eras_tz = eras_tz_.load(std::memory_order_relaxed);
+  if (eras_tz == nullptr || !eras_tz->Is(tz)) {
+    // ${TZ} has changed, so the eras no longer apply, and libc, which
+    // localtime_r() does not require to notice, must read it again.
+    tz_set();
+    const time_point<seconds> epoch = FromUnixSeconds(0);
+    for (std::size_t i = 0; i != kEras; ++i) {
+      eras_[i].store(epoch, epoch, 0, false, "", 0);
+      spans_[i] = Span();
+    }
+    eras_tz = nullptr;
+    for (const auto& tz_value : tz_values_) {
+      if (tz_value->Is(tz)) {
+        eras_tz = tz_value.get();
+        break;
+      }
+    }
+    if (eras_tz == nullptr) {
+      tz_values_.emplace_back(
+          new TZValue{tz != nullptr, (tz != nullptr) ? tz : ""});
+      eras_tz = tz_values_.back().get();
+    }
+    eras_tz_.store(eras_tz, std::memory_order_release);
+  }
+
+  const time_zone::absolute_lookup al = LibCBreakTime(s);
+  if (s < -kEraLimit || s > kEraLimit || !IsLinear(s, al)) return al;
+  Span span = {s, s + 1, al.offset, al.is_dst, al.abbr};
+  const std::int_fast64_t probes[] = {s + kProbeSeconds, s - kProbeSeconds};
+  for (const std::int_fast64_t probe : probes) {
+    const time_zone::absolute_lookup pal = LibCBreakTime(probe);
+    if (SameLocalTime(pal, al) && IsLinear(probe, pal)) {
+      span.begin = std::min(span.begin, probe);
+      span.end = std::max(span.end, probe + 1);
+    }
+  }
+
+  // Extend an era of the same local time that is within a probe of this
+  // one, or else replace the least recently learned.
+  std::size_t i = 0;
+  for (; i != kEras; ++i) {
+    const Span& known = spans_[i];
+    if (known.abbr != nullptr && known.offset == span.offset &&
+        known.is_dst == span.is_dst &&
+        std::strcmp(known.abbr, span.abbr) == 0 &&
+        span.begin <= known.end - 1 + kProbeSeconds &&
+        known.begin <= span.end - 1 + kProbeSeconds) {
+      span.begin = std::min(span.begin, known.begin);
+      span.end = std::max(span.end, known.end);
+      break;
+    }
+  }
+  if (i == kEras) {
+    i = next_span_;
+    next_span_ = (next_span_ + 1) % kEras;
+  }
+  spans_[i] = span;
+  eras_[i].store(FromUnixSeconds(span.begin), FromUnixSeconds(span.end),
+                 span.offset, span.is_dst, span.abbr, std::strlen(span.abbr));
+  return al;
+}
+
+time_zone::absolute_lookup TimeZoneLibC::LibCBreakTime(
+    std::int_fast64_t s) const {
   time_zone::absolute_lookup al;
   al.offset = 0;
   al.is_dst = false;
   al.abbr = "-00";
 
-  const std::int_fast64_t s = ToUnixSeconds(tp);
-
   // If std::time_t cannot hold the input we saturate the output.
   if (s < std::numeric_limits<std::time_t>::min()) {
     al.cs = civil_second::min();
@@ -222,6 +357,20 @@ time_zone::absolute_lookup TimeZoneLibC::BreakTime(
   return al;
 }
 
+void TimeZoneLibC::BreakTime(const time_point<seconds>* tps, std::size_t n,
+                             time_zone::absolute_lookup* als) const {
+  // There is no search state to share, but we can at least avoid making
+  // a virtual call per element.
+  for (std::size_t i = 0; i != n; ++i) {
+    als[i] = TimeZoneLibC::BreakTime(tps[i]);
+  }
+}
+
+time_zone::absolute_lookup TimeZoneLibC::BreakTime(
+    const time_point<seconds>& tp, std::size_t*) const {
+  return TimeZoneLibC::BreakTime(tp);
+}
+
 time_zone::civil_lookup TimeZoneLibC::MakeTime(const civil_second& cs) const {
   if (!local_) {
     // If time_point<seconds> cannot hold the result we saturate.
@@ -290,6 +439,18 @@ time_zone::civil_lookup TimeZoneLibC::MakeTime(const civil_second& cs) const {
   return {time_zone::civil_lookup::UNIQUE, tp, tp, tp};
 }
 
+void TimeZoneLibC::MakeTime(const civil_second* css, std::size_t n,
+                            time_zone::civil_lookup* cls) const {
+  for (std::size_t i = 0; i != n; ++i) {
+    cls[i] = TimeZoneLibC::MakeTime(css[i]);
+  }
+}
+
+time_zone::civil_lookup TimeZoneLibC::MakeTime(const civil_second& cs,
+                                               std::size_t*) const {
+  return TimeZoneLibC::MakeTime(cs);
+}
+
 bool TimeZoneLibC::NextTransition(const time_point<seconds>&,
                                   time_zone::civil_transition*) const {
   return false;
@@ -300,12 +461,15 @@ bool TimeZoneLibC::PrevTransition(const time_point<seconds>&,
   return false;
 }
 
-std::string TimeZoneLibC::Version() const {
-  return std::string();  // unknown
+const std::string& TimeZoneLibC::Version() const {
+  static const std::string* const kUnknown = new std::string();
+  return *kUnknown;
 }
 
-std::string TimeZoneLibC::Description() const {
-  return local_ ? "localtime" : "UTC";
+const std::string& TimeZoneLibC::Description() const {
+  static const std::string* const kLocal = new std::string("localtime");
+  static const std::string* const kUTC = new std::string("UTC");
+  return local_ ? *kLocal : *kUTC;
 }
 
 }  // namespace cctz
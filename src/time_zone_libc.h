@@ -15,8 +15,15 @@
 #ifndef CCTZ_TIME_ZONE_LIBC_H_
 #define CCTZ_TIME_ZONE_LIBC_H_
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "cctz/time_zone.h"
 #include "time_zone_if.h"
 
 namespace cctz {
@@ -31,17 +38,72 @@ class TimeZoneLibC : public TimeZoneIf {
   // TimeZoneIf implementations.
   time_zone::absolute_lookup BreakTime(
       const time_point<seconds>& tp) const override;
+  void BreakTime(const time_point<seconds>* tps, std::size_t n,
+                 time_zone::absolute_lookup* als) const override;
+  time_zone::absolute_lookup BreakTime(const time_point<seconds>& tp,
+                                       std::size_t* hint) const override;
+  time_zone::absolute_lookup BreakTimeAbbr(
+      const time_point<seconds>& tp, std::size_t* abbr_len) const override;
   time_zone::civil_lookup MakeTime(
       const civil_second& cs) const override;
+  void MakeTime(const civil_second* css, std::size_t n,
+                time_zone::civil_lookup* cls) const override;
+  time_zone::civil_lookup MakeTime(const civil_second& cs,
+                                   std::size_t* hint) const override;
   bool NextTransition(const time_point<seconds>& tp,
                       time_zone::civil_transition* trans) const override;
   bool PrevTransition(const time_point<seconds>& tp,
                       time_zone::civil_transition* trans) const override;
-  std::string Version() const override;
-  std::string Description() const override;
+  const std::string& Version() const override;
+  const std::string& Description() const override;
 
  private:
+  // A span of time over which localtime_r() gives one offset, etc.
+  struct Span {
+    std::int_fast64_t begin;  // seconds since the epoch
+    std::int_fast64_t end;    // exclusive
+    int offset;
+    bool is_dst;
+    const char* abbr;  // null when unused
+  };
+  static const std::size_t kEras = 8;
+
+  // The lookup of s seconds since the epoch, straight from libc.
+  time_zone::absolute_lookup LibCBreakTime(std::int_fast64_t s) const;
+
+  // A value of ${TZ} (or its absence) that eras were learned under.
+  struct TZValue {
+    bool set;
+    std::string value;
+
+    bool Is(const char* tz) const {
+      return tz == nullptr ? !set : set && value == tz;
+    }
+  };
+
+  // Looks up local time s, which the eras missed (or which are for a
+  // ${TZ} value other than tz), and learns the era around it.
+  time_zone::absolute_lookup LearnBreakTime(std::int_fast64_t s,
+                                            const char* tz) const;
+
   const bool local_;  // localtime or UTC
+
+  // libc describes no transitions, so local lookups learn the eras around
+  // the instants that they miss, from the results at the instant and at
+  // a probe either side of it, assuming that no change of offset, etc., is
+  // undone between two probes. The eras are only valid for the ${TZ} value
+  // that they were learned under, which lookups compare by value (not by
+  // the getenv() pointer), so that they notice a putenv() string that is
+  // changed in place. Each distinct value is kept for the life of the zone,
+  // as lock-free lookups may still be comparing against it.
+  mutable detail::time_zone_era eras_[kEras];    // the lock-free copy
+  mutable std::atomic<const TZValue*> eras_tz_;  // the ${TZ} for eras_
+  mutable std::mutex mu_;                        // serializes the learning
+  mutable Span spans_[kEras];                    // eras_, guarded by mu_
+  mutable std::size_t next_span_;                // guarded by mu_
+
+  // Every value that eras_tz_ has pointed to, guarded by mu_.
+  mutable std::vector<std::unique_ptr<const TZValue>> tz_values_;
 };
 
 }  // namespace cctz
@@ -33,12 +33,23 @@
 #include <zircon/types.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "time_zone_fixed.h"
 #include "time_zone_impl.h"
+#include "time_zone_info.h"
 
 namespace cctz {
 
@@ -71,19 +82,44 @@ int __system_property_get(const char* name, char* value) {
 }  // namespace
 #endif
 
-std::string time_zone::name() const {
+const std::string& time_zone::name() const {
   return effective_impl().Name();
 }
 
-time_zone::absolute_lookup time_zone::lookup(
+time_zone::absolute_lookup time_zone::lookup_outside_era(
     const time_point<seconds>& tp) const {
-  return effective_impl().BreakTime(tp);
+  const Impl& impl = effective_impl();
+  impl.EraMissed(tp);
+  return impl.BreakTime(tp);
+}
+
+void time_zone::lookup(const time_point<seconds>* tps, std::size_t n,
+                       absolute_lookup* als) const {
+  effective_impl().BreakTime(tps, n, als);
 }
 
 time_zone::civil_lookup time_zone::lookup(const civil_second& cs) const {
   return effective_impl().MakeTime(cs);
 }
 
+void time_zone::lookup(const civil_second* css, std::size_t n,
+                       civil_lookup* cls) const {
+  effective_impl().MakeTime(css, n, cls);
+}
+
+time_zone time_zone::cursor::zone() const {
+  return time_zone(impl_);
+}
+
+time_zone::absolute_lookup time_zone::cursor::lookup(
+    const time_point<seconds>& tp) {
+  return impl_->BreakTime(tp, &absolute_hint_);
+}
+
+time_zone::civil_lookup time_zone::cursor::lookup(const civil_second& cs) {
+  return impl_->MakeTime(cs, &civil_hint_);
+}
+
 bool time_zone::next_transition(const time_point<seconds>& tp,
                                 civil_transition* trans) const {
   return effective_impl().NextTransition(tp, trans);
@@ -94,11 +130,38 @@ bool time_zone::prev_transition(const time_point<seconds>& tp,
   return effective_impl().PrevTransition(tp, trans);
 }
 
-std::string time_zone::version() const {
+time_zone::transition_range time_zone::transitions(
+    const time_point<seconds>& begin, const time_point<seconds>& end) const {
+  const Impl* impl = &effective_impl();
+  transition_iterator first(impl, end);
+  if (begin < end) {
+    // next_transition() finds the first transition after its argument.
+    const time_point<seconds> tp =
+        (begin == time_point<seconds>::min()) ? begin : begin - seconds(1);
+    first.valid_ =
+        impl->NextTransition(tp, &first.trans_, &first.at_, &first.hint_) &&
+        first.at_ < end;
+  }
+  return transition_range(first, transition_iterator(impl, end));
+}
+
+time_zone::transition_iterator& time_zone::transition_iterator::operator++() {
+  const time_point<seconds> tp = at_;
+  valid_ = impl_->NextTransition(tp, &trans_, &at_, &hint_) && at_ < end_;
+  return *this;
+}
+
+time_zone::transition_iterator& time_zone::transition_iterator::operator--() {
+  const time_point<seconds> tp = valid_ ? at_ : end_;
+  valid_ = impl_->PrevTransition(tp, &trans_, &at_, &hint_);
+  return *this;
+}
+
+const std::string& time_zone::version() const {
   return effective_impl().Version();
 }
 
-std::string time_zone::description() const {
+const std::string& time_zone::description() const {
   return effective_impl().Description();
 }
 
@@ -111,10 +174,129 @@ const time_zone::Impl& time_zone::effective_impl() const {
   return *impl_;
 }
 
+// Walks the eras of both zones together, from the earliest instant that
+// "first" converts to, and, for each stretch of time with a fixed pair of
+// offsets, adds a span for the from-zone civil times that convert into it.
+// Those are the civil times of the stretch in the from zone, less any that
+// it repeats, which convert to the earlier instant, so the spans follow on
+// from one another, except where the from zone skips some civil times.
+time_zone_converter::time_zone_converter(const time_zone& from,
+                                         const time_zone& to,
+                                         const civil_second& first,
+                                         const civil_second& last)
+    : from_(from), to_(to), end_(first) {
+  const time_zone::Impl& from_impl = from_.effective_impl();
+  const time_zone::Impl& to_impl = to_.effective_impl();
+  const civil_second epoch;  // the civil time of unix time 0 in UTC
+  const time_zone::civil_lookup cl = from_impl.MakeTime(first);
+  time_point<seconds> tp = std::min(cl.pre, std::min(cl.trans, cl.post));
+  for (bool head = true; end_ <= last; head = false) {
+    ZoneEra from_era;
+    ZoneEra to_era;
+    if (!from_impl.Era(tp, &from_era) || !to_impl.Era(tp, &to_era)) break;
+    const time_point<seconds> begin = std::max(from_era.begin, to_era.begin);
+    const time_point<seconds> end = std::min(from_era.end, to_era.end);
+    if (end <= tp) break;  // beyond the last era
+    civil_second lo = end_;
+    if (!head) {
+      const civil_second cs = epoch + (ToUnixSeconds(begin) + from_era.offset);
+      if (cs > end_) {  // [end_, cs) was skipped, so converts to begin
+        const civil_second to_cs =
+            epoch + (ToUnixSeconds(begin) + to_era.offset);
+        spans_.push_back({end_, to_cs - end_, true});
+        lo = cs;
+      }
+    }
+    const civil_second hi = epoch + (ToUnixSeconds(end) + from_era.offset);
+    if (lo < hi) {
+      const std::int_fast64_t delta = to_era.offset - from_era.offset;
+      if (spans_.empty() || spans_.back().skipped ||
+          spans_.back().delta != delta) {
+        spans_.push_back({lo, delta, false});
+      }
+      end_ = hi;
+    }
+    tp = end;
+  }
+}
+
+civil_second time_zone_converter::convert(const civil_second& cs) const {
+  if (!tabulated(cs)) return convert_untabulated(cs);
+  const Span& span = spans_[find(cs)];
+  return (span.skipped ? span.begin : cs) + span.delta;
+}
+
+void time_zone_converter::convert(const civil_second* css, std::size_t n,
+                                  civil_second* out) const {
+  std::size_t i = 0;  // the span of the previous civil time
+  for (std::size_t k = 0; k != n; ++k) {
+    const civil_second& cs = css[k];
+    if (!tabulated(cs)) {
+      out[k] = convert_untabulated(cs);
+      continue;
+    }
+    if (cs < spans_[i].begin) {
+      i = find(cs);
+    } else {
+      // Sorted input only ever moves on to later spans.
+      while (i + 1 != spans_.size() && spans_[i + 1].begin <= cs) ++i;
+    }
+    const Span& span = spans_[i];
+    out[k] = (span.skipped ? span.begin : cs) + span.delta;
+  }
+}
+
+std::size_t time_zone_converter::find(const civil_second& cs) const {
+  const auto it = std::upper_bound(
+      spans_.begin(), spans_.end(), cs,
+      [](const civil_second& c, const Span& span) { return c < span.begin; });
+  return static_cast<std::size_t>(it - spans_.begin()) - 1;
+}
+
+civil_second time_zone_converter::convert_untabulated(
+    const civil_second& cs) const {
+  return cctz::convert(cctz::convert(cs, from_), to_);
+}
+
 bool load_time_zone(const std::string& name, time_zone* tz) {
   return time_zone::Impl::LoadTimeZone(name, tz);
 }
 
+time_zone_load load_time_zone_async(
+    const std::string& name,
+    std::function<void(bool loaded, const time_zone& tz)> done,
+    time_zone_executor executor) {
+  return time_zone::Impl::LoadTimeZoneAsync(name, std::move(done),
+                                            std::move(executor));
+}
+
+std::size_t preload_time_zones(const std::vector<std::string>& names,
+                               int num_threads) {
+  return time_zone::Impl::PreloadTimeZones(names, num_threads);
+}
+
+std::size_t preload_all_time_zones(int num_threads) {
+  std::vector<std::string> names;
+  TimeZoneInfo::ListZones(&names);
+  return time_zone::Impl::PreloadTimeZones(names, num_threads);
+}
+
+std::size_t update_time_zones() { return time_zone::Impl::UpdateTimeZones(); }
+
+bool stats(std::vector<time_zone_stats>* zones) {
+  zones->clear();
+#if defined(CCTZ_ENABLE_STATS)
+  time_zone::Impl::AppendStats(zones);
+  std::sort(zones->begin(), zones->end(),
+            [](const time_zone_stats& a, const time_zone_stats& b) {
+              return a.name < b.name;
+            });
+  return true;
+#else
+  return false;
+#endif
+}
+
 time_zone utc_time_zone() {
   return time_zone::Impl::UTC();  // avoid name lookup
 }
@@ -125,7 +307,11 @@ time_zone fixed_time_zone(const seconds& offset) {
   return tz;
 }
 
-time_zone local_time_zone() {
+namespace {
+
+// Returns the name of the local time zone (not necessarily loadable), as
+// given by ${TZ}, or else by the platform's setting.
+std::string LocalTimeZoneName() {
   const char* zone = ":localtime";
 #if defined(__ANDROID__)
   char sysprop[PROP_VALUE_MAX];
@@ -220,13 +406,139 @@ time_zone local_time_zone() {
   free(localtime_env);
   free(tz_env);
 #endif
+  return name;
+}
+
+// How often local_time_zone() checks whether its zone file has changed.
+constexpr std::int_fast64_t kLocalCheckNanos = 1000 * 1000 * 1000;
 
+// A monotonic clock, in nanoseconds. It need only be as precise as the
+// check interval, so we prefer a cheaper, coarse clock where there is one.
+std::int_fast64_t MonotonicNanos() {
+#if defined(CLOCK_MONOTONIC_COARSE)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) {
+    return std::int_fast64_t{ts.tv_sec} * 1000 * 1000 * 1000 + ts.tv_nsec;
+  }
+#endif
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The resolved local time zone, along with what it was resolved from, so
+// that local_time_zone() can notice when that changes.
+struct LocalTimeZone {
   time_zone tz;
-  load_time_zone(name, &tz);  // Falls back to UTC.
+  bool has_tz_env;
+  std::string tz_env;  // the value of ${TZ}, when has_tz_env
+  bool is_file;        // the zone name is a path (e.g., "/etc/localtime")
+  std::string name;
+  FileStamp stamp;
+  mutable std::atomic<std::int_fast64_t> next_check;  // MonotonicNanos()
+  const LocalTimeZone* replaced;  // the previous local_time_zone_cache
+};
+
+// The current LocalTimeZone. Those it replaces are never freed, as other
+// threads may still be reading them, so they remain reachable through
+// LocalTimeZone::replaced instead (but each is small, and replacements
+// only follow configuration changes).
+std::atomic<const LocalTimeZone*> local_time_zone_cache(nullptr);
+
+// Whether ${TZ} differs from the value recorded in local.
+bool TZEnvChanged(const LocalTimeZone& local) {
+  char* tz_env = nullptr;
+#if defined(_MSC_VER)
+  _dupenv_s(&tz_env, nullptr, "TZ");
+#else
+  tz_env = std::getenv("TZ");
+#endif
+  const bool changed = (tz_env != nullptr)
+                           ? !local.has_tz_env || local.tz_env != tz_env
+                           : local.has_tz_env;
+#if defined(_MSC_VER)
+  free(tz_env);
+#endif
+  return changed;
+}
+
+// Resolves the local time zone afresh. A reload re-reads the zone data
+// even when a zone of the same name is already loaded.
+std::unique_ptr<LocalTimeZone> NewLocalTimeZone(bool reload) {
+  std::unique_ptr<LocalTimeZone> local(new LocalTimeZone);
+  // ${TZ} is recorded before it is used, so that a concurrent change is
+  // at worst noticed again by the next check.
+  char* tz_env = nullptr;
+#if defined(_MSC_VER)
+  _dupenv_s(&tz_env, nullptr, "TZ");
+#else
+  tz_env = std::getenv("TZ");
+#endif
+  local->has_tz_env = (tz_env != nullptr);
+  if (tz_env != nullptr) local->tz_env = tz_env;
+#if defined(_MSC_VER)
+  free(tz_env);
+#endif
+  local->name = LocalTimeZoneName();
+  local->is_file = !local->name.empty() && local->name[0] == '/';
+  if (local->is_file) local->stamp = StampFile(local->name);
+  local->next_check.store(MonotonicNanos() + kLocalCheckNanos,
+                          std::memory_order_relaxed);
+
+  if (reload) {
+    time_zone::Impl::ReloadTimeZone(local->name, &local->tz);
+  } else {
+    load_time_zone(local->name, &local->tz);  // Falls back to UTC.
+  }
   // TODO: Follow the RFC3339 "Unknown Local Offset Convention" and
   // arrange for %z to generate "-0000" when we don't know the local
   // offset because the load_time_zone() failed and we're using UTC.
-  return tz;
+  return local;
+}
+
+// Replaces prev with a new LocalTimeZone, unless another thread already
+// has, in which case we use theirs.
+time_zone ReplaceLocalTimeZone(const LocalTimeZone* prev, bool reload) {
+  std::unique_ptr<LocalTimeZone> local = NewLocalTimeZone(reload);
+  local->replaced = prev;
+  if (local_time_zone_cache.compare_exchange_strong(
+          prev, local.get(), std::memory_order_acq_rel,
+          std::memory_order_acquire)) {
+    return local.release()->tz;
+  }
+  return prev->tz;
+}
+
+}  // namespace
+
+time_zone local_time_zone() {
+  const LocalTimeZone* local =
+      local_time_zone_cache.load(std::memory_order_acquire);
+  if (local == nullptr) return ReplaceLocalTimeZone(nullptr, false);
+  if (TZEnvChanged(*local)) return ReplaceLocalTimeZone(local, false);
+  if (local->is_file) {
+    const std::int_fast64_t now = MonotonicNanos();
+    if (now >= local->next_check.load(std::memory_order_relaxed)) {
+      local->next_check.store(now + kLocalCheckNanos,
+                              std::memory_order_relaxed);
+      if (!(StampFile(local->name) == local->stamp)) {
+        return ReplaceLocalTimeZone(local, true);
+      }
+    }
+  }
+  return local->tz;
+}
+
+void refresh_local_time_zone() {
+  std::unique_ptr<LocalTimeZone> local = NewLocalTimeZone(true);
+  const LocalTimeZone* prev =
+      local_time_zone_cache.load(std::memory_order_relaxed);
+  do {
+    local->replaced = prev;
+  } while (!local_time_zone_cache.compare_exchange_weak(
+      prev, local.get(), std::memory_order_release,
+      std::memory_order_relaxed));
+  local.release();
 }
 
 }  // namespace cctz
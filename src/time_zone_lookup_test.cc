@@ -14,17 +14,37 @@
 
 #include "cctz/time_zone.h"
 
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstddef>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
 #include <future>
+#include <iterator>
 #include <limits>
+#include <random>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "cctz/civil_time.h"
 #include "gtest/gtest.h"
+#include "time_zone_bundle.h"
+#include "time_zone_embedded.h"
+#include "time_zone_info.h"
 
 namespace chrono = std::chrono;
 
@@ -638,6 +658,17 @@ time_zone LoadZone(const std::string& name) {
   return tz;
 }
 
+// Copies the named zoneinfo file from ${TZDIR} to path, replacing any
+// existing file without ever leaving it partially written.
+bool CopyZoneFile(const std::string& name, const std::string& path) {
+  const char* const zoneinfo = std::getenv("TZDIR");
+  if (zoneinfo == nullptr) return false;
+  std::ifstream in(std::string(zoneinfo) + "/" + name, std::ios::binary);
+  if (!in) return false;
+  std::ofstream(path + ".tmp", std::ios::binary) << in.rdbuf();
+  return std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+}
+
 // This helper is a macro so that failed expectations show up with the
 // correct line numbers.
 #define ExpectTime(tp, tz, y, m, d, hh, mm, ss, off, isdst, zone) \
@@ -744,6 +775,28 @@ TEST(TimeZone, NamedTimeZones) {
   EXPECT_EQ("Fixed/UTC-12:34:56", fixed_neg.name());
 }
 
+TEST(TimeZone, StringReferences) {
+  // The strings are owned by the shared zone data, so every handle to
+  // the same zone sees the same objects, and they outlive the handles.
+  const std::string* name = nullptr;
+  const std::string* version = nullptr;
+  const std::string* description = nullptr;
+  {
+    const time_zone tz = LoadZone("America/New_York");
+    name = &tz.name();
+    version = &tz.version();
+    description = &tz.description();
+    EXPECT_EQ(name, &tz.name());
+    EXPECT_EQ(description, &tz.description());
+    EXPECT_FALSE(description->empty());
+  }
+  const time_zone tz = LoadZone("America/New_York");
+  EXPECT_EQ(name, &tz.name());
+  EXPECT_EQ(version, &tz.version());
+  EXPECT_EQ(description, &tz.description());
+  EXPECT_EQ("America/New_York", *name);
+}
+
 TEST(TimeZone, Failures) {
   time_zone tz;
   EXPECT_FALSE(load_time_zone(":America/Los_Angeles", &tz));
@@ -813,6 +866,623 @@ TEST(TimeZone, Equality) {
   EXPECT_NE(la, nyc);
 }
 
+TEST(TimeZone, Hash) {
+  const std::hash<time_zone> hash;
+  EXPECT_EQ(hash(time_zone()), hash(utc_time_zone()));
+  EXPECT_EQ(hash(utc_time_zone()), hash(fixed_time_zone(cctz::seconds(0))));
+  EXPECT_EQ(hash(LoadZone("America/Los_Angeles")),
+            hash(LoadZone("America/Los_Angeles")));
+
+  std::unordered_map<time_zone, int> counts;
+  for (const char* name : {"America/Los_Angeles", "America/New_York",
+                           "America/Los_Angeles", "UTC", "US/Pacific"}) {
+    ++counts[LoadZone(name)];
+  }
+  ++counts[time_zone()];
+  EXPECT_EQ(4, counts.size());
+  EXPECT_EQ(2, counts[LoadZone("America/Los_Angeles")]);
+  EXPECT_EQ(2, counts[utc_time_zone()]);
+  EXPECT_EQ(1, counts[LoadZone("US/Pacific")]);  // a different name
+}
+
+// Returns the statistics of the named zone, or a zero-filled result.
+time_zone_stats ZoneStats(const std::string& name) {
+  std::vector<time_zone_stats> zones;
+  stats(&zones);
+  for (const auto& zone : zones) {
+    if (zone.name == name) return zone;
+  }
+  return time_zone_stats();
+}
+
+TEST(TimeZone, Stats) {
+  const std::string name = "file:America/Chicago";
+  const time_zone tz = LoadZone(name);
+  std::vector<time_zone_stats> zones;
+  if (!stats(&zones)) {
+    EXPECT_TRUE(zones.empty());  // built without CCTZ_ENABLE_STATS
+    return;
+  }
+  EXPECT_FALSE(zones.empty());
+
+  const time_zone_stats before = ZoneStats(name);
+  EXPECT_EQ(name, before.name);
+  EXPECT_GT(before.bytes_read, 0);
+  EXPECT_GT(before.transitions, 0);
+  EXPECT_GE(before.load_nanos, before.extend_nanos);
+
+  // Alternating between distant transitions defeats the hints, while
+  // repeating a lookup always hits.
+  for (int i = 0; i != 2; ++i) {
+    convert(civil_second(1950, 6, 1), tz);
+    convert(civil_second(1990, 6, 1), tz);
+    convert(convert(civil_second(1950, 6, 1), tz), tz);
+    convert(convert(civil_second(1990, 6, 1), tz), tz);
+  }
+  convert(convert(civil_second(1990, 6, 1), tz), tz);
+  const time_zone_stats middle = ZoneStats(name);
+  EXPECT_GT(middle.absolute.hint_hits, before.absolute.hint_hits);
+  EXPECT_GT(middle.absolute.hint_misses, before.absolute.hint_misses);
+  EXPECT_GT(middle.absolute.searches, before.absolute.searches);
+  EXPECT_GT(middle.civil.hint_hits, before.civil.hint_hits);
+  EXPECT_GT(middle.civil.hint_misses, before.civil.hint_misses);
+  EXPECT_GT(middle.civil.searches, before.civil.searches);
+
+  // Beyond the generated transitions, lookups are shifted by 400 years.
+  convert(convert(civil_second(3000, 6, 1), tz), tz);
+  const time_zone_stats after = ZoneStats(name);
+  EXPECT_EQ(middle.absolute.shifts + 1, after.absolute.shifts);
+  EXPECT_EQ(middle.civil.shifts + 1, after.civil.shifts);
+  EXPECT_GT(after.transitions, middle.transitions);  // generated on demand
+}
+
+// Expects that the named zones have the same version and transitions.
+void ExpectSameZone(const std::string& name, const std::string& ref_name) {
+  const time_zone tz = LoadZone(name);
+  const time_zone ref = LoadZone(ref_name);
+  EXPECT_EQ(ref.version(), tz.version());
+  auto tp = time_point<cctz::seconds>::min();
+  time_zone::civil_transition trans;
+  time_zone::civil_transition ref_trans;
+  for (int i = 0; i != 600 && ref.next_transition(tp, &ref_trans); ++i) {
+    ASSERT_TRUE(tz.next_transition(tp, &trans)) << name;
+    EXPECT_EQ(ref_trans.from, trans.from) << name;
+    EXPECT_EQ(ref_trans.to, trans.to) << name;
+    tp = ref.lookup(ref_trans.to).trans;
+    const auto al = tz.lookup(tp);
+    const auto ref_al = ref.lookup(tp);
+    EXPECT_EQ(ref_al.offset, al.offset) << name;
+    EXPECT_STREQ(ref_al.abbr, al.abbr) << name;
+    EXPECT_EQ(ref_al.abbr, format("%Z", tp, tz)) << name;  // its length too
+    EXPECT_EQ(ref.lookup(trans.from).pre, tz.lookup(trans.from).pre) << name;
+  }
+}
+
+TEST(TimeZone, Bundle) {
+  if (std::getenv("TZDIR") == nullptr) GTEST_SKIP() << "${TZDIR} is unset";
+
+  // The zones are bundled under the names of temporary copies of their
+  // zoneinfo files, which are removed before the bundle is used, so they
+  // can only be loaded from the bundle.
+  const std::string path = testing::TempDir() + "/time_zone_bundle_test";
+  const std::pair<const char*, const char*> links[] = {
+      {"America/New_York", "US/Eastern"},
+      {"Australia/Lord_Howe", "Australia/LHI"},
+      {"Pacific/Chatham", "NZ-CHAT"},
+      {"Asia/Tokyo", "Japan"},  // withheld until the bundle is cleared
+  };
+  std::vector<std::string> copies;
+  for (const auto& link : links) {
+    copies.push_back(path + "." + std::to_string(copies.size()));
+    ASSERT_TRUE(CopyZoneFile(link.first, copies.back()));
+  }
+  std::vector<std::string> names = {"Factory"};
+  for (const auto& copy : copies) names.push_back("file:" + copy);
+  ASSERT_TRUE(write_time_zone_bundle(path, names));
+  for (const auto& copy : copies) std::remove(copy.c_str());
+  EXPECT_FALSE(write_time_zone_bundle(path + ".bad", {"Invalid/TimeZone"}));
+
+  // Files that are missing, truncated, or not bundles are rejected.
+  EXPECT_FALSE(use_time_zone_bundle(path + ".missing"));
+  std::string image;
+  {
+    std::ifstream in(path, std::ios::binary);
+    image.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+  }
+  ASSERT_FALSE(image.empty());
+  std::ofstream(path + ".short", std::ios::binary)
+      .write(image.data(), static_cast<std::streamsize>(image.size() / 2));
+  EXPECT_FALSE(use_time_zone_bundle(path + ".short"));
+  std::ofstream(path + ".text") << "not a bundle";
+  EXPECT_FALSE(use_time_zone_bundle(path + ".text"));
+  std::remove((path + ".short").c_str());
+  std::remove((path + ".text").c_str());
+
+  ASSERT_TRUE(use_time_zone_bundle(path));
+  std::remove(path.c_str());  // the mapping remains
+
+  // Nothing else loads "Factory", so it must come from the bundle.
+  const time_zone factory = LoadZone("Factory");
+  const auto al = factory.lookup(chrono::system_clock::from_time_t(0));
+  EXPECT_EQ(0, al.offset);
+  EXPECT_STREQ("-00", al.abbr);
+
+  // Bundled zones agree with their (unbundled) links.
+  time_zone tz;
+  for (std::size_t i = 0; i + 1 != copies.size(); ++i) {
+    ASSERT_TRUE(load_time_zone(names[i + 1], &tz)) << names[i + 1];
+    ExpectSameZone(names[i + 1], links[i].second);
+  }
+
+  // Later loads no longer consult the bundle.
+  ClearZoneBundleTestOnly();
+  EXPECT_FALSE(load_time_zone(names.back(), &tz));
+}
+
+TEST(TimeZone, CorruptBundle) {
+  if (std::getenv("TZDIR") == nullptr) GTEST_SKIP() << "${TZDIR} is unset";
+
+  // Each case bundles a fresh copy of a zoneinfo file, and then corrupts
+  // the bundle before using it. A corrupt zone must not load.
+  const std::string path = testing::TempDir() + "/time_zone_corrupt_bundle";
+  using Corruption = std::function<void(BundleZone*, Transition*,
+                                         TransitionType*)>;
+  const std::pair<bool, Corruption> cases[] = {
+      {true, [](BundleZone*, Transition*, TransitionType*) {}},
+      {false,
+       [](BundleZone* zone, Transition* trs, TransitionType*) {
+         trs[1].type_index = static_cast<std::uint_least8_t>(zone->typecnt);
+       }},
+      {false,
+       [](BundleZone* zone, Transition*, TransitionType* tts) {
+         tts[0].abbr_index = static_cast<std::uint_least8_t>(zone->abbrlen);
+       }},
+      {false,
+       [](BundleZone*, Transition*, TransitionType* tts) {
+         tts[0].abbr_len += 1000;
+       }},
+      {false,
+       [](BundleZone*, Transition* trs, TransitionType*) {
+         std::swap(trs[1], trs[2]);  // out of order
+       }},
+      {false,
+       [](BundleZone*, Transition* trs, TransitionType*) {
+         trs[1].unix_time += 1;  // disagrees with unix_times
+       }},
+  };
+  for (std::size_t i = 0; i != sizeof(cases) / sizeof(cases[0]); ++i) {
+    const std::string copy = path + "." + std::to_string(i);
+    ASSERT_TRUE(CopyZoneFile("America/New_York", copy));
+    ASSERT_TRUE(write_time_zone_bundle(path, {"file:" + copy}));
+    std::remove(copy.c_str());
+    std::string image;
+    {
+      std::ifstream in(path, std::ios::binary);
+      image.assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+    }
+    BundleHeader header;
+    ASSERT_LE(sizeof(header), image.size());
+    std::memcpy(&header, &image[0], sizeof(header));
+    ASSERT_EQ(1, header.zone_count);
+    BundleEntry entry;
+    std::memcpy(&entry, &image[sizeof(header)], sizeof(entry));
+    BundleZone zone;
+    std::memcpy(&zone, &image[entry.zone], sizeof(zone));
+    ASSERT_LT(2, zone.timecnt);
+    std::vector<Transition> trs(zone.timecnt);
+    std::memcpy(trs.data(), &image[zone.transitions],
+                trs.size() * sizeof(Transition));
+    std::vector<TransitionType> tts(zone.typecnt);
+    std::memcpy(tts.data(), &image[zone.transition_types],
+                tts.size() * sizeof(TransitionType));
+    cases[i].second(&zone, trs.data(), tts.data());
+    std::memcpy(&image[entry.zone], &zone, sizeof(zone));
+    std::memcpy(&image[zone.transitions], trs.data(),
+                trs.size() * sizeof(Transition));
+    std::memcpy(&image[zone.transition_types], tts.data(),
+                tts.size() * sizeof(TransitionType));
+    std::ofstream(path, std::ios::binary)
+        .write(image.data(), static_cast<std::streamsize>(image.size()));
+
+    ASSERT_TRUE(use_time_zone_bundle(path)) << i;
+    std::remove(path.c_str());
+    time_zone tz;
+    EXPECT_EQ(cases[i].first, load_time_zone("file:" + copy, &tz)) << i;
+    ClearZoneBundleTestOnly();
+  }
+}
+
+TEST(TimeZone, Embedded) {
+  // The embedded zones are compared with links from the test zoneinfo.
+  if (std::getenv("TZDIR") == nullptr) GTEST_SKIP() << "${TZDIR} is unset";
+
+  // The CMake and Bazel builds compile these zones into the test.
+  const std::pair<const char*, const char*> links[] = {
+      {"Asia/Kolkata", "Asia/Calcutta"},
+      {"Europe/Dublin", "Eire"},
+  };
+  for (const auto& link : links) {
+    if (FindEmbeddedZone(link.first) == nullptr) {
+      GTEST_SKIP() << link.first << " is not embedded";
+    }
+    ExpectSameZone(link.first, link.second);
+  }
+}
+
+TEST(TimeZone, Preload) {
+  const std::vector<std::string> names = {
+      "America/Los_Angeles", "Invalid/TimeZone", "Europe/Paris", "UTC",
+      "America/Los_Angeles"};
+  EXPECT_EQ(4, preload_time_zones(names, 3));
+  EXPECT_EQ(0, preload_time_zones({}, 3));
+
+  // zone1970.tab lists hundreds of zones, all of which should load.
+  const std::size_t loaded = preload_all_time_zones(4);
+  EXPECT_GT(loaded, 300);
+  EXPECT_EQ(loaded, preload_all_time_zones(0));  // now cached
+}
+
+TEST(TimeZone, LoadAsync) {
+  // Without an executor, each load runs on a thread of its own. (Nothing
+  // else loads these names, so the loads cannot already be finished.)
+  time_zone tz;
+  const time_zone_load paris = load_time_zone_async("file:Europe/Paris");
+  EXPECT_TRUE(paris.get(&tz));
+  EXPECT_TRUE(paris.ready());
+  EXPECT_EQ(LoadZone("file:Europe/Paris"), tz);
+  EXPECT_EQ(3600, tz.lookup(chrono::system_clock::from_time_t(0)).offset);
+  EXPECT_FALSE(load_time_zone_async("file:Invalid/TimeZone").get(&tz));
+  EXPECT_EQ(utc_time_zone(), tz);
+  EXPECT_FALSE(time_zone_load().get(&tz));
+
+  // Concurrent requests share one load, which runs on the executor.
+  std::vector<std::function<void()>> tasks;
+  const time_zone_executor executor = [&tasks](std::function<void()> task) {
+    tasks.push_back(std::move(task));
+  };
+  const std::string name = "file:Asia/Kolkata";
+  int calls = 0;
+  const auto done = [&calls](bool loaded, const time_zone& zone) {
+    EXPECT_TRUE(loaded);
+    EXPECT_EQ("file:Asia/Kolkata", zone.name());
+    ++calls;
+  };
+  std::vector<time_zone_load> loads;
+  for (int i = 0; i != 3; ++i) {
+    loads.push_back(load_time_zone_async(name, done, executor));
+  }
+  ASSERT_EQ(1, tasks.size());
+  for (const time_zone_load& load : loads) EXPECT_FALSE(load.ready());
+  EXPECT_EQ(0, calls);
+  tasks.front()();
+  EXPECT_EQ(3, calls);
+  for (const time_zone_load& load : loads) {
+    EXPECT_TRUE(load.ready());
+    EXPECT_TRUE(load.get(&tz));
+    EXPECT_EQ(LoadZone(name), tz);
+  }
+
+  // Requests for a loaded zone finish before returning, with no task.
+  const time_zone_load again = load_time_zone_async(name, done, executor);
+  EXPECT_EQ(1, tasks.size());
+  EXPECT_EQ(4, calls);
+  EXPECT_TRUE(again.ready());
+}
+
+TEST(TimeZoneInfo, SharedTables) {
+  TimeZoneInfo tokyo;
+  TimeZoneInfo japan;
+  TimeZoneInfo seoul;
+  ASSERT_TRUE(tokyo.Load("Asia/Tokyo"));
+  ASSERT_TRUE(japan.Load("Japan"));
+  ASSERT_TRUE(seoul.Load("Asia/Seoul"));
+  EXPECT_TRUE(tokyo.SharesTables(japan));
+  EXPECT_FALSE(tokyo.SharesTables(seoul));
+
+  // Compact zones, which have no Transition table, share theirs likewise.
+  TimeZoneInfo compact_tokyo;
+  TimeZoneInfo compact_japan;
+  TimeZoneInfo compact_seoul;
+  use_compact_time_zones(true);
+  const bool loaded = compact_tokyo.Load("Asia/Tokyo") &&
+                      compact_japan.Load("Japan") &&
+                      compact_seoul.Load("Asia/Seoul");
+  use_compact_time_zones(false);
+  ASSERT_TRUE(loaded);
+  EXPECT_TRUE(compact_tokyo.SharesTables(compact_japan));
+  EXPECT_FALSE(compact_tokyo.SharesTables(compact_seoul));
+  EXPECT_FALSE(compact_tokyo.SharesTables(tokyo));
+}
+
+TEST(TimeZoneInfo, FixedOffsetShortcut) {
+  // Fixed-offset zones bypass their TimeZoneInfo, but must agree with it.
+  const auto tp_min = time_point<cctz::seconds>::min();
+  const auto tp_max = time_point<cctz::seconds>::max();
+  for (const auto offset : {-24 * 60 * 60, -(8 * 60 + 30) * 60, 0, 1,
+                            (5 * 60 + 45) * 60, 24 * 60 * 60}) {
+    const time_zone tz = fixed_time_zone(cctz::seconds(offset));
+    TimeZoneInfo info;
+    ASSERT_TRUE(info.Load(tz.name()));
+    for (const auto tp : {tp_min, tp_min + cctz::seconds(1), FromUnixSeconds(0),
+                          FromUnixSeconds(1590969600),  // 2020-06-01
+                          tp_max - cctz::seconds(1), tp_max}) {
+      const auto al = tz.lookup(tp);
+      const auto ial = info.BreakTime(tp);
+      EXPECT_EQ(ial.cs, al.cs) << tz.name();
+      EXPECT_EQ(ial.offset, al.offset) << tz.name();
+      EXPECT_EQ(ial.is_dst, al.is_dst) << tz.name();
+      EXPECT_STREQ(ial.abbr, al.abbr) << tz.name();
+      for (const auto cs : {al.cs - 1, al.cs, al.cs + 1}) {
+        const auto cl = tz.lookup(cs);
+        const auto icl = info.MakeTime(cs);
+        EXPECT_EQ(icl.kind, cl.kind) << tz.name() << " " << cs;
+        EXPECT_EQ(icl.pre, cl.pre) << tz.name() << " " << cs;
+        EXPECT_EQ(icl.trans, cl.trans) << tz.name() << " " << cs;
+        EXPECT_EQ(icl.post, cl.post) << tz.name() << " " << cs;
+      }
+    }
+  }
+}
+
+TEST(TimeZone, CurrentEra) {
+  // Lookups near the current time are answered from the zone's current
+  // era, and must agree with the full lookups that a cursor performs.
+  const auto now = chrono::time_point_cast<cctz::seconds>(
+      chrono::system_clock::now());
+  for (const char* const* np = kTimeZoneNames; *np != nullptr; ++np) {
+    time_zone tz;
+    ASSERT_TRUE(load_time_zone(*np, &tz)) << *np;
+    time_zone::cursor cur(tz);
+    for (int h = -24 * 400; h <= 24 * 400; h += 37) {
+      const auto tp = now + chrono::hours(h) + cctz::seconds(h);
+      const auto al = tz.lookup(tp);
+      const auto cal = cur.lookup(tp);
+      EXPECT_EQ(cal.cs, al.cs) << *np << " " << h;
+      EXPECT_EQ(cal.offset, al.offset) << *np << " " << h;
+      EXPECT_EQ(cal.is_dst, al.is_dst) << *np << " " << h;
+      EXPECT_STREQ(cal.abbr, al.abbr) << *np << " " << h;
+    }
+  }
+}
+
+TEST(TimeZoneInfo, Era) {
+  // Eras are found from the rule until Future() exists, and from it after
+  // that, and either way must agree with BreakTime() throughout.
+  for (const char* name : {"file:America/Los_Angeles", "file:Europe/London",
+                           "file:Australia/Lord_Howe", "file:Asia/Tokyo"}) {
+    TimeZoneInfo info;
+    ASSERT_TRUE(info.Load(name));
+    for (int pass = 0; pass != 2; ++pass) {
+      std::vector<ZoneEra> eras;
+      for (std::int_fast64_t t = 946684800; t < 4102444800; t += 13 * 86400) {
+        ZoneEra era;
+        ASSERT_TRUE(info.Era(FromUnixSeconds(t), &era)) << name << " " << t;
+        EXPECT_LE(era.begin, FromUnixSeconds(t)) << name;
+        EXPECT_GT(era.end, FromUnixSeconds(t)) << name;
+        eras.push_back(era);
+      }
+      for (const ZoneEra& era : eras) {
+        for (const auto tp : {era.begin, era.end - cctz::seconds(1)}) {
+          const auto al = info.BreakTime(tp);
+          EXPECT_EQ(civil_second() + ToUnixSeconds(tp) + era.offset, al.cs)
+              << name;
+          EXPECT_EQ(era.offset, al.offset) << name;
+          EXPECT_EQ(era.is_dst, al.is_dst) << name;
+          EXPECT_STREQ(era.abbr, al.abbr) << name;
+        }
+      }
+    }
+  }
+
+  // The era before the first transition (in 1920) uses the default type.
+  TimeZoneInfo info;
+  ASSERT_TRUE(info.Load("file:Asia/Kathmandu"));
+  ZoneEra era;
+  ASSERT_TRUE(info.Era(FromUnixSeconds(-2208988800), &era));  // 1900
+  time_zone::civil_transition trans;
+  ASSERT_TRUE(info.NextTransition(era.begin, &trans));
+  EXPECT_EQ(info.MakeTime(trans.to).trans, era.end);
+  for (const auto tp : {era.begin, era.end - cctz::seconds(1)}) {
+    const auto al = info.BreakTime(tp);
+    EXPECT_EQ(civil_second() + ToUnixSeconds(tp) + era.offset, al.cs);
+    EXPECT_EQ(era.offset, al.offset);
+  }
+}
+
+TEST(TimeZoneEra, CivilAt) {
+  // The closed-form conversion agrees with civil_second arithmetic.
+  std::mt19937_64 urbg(42);  // a UniformRandomBitGenerator with fixed seed
+  const std::int_fast64_t kLimit = std::int_fast64_t{1} << 62;
+  std::vector<std::int_fast64_t> ts = {0,         -1,      1,      -86400,
+                                       951782400, -kLimit, kLimit - 1};
+  for (int i = 0; i != 10000; ++i) {
+    const int bits = 1 + static_cast<int>(urbg() % 62);  // t < 2^62
+    const auto t = static_cast<std::int_fast64_t>(urbg() >> (64 - bits));
+    ts.push_back(i % 2 == 0 ? t : -t);
+  }
+  for (const std::int_fast64_t t : ts) {
+    EXPECT_EQ(civil_second() + t, detail::time_zone_era::civil_at(t)) << t;
+  }
+}
+
+TEST(TimeZoneEra, Extremes) {
+  // The instants at the ends of time_point<seconds> lie outside any era,
+  // without the bounds checks overflowing.
+  const auto tp_min = time_point<cctz::seconds>::min();
+  const auto tp_max = time_point<cctz::seconds>::max();
+  const std::int_fast64_t kEraLimit = std::int_fast64_t{1} << 59;
+  detail::time_zone_era era;
+  era.store(FromUnixSeconds(-kEraLimit), FromUnixSeconds(kEraLimit), -1,
+            false, "A", 1);
+  time_zone::absolute_lookup al;
+  EXPECT_FALSE(era.lookup(tp_min, &al));
+  EXPECT_FALSE(era.lookup(tp_max, &al));
+  EXPECT_FALSE(era.lookup(FromUnixSeconds(-kEraLimit - 1), &al));
+  EXPECT_FALSE(era.lookup(FromUnixSeconds(kEraLimit), &al));
+  ASSERT_TRUE(era.lookup(FromUnixSeconds(-kEraLimit), &al));
+  EXPECT_EQ(civil_second() + (-kEraLimit - 1), al.cs);
+  ASSERT_TRUE(era.lookup(FromUnixSeconds(kEraLimit - 1), &al));
+  EXPECT_EQ(civil_second() + (kEraLimit - 2), al.cs);
+
+  // And so do lookups of them in zones whose current era is cached.
+  const auto now = chrono::time_point_cast<cctz::seconds>(
+      chrono::system_clock::now());
+  std::vector<time_zone> zones = {utc_time_zone(),
+                                  fixed_time_zone(cctz::seconds(-3600))};
+  for (const char* const* np = kTimeZoneNames; *np != nullptr; ++np) {
+    zones.push_back(LoadZone(*np));
+  }
+  for (const time_zone& tz : zones) {
+    tz.lookup(now);  // caches the current era
+    time_zone::cursor cur(tz);
+    for (const auto tp : {tp_min, tp_min + cctz::seconds(1),
+                          tp_max - cctz::seconds(1), tp_max}) {
+      const auto al = tz.lookup(tp);
+      const auto cal = cur.lookup(tp);
+      EXPECT_EQ(cal.cs, al.cs) << tz.name();
+      EXPECT_EQ(cal.offset, al.offset) << tz.name();
+      EXPECT_EQ(cal.is_dst, al.is_dst) << tz.name();
+      EXPECT_STREQ(cal.abbr, al.abbr) << tz.name();
+    }
+  }
+}
+
+#if !defined(_WIN32)
+namespace {
+
+// The era that EraLookupHandler() reads, in the middle of whatever
+// time_zone_era::store() it interrupts.
+detail::time_zone_era interrupted_era;
+std::atomic<int> era_signals(0);
+std::atomic<int> era_hits(0);
+std::atomic<int> era_torn(0);
+
+// Looks up an instant in each of the two eras that TimeZoneEra.Torn
+// stores, counting the lookups that mix the fields of both.
+void EraLookupHandler(int) {
+  for (const int t : {500, 1500}) {
+    time_zone::absolute_lookup al;
+    std::size_t abbr_len;
+    if (interrupted_era.lookup(time_point<cctz::seconds>(cctz::seconds(t)),
+                               &al, &abbr_len)) {
+      ++era_hits;
+      const bool first = t < 1000;
+      if (al.offset != (first ? 1 : 2) || al.is_dst == first ||
+          al.abbr[0] != (first ? 'A' : 'B') || abbr_len != (first ? 1 : 2)) {
+        ++era_torn;
+      }
+    }
+  }
+  ++era_signals;
+}
+
+}  // namespace
+
+TEST(TimeZoneEra, Torn) {
+  // A lookup that interrupts store() must not accept the partly written
+  // era, so, for a second, signals interrupt a thread that keeps replacing
+  // it. (Catching a torn read relies on the timing of the interruptions,
+  // so a regression shows as an occasional failure.)
+  const auto tp = [](int s) { return time_point<cctz::seconds>(
+                                  cctz::seconds(s)); };
+  struct sigaction sa = {};
+  sa.sa_handler = EraLookupHandler;
+  struct sigaction old_sa;
+  ASSERT_EQ(0, sigaction(SIGUSR1, &sa, &old_sa));
+  interrupted_era.store(tp(0), tp(1000), 1, false, "A", 1);
+  std::atomic<bool> done(false);
+  std::thread writer([&done, &tp]() {
+    for (int i = 0; !done.load(std::memory_order_relaxed); ++i) {
+      if (i % 2 == 0) {
+        interrupted_era.store(tp(1000), tp(2000), 2, true, "BB", 2);
+      } else {
+        interrupted_era.store(tp(0), tp(1000), 1, false, "A", 1);
+      }
+    }
+  });
+  const auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+  while (chrono::steady_clock::now() < deadline) {
+    const int signals = era_signals.load();
+    pthread_kill(writer.native_handle(), SIGUSR1);
+    while (era_signals.load() == signals) std::this_thread::yield();
+  }
+  done.store(true);
+  writer.join();
+  sigaction(SIGUSR1, &old_sa, nullptr);
+  EXPECT_GT(era_hits.load(), 0);
+  EXPECT_EQ(0, era_torn.load());
+}
+#endif
+
+TEST(TimeZoneInfo, FutureOnDemand) {
+  TimeZoneInfo tz;
+  ASSERT_TRUE(tz.Load("file:America/Los_Angeles"));
+
+  // Only the zoneinfo transitions are stored, and nothing is generated
+  // from the future specification until the first lookup that needs it.
+  const std::string desc = tz.Description();
+  const int trans = std::atoi(desc.c_str() + desc.find('=') + 1);
+  EXPECT_LT(trans, 400) << desc;
+
+  const auto pdt = tz.MakeTime(civil_second(2600, 7, 1, 12, 0, 0));
+  EXPECT_EQ(time_zone::civil_lookup::UNIQUE, pdt.kind);
+  EXPECT_EQ(-7 * 60 * 60, tz.BreakTime(pdt.pre).offset);
+  const auto gap = tz.MakeTime(civil_second(2300, 3, 11, 2, 30, 0));
+  EXPECT_EQ(time_zone::civil_lookup::SKIPPED, gap.kind);
+  time_zone::civil_transition next;
+  ASSERT_TRUE(tz.NextTransition(gap.trans, &next));
+  EXPECT_EQ(civil_second(2300, 11, 4, 2, 0, 0), next.from);
+  EXPECT_EQ(desc, tz.Description());
+}
+
+TEST(TimeZoneInfo, Compact) {
+  for (const char* name : {"America/Los_Angeles", "Australia/Lord_Howe",
+                           "Europe/Dublin", "Asia/Kathmandu"}) {
+    TimeZoneInfo full;
+    TimeZoneInfo compact;
+    ASSERT_TRUE(full.Load(std::string("file:") + name));
+    use_compact_time_zones(true);
+    const bool loaded = compact.Load(std::string("file:") + name);
+    use_compact_time_zones(false);
+    ASSERT_TRUE(loaded);
+    EXPECT_FALSE(compact.SharesTables(full));
+
+    // Visit every transition, both ways, along with the times around it.
+    auto tp = time_point<cctz::seconds>::min();
+    time_zone::civil_transition trans;
+    time_zone::civil_transition ctrans;
+    for (int i = 0; i != 1000 && full.NextTransition(tp, &trans); ++i) {
+      ASSERT_TRUE(compact.NextTransition(tp, &ctrans)) << name;
+      EXPECT_EQ(trans.from, ctrans.from) << name;
+      EXPECT_EQ(trans.to, ctrans.to) << name;
+      tp = full.MakeTime(trans.to).trans;
+      ASSERT_TRUE(compact.PrevTransition(tp + cctz::seconds(1), &ctrans));
+      EXPECT_EQ(trans.from, ctrans.from) << name;
+      for (const auto& cs : {trans.from - 1, trans.from, trans.to - 1,
+                             trans.to, trans.to + 86400}) {
+        const auto cl = full.MakeTime(cs);
+        const auto ccl = compact.MakeTime(cs);
+        EXPECT_EQ(cl.kind, ccl.kind) << name << " " << cs;
+        EXPECT_EQ(cl.pre, ccl.pre) << name << " " << cs;
+        EXPECT_EQ(cl.trans, ccl.trans) << name << " " << cs;
+        EXPECT_EQ(cl.post, ccl.post) << name << " " << cs;
+      }
+      for (const auto& t : {tp - cctz::seconds(1), tp}) {
+        const auto al = full.BreakTime(t);
+        const auto cal = compact.BreakTime(t);
+        EXPECT_EQ(al.cs, cal.cs) << name;
+        EXPECT_EQ(al.offset, cal.offset) << name;
+        EXPECT_STREQ(al.abbr, cal.abbr) << name;
+      }
+    }
+    const civil_second far(2600, 7, 1);
+    EXPECT_EQ(full.BreakTime(full.MakeTime(far).pre).cs,
+              compact.BreakTime(compact.MakeTime(far).pre).cs);
+  }
+}
+
 TEST(StdChronoTimePoint, TimeTAlignment) {
   // Ensures that the Unix epoch and the system clock epoch are an integral
   // number of seconds apart. This simplifies conversions to/from time_t.
@@ -896,6 +1566,147 @@ TEST(BreakTime, LocalTimeInSydney) {
   EXPECT_EQ(weekday::thursday, get_weekday(convert(tp, tz)));
 }
 
+TEST(BreakTime, Batch) {
+  // Sorted instants, a few per year, that cross the last zic transition
+  // and run on past the span of the future_spec_ extension.
+  std::vector<time_point<cctz::seconds>> tps;
+  auto tp = convert(civil_second(1900, 1, 1, 0, 0, 0), utc_time_zone());
+  for (int i = 0; i != 3000; ++i) {
+    tps.push_back(tp);
+    tp += chrono::hours(24 * 122 + 7) + cctz::seconds(i);
+  }
+  std::vector<time_point<cctz::seconds>> shuffled = tps;
+  std::mt19937 urbg(42);  // a UniformRandomBitGenerator with fixed seed
+  std::shuffle(shuffled.begin(), shuffled.end(), urbg);
+
+  for (const char* name : {"UTC", "Fixed/UTC-08:00:00", "America/New_York",
+                           "Australia/Sydney", "Europe/Dublin"}) {
+    const time_zone tz = LoadZone(name);
+    for (const auto* input : {&tps, &shuffled}) {
+      std::vector<time_zone::absolute_lookup> als(input->size());
+      tz.lookup(input->data(), input->size(), als.data());
+      for (std::size_t i = 0; i != input->size(); ++i) {
+        const time_zone::absolute_lookup al = tz.lookup((*input)[i]);
+        EXPECT_EQ(al.cs, als[i].cs) << name;
+        EXPECT_EQ(al.offset, als[i].offset) << name;
+        EXPECT_EQ(al.is_dst, als[i].is_dst) << name;
+        EXPECT_STREQ(al.abbr, als[i].abbr) << name;
+      }
+    }
+  }
+
+  // An empty batch is fine.
+  LoadZone("America/New_York").lookup(tps.data(), 0, nullptr);
+}
+
+TEST(Cursor, MatchesLookup) {
+  std::vector<time_point<cctz::seconds>> tps;
+  auto tp = convert(civil_second(1900, 1, 1, 0, 0, 0), utc_time_zone());
+  for (int i = 0; i != 2000; ++i) {
+    tps.push_back(tp);
+    tp += chrono::hours(24 * 61 + 5) + cctz::seconds(i);
+  }
+  std::mt19937 urbg(42);  // a UniformRandomBitGenerator with fixed seed
+  std::vector<time_point<cctz::seconds>> shuffled = tps;
+  std::shuffle(shuffled.begin(), shuffled.end(), urbg);
+
+  for (const char* name : {"UTC", "America/New_York", "Australia/Sydney",
+                           "Europe/Dublin", "libc:UTC"}) {
+    const time_zone tz = LoadZone(name);
+    for (const auto* input : {&tps, &shuffled}) {
+      time_zone::cursor cur(tz);
+      EXPECT_EQ(tz, cur.zone());
+      for (const auto& t : *input) {
+        const time_zone::absolute_lookup al = tz.lookup(t);
+        const time_zone::absolute_lookup cal = cur.lookup(t);
+        EXPECT_EQ(al.cs, cal.cs) << name;
+        EXPECT_EQ(al.offset, cal.offset) << name;
+        EXPECT_EQ(al.is_dst, cal.is_dst) << name;
+        EXPECT_STREQ(al.abbr, cal.abbr) << name;
+
+        // Include the civil times either side of any transition.
+        for (const civil_second cs : {al.cs, al.cs - 3600, al.cs + 3600}) {
+          const time_zone::civil_lookup cl = tz.lookup(cs);
+          const time_zone::civil_lookup ccl = cur.lookup(cs);
+          EXPECT_EQ(cl.kind, ccl.kind) << name << " " << cs;
+          EXPECT_EQ(cl.pre, ccl.pre) << name << " " << cs;
+          EXPECT_EQ(cl.trans, ccl.trans) << name << " " << cs;
+          EXPECT_EQ(cl.post, ccl.post) << name << " " << cs;
+        }
+      }
+    }
+  }
+
+  // Cursors on separate threads do not interfere with one another.
+  const time_zone nyc = LoadZone("America/New_York");
+  std::vector<std::thread> threads;
+  std::vector<int> mismatches(8);
+  for (std::size_t i = 0; i != mismatches.size(); ++i) {
+    threads.emplace_back([&, i] {
+      time_zone::cursor cur(nyc);
+      for (std::size_t j = i; j < tps.size(); j += mismatches.size()) {
+        if (cur.lookup(tps[j]).cs != nyc.lookup(tps[j]).cs) ++mismatches[i];
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  for (const int n : mismatches) EXPECT_EQ(0, n);
+}
+
+TEST(TimeZoneConverter, MatchesConvert) {
+  const civil_second first(1900, 1, 1, 0, 0, 0);
+  const civil_second last(2100, 1, 1, 0, 0, 0);
+  const std::pair<const char*, const char*> pairs[] = {
+      {"America/New_York", "Australia/Lord_Howe"},
+      {"Australia/Sydney", "America/New_York"},
+      {"Europe/Dublin", "UTC"},
+      {"UTC", "America/Los_Angeles"},
+      {"Fixed/UTC+05:45:00", "Asia/Kathmandu"},
+      {"America/New_York", "America/New_York"},
+      {"libc:UTC", "Europe/London"},  // no table, as libc has no eras
+  };
+  for (const auto& pair : pairs) {
+    const time_zone from = LoadZone(pair.first);
+    const time_zone to = LoadZone(pair.second);
+    const time_zone_converter conv(from, to, first, last);
+
+    // Sorted civil times, from before the table to after it, including
+    // the civil times around every transition of either zone.
+    std::vector<civil_second> css;
+    for (civil_second cs(1880, 1, 1, 0, 0, 0); cs < civil_second(2120);
+         cs += 7 * 24 * 3600 + 3600 + 17 * 60) {
+      css.push_back(cs);
+    }
+    for (const time_zone& tz : {from, to}) {
+      auto tp = time_point<cctz::seconds>::min();
+      time_zone::civil_transition trans;
+      while (tz.next_transition(tp, &trans) && trans.from.year() < 2120) {
+        const time_point<cctz::seconds> at = tz.lookup(trans.to).trans;
+        const civil_second cs = convert(at, from);
+        for (int m = -180; m <= 180; m += 15) css.push_back(cs + m * 60);
+        tp = at;
+      }
+    }
+    std::sort(css.begin(), css.end());
+
+    std::vector<civil_second> out(css.size());
+    conv.convert(css.data(), css.size(), out.data());
+    for (std::size_t i = 0; i != css.size(); ++i) {
+      const civil_second want = convert(convert(css[i], from), to);
+      EXPECT_EQ(want, conv.convert(css[i]))
+          << pair.first << " " << pair.second << " " << css[i];
+      EXPECT_EQ(want, out[i])
+          << pair.first << " " << pair.second << " " << css[i];
+    }
+  }
+
+  // An empty range still converts.
+  const time_zone nyc = LoadZone("America/New_York");
+  const time_zone_converter empty(nyc, utc_time_zone(), last, first);
+  EXPECT_EQ(civil_second(2000, 1, 1, 5, 0, 0),
+            empty.convert(civil_second(2000, 1, 1, 0, 0, 0)));
+}
+
 TEST(MakeTime, TimePointResolution) {
   const time_zone utc = utc_time_zone();
   const time_point<chrono::nanoseconds> tp_ns =
@@ -1032,6 +1843,138 @@ TEST(MakeTime, SysSecondsLimits) {
   }
 }
 
+TEST(MakeTime, Batch) {
+  // Sorted civil times, a few per year, plus the civil times either side
+  // of each transition in a zone with both skipped and repeated times.
+  std::vector<civil_second> sorted;
+  for (civil_second cs(1900, 1, 1, 1, 30, 0); cs.year() < 2600;
+       cs += 60 * 60 * (24 * 122 + 7)) {
+    sorted.push_back(cs);
+  }
+  const time_zone nyc = LoadZone("America/New_York");
+  std::vector<civil_second> edges;
+  time_zone::civil_transition trans;
+  for (civil_second cs(1900, 1, 1, 0, 0, 0);
+       nyc.next_transition(nyc.lookup(cs).trans, &trans) &&
+       trans.to.year() < 2100;
+       cs = trans.to) {
+    edges.push_back(trans.from - 1);
+    edges.push_back(trans.from);
+    edges.push_back(trans.to);
+  }
+  std::vector<civil_second> shuffled = sorted;
+  shuffled.insert(shuffled.end(), edges.begin(), edges.end());
+  std::mt19937 urbg(42);  // a UniformRandomBitGenerator with fixed seed
+  std::shuffle(shuffled.begin(), shuffled.end(), urbg);
+  // A batch within a single summer, which takes the no-transition path.
+  std::vector<civil_second> summer;
+  for (civil_second cs(2020, 6, 1, 0, 0, 0); cs.month() < 9; cs += 3607) {
+    summer.push_back(cs);
+  }
+
+  for (const char* name : {"UTC", "Fixed/UTC-08:00:00", "America/New_York",
+                           "Australia/Sydney", "Europe/Dublin"}) {
+    const time_zone tz = LoadZone(name);
+    for (const auto* input : {&sorted, &edges, &shuffled, &summer}) {
+      std::vector<time_zone::civil_lookup> cls(input->size());
+      tz.lookup(input->data(), input->size(), cls.data());
+      for (std::size_t i = 0; i != input->size(); ++i) {
+        const time_zone::civil_lookup cl = tz.lookup((*input)[i]);
+        EXPECT_EQ(cl.kind, cls[i].kind) << name << " " << (*input)[i];
+        EXPECT_EQ(cl.pre, cls[i].pre) << name << " " << (*input)[i];
+        EXPECT_EQ(cl.trans, cls[i].trans) << name << " " << (*input)[i];
+        EXPECT_EQ(cl.post, cls[i].post) << name << " " << (*input)[i];
+      }
+    }
+  }
+
+  // An empty batch is fine.
+  nyc.lookup(sorted.data(), 0, nullptr);
+}
+
+TEST(TimeZone, LocalTimeZoneCache) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (std::getenv("TZDIR") == nullptr) GTEST_SKIP() << "${TZDIR} is unset";
+  const char* const ep = getenv("TZ");
+  const std::string tz_name = (ep != nullptr) ? ep : "";
+
+  // Changes to ${TZ} take effect on the very next call.
+  ASSERT_EQ(0, setenv("TZ", "America/New_York", 1));
+  refresh_local_time_zone();
+  EXPECT_EQ(LoadZone("America/New_York"), local_time_zone());
+  EXPECT_EQ(local_time_zone(), local_time_zone());
+  ASSERT_EQ(0, setenv("TZ", ":Asia/Tokyo", 1));
+  EXPECT_EQ(LoadZone("Asia/Tokyo"), local_time_zone());
+  ASSERT_EQ(0, setenv("TZ", "America/New_York", 1));
+  EXPECT_EQ(LoadZone("America/New_York"), local_time_zone());
+  ASSERT_EQ(0, unsetenv("TZ"));
+  EXPECT_EQ(LoadZone("/etc/localtime"), local_time_zone());
+
+  // A replaced zone file is read again after a refresh.
+  const std::string path = testing::TempDir() + "/localtime_cache_test";
+  ASSERT_TRUE(CopyZoneFile("America/Los_Angeles", path));
+  ASSERT_EQ(0, setenv("TZ", path.c_str(), 1));
+  refresh_local_time_zone();
+  const auto tp = chrono::system_clock::from_time_t(0);
+  const time_zone la = local_time_zone();
+  EXPECT_EQ(-8 * 60 * 60, la.lookup(tp).offset);
+  ASSERT_TRUE(CopyZoneFile("Asia/Tokyo", path));
+  refresh_local_time_zone();
+  const time_zone tokyo = local_time_zone();
+  EXPECT_NE(la, tokyo);
+  EXPECT_EQ(9 * 60 * 60, tokyo.lookup(tp).offset);
+  EXPECT_EQ(-8 * 60 * 60, la.lookup(tp).offset);  // still usable
+  EXPECT_EQ(tokyo, LoadZone(path));
+  std::remove(path.c_str());
+
+  if (ep == nullptr) {
+    ASSERT_EQ(0, unsetenv("TZ"));
+  } else {
+    ASSERT_EQ(0, setenv("TZ", tz_name.c_str(), 1));
+  }
+  refresh_local_time_zone();
+#endif
+}
+
+TEST(TimeZone, UpdateTimeZones) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  const std::string path = testing::TempDir() + "/update_time_zones_test";
+  if (!CopyZoneFile("America/Los_Angeles", path)) {
+    GTEST_SKIP() << "needs ${TZDIR}";
+  }
+  const time_zone tz = LoadZone(path);
+  const auto epoch = chrono::system_clock::from_time_t(0);
+  const auto now = chrono::system_clock::now();
+  const time_zone::absolute_lookup before = tz.lookup(now);
+
+  // An unchanged zone keeps its data (and so its abbreviations), even when
+  // its file is replaced, and then read again into the other layout.
+  update_time_zones();
+  EXPECT_EQ(before.abbr, tz.lookup(now).abbr);
+  ASSERT_TRUE(CopyZoneFile("America/Los_Angeles", path));
+  use_compact_time_zones(true);
+  update_time_zones();
+  use_compact_time_zones(false);
+  EXPECT_EQ(before.abbr, tz.lookup(now).abbr);
+
+  // A changed zone switches to the new data, in place.
+  EXPECT_EQ(-8 * 60 * 60, tz.lookup(epoch).offset);
+  ASSERT_TRUE(CopyZoneFile("Asia/Tokyo", path));
+  EXPECT_LE(1, update_time_zones());
+  EXPECT_EQ(tz, LoadZone(path));
+  EXPECT_EQ(9 * 60 * 60, tz.lookup(epoch).offset);
+  EXPECT_EQ(9 * 60 * 60, tz.lookup(now).offset);  // the current era too
+  EXPECT_EQ("JST", std::string(tz.lookup(now).abbr));
+  const std::string abbr = before.abbr;  // still valid
+  EXPECT_TRUE(abbr == "PST" || abbr == "PDT");
+
+  // Once the file has gone, the zone keeps the data it has.
+  std::remove(path.c_str());
+  update_time_zones();
+  EXPECT_EQ(9 * 60 * 60, tz.lookup(epoch).offset);
+#endif
+}
+
 TEST(MakeTime, LocalTimeLibC) {
   // Checks that cctz and libc agree on transition points in [1970:2037].
   //
@@ -1045,6 +1988,7 @@ TEST(MakeTime, LocalTimeLibC) {
   for (const char* const* np = kTimeZoneNames; *np != nullptr; ++np) {
     ASSERT_EQ(0, setenv("TZ", *np, 1));  // change what "localtime" means
     const auto zi = local_time_zone();
+    ASSERT_EQ(LoadZone(*np), zi);
     const auto lc = LoadZone("libc:localtime");
     time_zone::civil_transition transition;
     for (auto tp = zi.lookup(civil_second()).trans;
@@ -1115,6 +2059,95 @@ TEST(MakeTime, LocalTimeLibC) {
 #endif
 }
 
+TEST(BreakTime, LocalTimeLibC) {
+  // Checks that "libc:localtime" lookups, most of which its cache answers,
+  // agree with localtime_r(), including around every transition, and after
+  // each change to ${TZ}.
+#if defined(__linux__) && !defined(__ANDROID__)
+  const char* const ep = getenv("TZ");
+  const std::string tz_name = (ep != nullptr) ? ep : "";
+  const time_zone lc = LoadZone("libc:localtime");
+  for (const char* name : {"America/Los_Angeles", "Australia/Lord_Howe",
+                           "Europe/London", "Asia/Kolkata"}) {
+    ASSERT_EQ(0, setenv("TZ", name, 1));
+    tzset();
+    const time_zone zi = LoadZone(name);
+    std::vector<time_point<seconds>> tps;
+    time_zone::civil_transition transition;
+    for (auto tp = zi.lookup(civil_second()).trans;
+         zi.next_transition(tp, &transition);
+         tp = zi.lookup(transition.to).trans) {
+      if (transition.to.year() > 2037) break;  // for 32-bit time_t
+      const auto trans = zi.lookup(transition.to).trans;
+      for (const int delta : {-5400, -1800, -1, 0, 1, 1800, 5400}) {
+        tps.push_back(trans + seconds(delta));
+      }
+    }
+    std::vector<std::tm> tms;
+    for (const auto& tp : tps) {
+      const std::time_t t = chrono::system_clock::to_time_t(tp);
+      std::tm tm;
+      ASSERT_NE(nullptr, localtime_r(&t, &tm));
+      tms.push_back(tm);
+    }
+    auto agrees = [](const std::tm& tm, const time_zone::absolute_lookup& al) {
+      return al.cs == civil_second(tm.tm_year + 1900, tm.tm_mon + 1,
+                                   tm.tm_mday, tm.tm_hour, tm.tm_min,
+                                   tm.tm_sec) &&
+             al.offset == tm.tm_gmtoff && al.is_dst == (tm.tm_isdst > 0) &&
+             std::string(al.abbr) == tm.tm_zone;
+    };
+    for (int pass = 0; pass != 2; ++pass) {  // forwards, then backwards
+      for (std::size_t j = 0; j != tps.size(); ++j) {
+        const std::size_t i = (pass == 0) ? j : tps.size() - 1 - j;
+        const time_zone::absolute_lookup al = lc.lookup(tps[i]);
+        SCOPED_TRACE(testing::Message()
+                     << "For " << chrono::system_clock::to_time_t(tps[i])
+                     << " in " << name);
+        EXPECT_EQ(civil_second(tms[i].tm_year + 1900, tms[i].tm_mon + 1,
+                               tms[i].tm_mday, tms[i].tm_hour, tms[i].tm_min,
+                               tms[i].tm_sec),
+                  al.cs);
+        EXPECT_EQ(tms[i].tm_gmtoff, al.offset);
+        EXPECT_EQ(tms[i].tm_isdst > 0, al.is_dst);
+        EXPECT_STREQ(tms[i].tm_zone, al.abbr);
+      }
+    }
+
+    // Concurrent lookups, which race to learn and replace the eras, agree
+    // just the same.
+    std::atomic<int> disagreements(0);
+    std::vector<std::thread> threads;
+    const std::size_t kThreads = 4;
+    for (std::size_t t = 0; t != kThreads; ++t) {
+      threads.emplace_back([&, t]() {
+        for (std::size_t j = 0; j != 4 * tps.size(); ++j) {
+          const std::size_t i = (t * tps.size() / kThreads + j) % tps.size();
+          if (!agrees(tms[i], lc.lookup(tps[i]))) ++disagreements;
+        }
+      });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(0, disagreements.load());
+  }
+
+  // A putenv() string that is changed in place is a change of ${TZ}, even
+  // though getenv() returns the same pointer.
+  static char tz_env[] = "TZ=America/Los_Angeles";
+  ASSERT_EQ(0, putenv(tz_env));
+  const auto summer = chrono::system_clock::from_time_t(1593561600);
+  EXPECT_EQ(-7 * 60 * 60, lc.lookup(summer).offset);
+  std::strcpy(tz_env, "TZ=Asia/Tokyo");
+  EXPECT_EQ(9 * 60 * 60, lc.lookup(summer).offset);
+  EXPECT_STREQ("JST", lc.lookup(summer).abbr);
+  if (ep == nullptr) {
+    ASSERT_EQ(0, unsetenv("TZ"));
+  } else {
+    ASSERT_EQ(0, setenv("TZ", tz_name.c_str(), 1));
+  }
+#endif
+}
+
 TEST(NextTransition, UTC) {
   const auto tz = utc_time_zone();
   time_zone::civil_transition trans;
@@ -1178,6 +2211,121 @@ TEST(PrevTransition, AmericaNewYork) {
   // We have a transition but we don't know which one.
 }
 
+TEST(NextTransition, ExtendedYears) {
+  // Lookups in the years generated from the future specification locate
+  // their transition by year, so check them against next_transition(),
+  // which always searches. Fresh cursors ensure there is no search hint.
+  for (const char* name : {"America/New_York", "Australia/Sydney",
+                           "Europe/Dublin", "America/Santiago"}) {
+    const time_zone tz = LoadZone(name);
+    auto tp = convert(civil_second(2040, 1, 1, 0, 0, 0), tz);
+    const auto end = convert(civil_second(2350, 1, 1, 0, 0, 0), tz);
+    time_zone::civil_transition trans;
+    int count = 0;
+    while (tz.next_transition(tp, &trans)) {
+      tp = tz.lookup(trans.to).trans;
+      if (tp >= end) break;
+      EXPECT_EQ(trans.to, time_zone::cursor(tz).lookup(tp).cs) << name;
+      EXPECT_EQ(trans.from,
+                time_zone::cursor(tz).lookup(tp - cctz::seconds(1)).cs + 1)
+          << name;
+      EXPECT_EQ(tp, time_zone::cursor(tz).lookup(trans.to).trans) << name;
+      if (trans.from < trans.to) {  // trans.from was skipped
+        EXPECT_EQ(tp, time_zone::cursor(tz).lookup(trans.from).trans) << name;
+      }
+      ++count;
+    }
+    EXPECT_EQ(2 * (2350 - 2040), count) << name;
+  }
+}
+
+TEST(Transitions, MatchesNextTransition) {
+  for (const char* name :
+       {"America/New_York", "Australia/Lord_Howe", "Europe/Dublin",
+        "Asia/Kathmandu", "UTC", "Fixed/UTC+05:00:00", "libc:UTC"}) {
+    const time_zone tz = LoadZone(name);
+    // From the first transition into the generated future years.
+    const auto begin = time_point<cctz::seconds>::min();
+    const auto end = convert(civil_second(2500, 1, 1, 0, 0, 0), tz);
+    std::vector<time_zone::civil_transition> want;
+    auto tp = begin;
+    time_zone::civil_transition trans;
+    while (tz.next_transition(tp, &trans)) {
+      tp = tz.lookup(trans.to).trans;
+      if (tp >= end) break;
+      want.push_back(trans);
+    }
+
+    const time_zone::transition_range range = tz.transitions(begin, end);
+    EXPECT_EQ(want.empty(), range.empty()) << name;
+    std::vector<time_zone::civil_transition> got;
+    for (const auto& t : range) got.push_back(t);
+    ASSERT_EQ(want.size(), got.size()) << name;
+    for (std::size_t i = 0; i != want.size(); ++i) {
+      EXPECT_EQ(want[i].from, got[i].from) << name;
+      EXPECT_EQ(want[i].to, got[i].to) << name;
+    }
+
+    got.clear();
+    for (auto it = range.rbegin(); it != range.rend(); ++it) {
+      got.push_back({it->from, (*it).to});
+    }
+    std::reverse(got.begin(), got.end());
+    ASSERT_EQ(want.size(), got.size()) << name;
+    for (std::size_t i = 0; i != want.size(); ++i) {
+      EXPECT_EQ(want[i].from, got[i].from) << name;
+      EXPECT_EQ(want[i].to, got[i].to) << name;
+    }
+
+    // The standard algorithms take the iterators too.
+    EXPECT_EQ(static_cast<std::ptrdiff_t>(want.size()),
+              std::distance(range.begin(), range.end()))
+        << name;
+    got.assign(range.rbegin(), range.rend());
+    std::reverse(got.begin(), got.end());
+    ASSERT_EQ(want.size(), got.size()) << name;
+    if (!want.empty()) {
+      EXPECT_EQ(want.back().to, std::prev(range.end())->to) << name;
+      EXPECT_EQ(want.front().to, got.front().to) << name;
+    }
+  }
+
+  // The iterators are default-constructible, and dereference to the
+  // transition that they hold.
+  static_assert(
+      std::is_same<const time_zone::civil_transition&,
+                   decltype(*time_zone::transition_iterator())>::value,
+      "transition_iterator::reference");
+  static_assert(
+      std::is_same<const time_zone::civil_transition&,
+                   decltype(*time_zone::reverse_transition_iterator())>::value,
+      "reverse_transition_iterator::reference");
+  time_zone::transition_iterator first;
+  time_zone::reverse_transition_iterator last;
+
+  // A transition at the beginning of the range is included, and one at
+  // the end is not.
+  const time_zone nyc = LoadZone("America/New_York");
+  const auto spring = convert(civil_second(2018, 3, 11, 3, 0, 0), nyc);
+  const auto fall = convert(civil_second(2018, 11, 4, 1, 0, 0), nyc) +
+                    chrono::hours(1);
+  const time_zone::transition_range range = nyc.transitions(spring, fall);
+  first = range.begin();
+  last = range.rbegin();
+  EXPECT_EQ(first.operator->(), &*first);  // no temporary copy
+  EXPECT_EQ(first->to, last->to);
+  EXPECT_EQ(range.rend(), ++last);
+  EXPECT_EQ(range.rbegin(), --last);
+  auto it = range.begin();
+  ASSERT_NE(range.end(), it);
+  EXPECT_EQ(civil_second(2018, 3, 11, 2, 0, 0), it->from);
+  EXPECT_EQ(civil_second(2018, 3, 11, 3, 0, 0), it->to);
+  EXPECT_EQ(range.end(), ++it);
+  EXPECT_EQ(civil_second(2018, 3, 11, 3, 0, 0), (*--it).to);
+  EXPECT_EQ(range.begin(), it);
+  EXPECT_TRUE(nyc.transitions(fall, spring).empty());
+}
+
 TEST(TimeZoneEdgeCase, AmericaNewYork) {
   const time_zone tz = LoadZone("America/New_York");
 
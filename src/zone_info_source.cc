@@ -19,6 +19,8 @@ namespace cctz {
 // Defined out-of-line to avoid emitting a weak vtable in all TUs.
 ZoneInfoSource::~ZoneInfoSource() {}
 std::string ZoneInfoSource::Version() const { return std::string(); }
+const char* ZoneInfoSource::Data() const { return nullptr; }
+std::size_t ZoneInfoSource::Size() const { return 0; }
 
 }  // namespace cctz
 